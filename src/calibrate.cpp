@@ -0,0 +1,764 @@
+/**
+ * calibrate.cpp
+ *
+ * Checks how closely the simulation matches real football. Plays a large batch
+ * of games in parallel and compares them against:
+ *
+ *  - the play mix (run, short pass, long pass) by down and distance in the
+ *    training data, either the CSV training set or a playcall-ingest feature
+ *    cache, and
+ *  - per team, per game targets for points, yards and turnovers, read from a
+ *    small text file (see calibration_targets.txt).
+ *
+ * For each comparison it prints the simulated value with a 95% confidence
+ * interval, along with how far it is from the reference.
+ *
+ * With --tune, it instead searches for play outcome tables (see ruleset.h)
+ * that bring the simulation closer to the reference, and writes them out as a
+ * ruleset file the driver can load, and optionally as a header to build in.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/context.h"
+#include "engine/game.h"
+#include "engine/observers.h"
+#include "engine/playcall.h"
+#include "engine/ruleset.h"
+#include "engine/stats.h"
+#include "engine/threadpool.h"
+#include "learn/features.h"
+#include "learn/model.h"
+
+/* Number of calls the model makes: run, short pass and long pass. */
+static const unsigned int NUM_CALLS = LONG_PASS + 1;
+static const unsigned int NUM_DOWNS = 4;
+
+enum DistanceBucket { SHORT_YARDAGE,
+    MEDIUM_YARDAGE,
+    LONG_YARDAGE,
+    NUM_BUCKETS };
+
+static const char* const BUCKET_NAMES[NUM_BUCKETS] = { "1-3", "4-7", "8+" };
+static const char* const CALL_NAMES[NUM_CALLS] = { "run", "short_pass", "long_pass" };
+
+static DistanceBucket bucketOf(int distance)
+{
+    if (distance <= 3)
+        return SHORT_YARDAGE;
+    return distance <= 7 ? MEDIUM_YARDAGE : LONG_YARDAGE;
+}
+
+/* Per team, per game stats compared against targets. */
+enum Stat { POINTS,
+    PASSING_YARDS,
+    RUSHING_YARDS,
+    SACKS,
+    INTERCEPTIONS,
+    TURNOVERS,
+    NUM_STATS };
+
+static const char* const STAT_NAMES[NUM_STATS] = {
+    "points",
+    "passing_yards",
+    "rushing_yards",
+    "sacks",
+    "interceptions",
+    "turnovers"
+};
+
+/* Number of each call made, by down and distance. */
+struct PlayMix {
+    uint64_t counts[NUM_DOWNS][NUM_BUCKETS][NUM_CALLS] = {};
+
+    void add(int down, int distance, unsigned int call)
+    {
+        if (down >= 1 && down <= static_cast<int>(NUM_DOWNS) && call < NUM_CALLS)
+            counts[down - 1][bucketOf(distance)][call]++;
+    }
+
+    void add(const PlayMix& other)
+    {
+        for (unsigned int d = 0; d < NUM_DOWNS; d++)
+            for (unsigned int b = 0; b < NUM_BUCKETS; b++)
+                for (unsigned int c = 0; c < NUM_CALLS; c++)
+                    counts[d][b][c] += other.counts[d][b][c];
+    }
+
+    uint64_t total(unsigned int down, unsigned int bucket) const
+    {
+        uint64_t n = 0;
+        for (unsigned int c = 0; c < NUM_CALLS; c++)
+            n += counts[down][bucket][c];
+        return n;
+    }
+};
+
+/* What a stat should look like, per team per game. */
+struct Target {
+    bool known = false;
+    double mean = 0;
+    double sd = 0;
+};
+
+/* Everything measured from the simulated games. */
+struct Measurements {
+    PlayMix mix;
+    Moments stats[NUM_STATS];
+    uint64_t games = 0;
+    uint64_t plays = 0;
+
+    void add(const Measurements& other)
+    {
+        mix.add(other.mix);
+        for (unsigned int s = 0; s < NUM_STATS; s++)
+            stats[s].add(other.stats[s]);
+        games += other.games;
+        plays += other.plays;
+    }
+};
+
+/* Counts calls by situation, and turnovers by team, over one game. */
+class CalibrationObserver {
+private:
+    int down;
+    int distance;
+    bool homeOnOffense;
+
+public:
+    static constexpr unsigned int events = SNAP_EVENT | PLAY_EVENT;
+
+    PlayMix mix;
+    unsigned int homeTurnovers = 0;
+    unsigned int awayTurnovers = 0;
+
+    void onGameEvent(GameEvent event, Game* game)
+    {
+        if (event == SNAP_EVENT) {
+            down = game->getSituation()->down;
+            distance = game->getSituation()->distance;
+            homeOnOffense = game->isHomeOnOffense();
+            return;
+        }
+
+        mix.add(down, distance, game->getLastOffenseCall());
+
+        const PlayOutcome* outcome = game->getLastOutcome();
+        bool turnover = outcome->result == INTERCEPTION
+            || (outcome->result == FUMBLE && outcome->changePoss);
+        if (turnover)
+            (homeOnOffense ? homeTurnovers : awayTurnovers)++;
+    }
+};
+
+/* Adds one team's side of a finished game to the stats. */
+static void addTeam(Measurements& m, unsigned int points, const TeamStats& stats,
+    unsigned int turnovers)
+{
+    m.stats[POINTS].add(points);
+    m.stats[PASSING_YARDS].add(stats.passingYards);
+    m.stats[RUSHING_YARDS].add(stats.rushingYards);
+    m.stats[SACKS].add(stats.sacks);
+    m.stats[INTERCEPTIONS].add(stats.interceptions);
+    m.stats[TURNOVERS].add(turnovers);
+}
+
+/**
+ * Reads the play mix out of training data, either a feature cache or the CSV
+ * training set (Quarter,Minute,Second,Down,ToGo,YardLine,Outcome). Rows that
+ * aren't an offensive snap with a known call are skipped. Returns false if the
+ * file can't be read.
+ */
+static bool loadReferenceMix(const std::string& path, PlayMix& mix)
+{
+    if (isFeatureCache(path)) {
+        try {
+            FeatureCache cache(path);
+            const double* features = cache.features();
+            for (uint64_t i = 0; i < cache.numSamples(); i++) {
+                const double* f = features + i * cache.numFeatures();
+                mix.add(f[FEATURE_DOWN], f[FEATURE_DISTANCE], cache.labels()[i]);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line)) {
+        int quarter, minute, second, down, distance, yardLine, call;
+        if (std::sscanf(line.c_str(), "%d,%d,%d,%d,%d,%d,%d", &quarter, &minute,
+                &second, &down, &distance, &yardLine, &call)
+            == 7)
+            mix.add(down, distance, call);
+    }
+
+    return true;
+}
+
+/* Reads "name mean sd" lines, ignoring blank lines and # comments. */
+static bool loadTargets(const std::string& path, Target targets[NUM_STATS])
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        double mean, sd;
+        if (!(fields >> name) || name[0] == '#' || !(fields >> mean >> sd))
+            continue;
+
+        for (unsigned int s = 0; s < NUM_STATS; s++) {
+            if (name == STAT_NAMES[s])
+                targets[s] = { true, mean, sd };
+        }
+    }
+
+    return true;
+}
+
+/* Jensen-Shannon divergence of two distributions over calls, in bits. */
+static double jsDivergence(const double p[NUM_CALLS], const double q[NUM_CALLS])
+{
+    double js = 0;
+    for (unsigned int c = 0; c < NUM_CALLS; c++) {
+        double m = (p[c] + q[c]) / 2;
+        if (p[c] > 0)
+            js += p[c] / 2 * std::log2(p[c] / m);
+        if (q[c] > 0)
+            js += q[c] / 2 * std::log2(q[c] / m);
+    }
+    return js;
+}
+
+/* KL divergence from a normal fit to the reference normal, in nats. */
+static double normalKL(double mean, double sd, double refMean, double refSd)
+{
+    if (sd <= 0 || refSd <= 0)
+        return NAN;
+    double diff = mean - refMean;
+    return std::log(refSd / sd) + (sd * sd + diff * diff) / (2 * refSd * refSd) - 0.5;
+}
+
+static void proportions(const PlayMix& mix, unsigned int d, unsigned int b, double p[NUM_CALLS])
+{
+    uint64_t n = mix.total(d, b);
+    for (unsigned int c = 0; c < NUM_CALLS; c++)
+        p[c] = n > 0 ? static_cast<double>(mix.counts[d][b][c]) / n : 0;
+}
+
+/* JS divergence of each down and distance, weighted by how often it comes up
+ * in the reference. */
+static double mixDivergence(const PlayMix& sim, const PlayMix& ref)
+{
+    double weighted = 0;
+    uint64_t refTotal = 0;
+    for (unsigned int d = 0; d < NUM_DOWNS; d++) {
+        for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+            uint64_t refN = ref.total(d, b);
+            if (sim.total(d, b) == 0 || refN == 0)
+                continue;
+
+            double p[NUM_CALLS], q[NUM_CALLS];
+            proportions(ref, d, b, p);
+            proportions(sim, d, b, q);
+            weighted += jsDivergence(p, q) * refN;
+            refTotal += refN;
+        }
+    }
+
+    return refTotal > 0 ? weighted / refTotal : 0;
+}
+
+/* What the tuner minimizes: the play mix divergence plus the KL divergence of
+ * every stat that has a target. */
+static double divergence(const Measurements& sim, const PlayMix& ref,
+    const Target targets[NUM_STATS])
+{
+    double total = mixDivergence(sim.mix, ref);
+    for (unsigned int s = 0; s < NUM_STATS; s++) {
+        if (!targets[s].known)
+            continue;
+        double kl = normalKL(sim.stats[s].mean(), std::sqrt(sim.stats[s].variance()),
+            targets[s].mean, targets[s].sd);
+        if (!std::isnan(kl))
+            total += kl;
+    }
+    return total;
+}
+
+static void reportPlayMix(const PlayMix& sim, const PlayMix& ref)
+{
+    std::printf("Play mix by down and distance, %% run / short pass / long pass\n");
+    std::printf("%-4s %-6s %-20s %-20s %-7s %-8s\n", "down", "to go", "reference",
+        "simulated", "+/-", "JS bits");
+
+    bool any = false;
+    for (unsigned int d = 0; d < NUM_DOWNS; d++) {
+        for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+            uint64_t n = sim.total(d, b);
+            uint64_t refN = ref.total(d, b);
+            if (n == 0 || refN == 0)
+                continue;
+
+            double p[NUM_CALLS], q[NUM_CALLS];
+            proportions(ref, d, b, p);
+            proportions(sim, d, b, q);
+
+            double halfWidth = 0;
+            for (unsigned int c = 0; c < NUM_CALLS; c++)
+                halfWidth = std::max(halfWidth, Z_95 * std::sqrt(q[c] * (1 - q[c]) / n));
+
+            double js = jsDivergence(p, q);
+            any = true;
+
+            std::printf("%-4u %-6s %5.1f %5.1f %5.1f    %5.1f %5.1f %5.1f    %-7.2f %-8.5f\n",
+                d + 1, BUCKET_NAMES[b], 100 * p[0], 100 * p[1], 100 * p[2],
+                100 * q[0], 100 * q[1], 100 * q[2], 100 * halfWidth, js);
+        }
+    }
+
+    if (any)
+        std::printf("Weighted JS divergence: %.5f bits\n", mixDivergence(sim, ref));
+}
+
+static void reportStats(const Measurements& sim, const Target targets[NUM_STATS])
+{
+    std::printf("\nPer team, per game\n");
+    std::printf("%-14s %-22s %-18s %-8s %-8s\n", "stat", "simulated (95% CI)",
+        "target (sd)", "z", "KL nats");
+
+    for (unsigned int s = 0; s < NUM_STATS; s++) {
+        const Moments& m = sim.stats[s];
+        double mean = m.mean();
+        double sd = std::sqrt(m.variance());
+        double halfWidth = m.halfWidth();
+
+        std::printf("%-14s %8.2f +/- %-9.3f ", STAT_NAMES[s], mean, halfWidth);
+        if (targets[s].known) {
+            const Target& t = targets[s];
+            std::printf("%7.2f (%6.2f)   %-8.2f %-8.4f\n", t.mean, t.sd,
+                t.sd > 0 ? (mean - t.mean) / t.sd : NAN, normalKL(mean, sd, t.mean, t.sd));
+        } else {
+            std::printf("%-18s\n", "-");
+        }
+    }
+}
+
+/* Which tables --tune may change. */
+enum TuneFlags { TUNE_MODS = 1,
+    TUNE_GAINS = 2 };
+
+struct CalibrationOptions {
+    BatchConfig batch;
+    std::string reference;
+    std::string targets;
+    std::string rules;
+    unsigned int tune;
+    unsigned int rounds;
+    std::string output;
+    std::string header;
+};
+
+static void printUsage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options] [TRAINING_DATA]\n"
+              << "Compares simulated games against the training data (default\n"
+              << "training_set.csv, or a feature cache) and per game targets.\n\n"
+              << "  -n, --games N          number of games to simulate, or with --tune,\n"
+              << "                         to try each candidate on (default 100000)\n"
+              << "  -j, --threads N        number of worker threads (default: all cores)\n"
+              << "  -s, --seed N           base seed for the batch (default: current time)\n"
+              << "  -t, --targets FILE     per game targets (default calibration_targets.txt)\n"
+              << "  -r, --rules FILE       ruleset to simulate, or to start tuning from\n"
+              << "                         (default: the built in tables)\n"
+              << "  -T, --tune TABLES      tune mods, gains or all of the tables\n"
+              << "  -R, --rounds N         most passes over the tables to tune (default 3)\n"
+              << "  -o, --output FILE      where to write the tuned ruleset\n"
+              << "                         (default tuned-rules.txt)\n"
+              << "      --header FILE      also write it as a header with a constexpr Ruleset\n"
+              << "  -h, --help             show this message\n";
+}
+
+static bool parseTune(const char* arg, unsigned int& tune)
+{
+    std::string name(arg);
+    if (name == "mods")
+        tune = TUNE_MODS;
+    else if (name == "gains")
+        tune = TUNE_GAINS;
+    else if (name == "all")
+        tune = TUNE_MODS | TUNE_GAINS;
+    else
+        return false;
+
+    return true;
+}
+
+static bool parseOptions(int argc, char* argv[], CalibrationOptions& opts)
+{
+    enum { HEADER_OPT = 256 };
+    static const struct option longOpts[] = {
+        { "games", required_argument, nullptr, 'n' },
+        { "threads", required_argument, nullptr, 'j' },
+        { "seed", required_argument, nullptr, 's' },
+        { "targets", required_argument, nullptr, 't' },
+        { "rules", required_argument, nullptr, 'r' },
+        { "tune", required_argument, nullptr, 'T' },
+        { "rounds", required_argument, nullptr, 'R' },
+        { "output", required_argument, nullptr, 'o' },
+        { "header", required_argument, nullptr, HEADER_OPT },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    opts.batch.seed = time(0);
+    opts.batch.numGames = 100000;
+    opts.batch.numThreads = std::max(1u, std::thread::hardware_concurrency());
+    opts.batch.home.type = AI_TEAM;
+    opts.batch.away.type = AI_TEAM;
+    opts.reference = "training_set.csv";
+    opts.targets = "calibration_targets.txt";
+    opts.tune = 0;
+    opts.rounds = 3;
+    opts.output = "tuned-rules.txt";
+
+    int c;
+    while ((c = getopt_long(argc, argv, "n:j:s:t:r:T:R:o:h", longOpts, nullptr)) != -1) {
+        switch (c) {
+        case 'n':
+            opts.batch.numGames = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'j':
+            opts.batch.numThreads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 's':
+            opts.batch.seed = std::strtoull(optarg, nullptr, 0);
+            break;
+        case 't':
+            opts.targets = optarg;
+            break;
+        case 'r':
+            opts.rules = optarg;
+            break;
+        case 'T':
+            if (!parseTune(optarg, opts.tune)) {
+                std::cerr << "Invalid argument for --tune: " << optarg << '\n';
+                return false;
+            }
+            break;
+        case 'R':
+            opts.rounds = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'o':
+            opts.output = optarg;
+            break;
+        case HEADER_OPT:
+            opts.header = optarg;
+            break;
+        case 'h':
+        default:
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (optind < argc)
+        opts.reference = argv[optind];
+
+    if (opts.batch.numGames == 0 || opts.batch.numThreads == 0) {
+        std::cerr << "Need at least one game and one thread\n";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Plays the batch with the context's current ruleset and measures it. Each
+ * game is counted into a local observer first, and only added to the totals,
+ * under the lock, once it's over.
+ */
+static Measurements simulate(const BatchConfig& batch, ThreadPool& pool)
+{
+    Measurements total;
+    std::mutex lock;
+    GameRunner run = [&](Game* game) {
+        CalibrationObserver obs;
+        ObservedGame<CalibrationObserver> observed(game, obs);
+        observed.gameLoop();
+
+        Measurements m;
+        m.mix = obs.mix;
+        addTeam(m, game->getHomeScore(), *game->getHomeStats(), obs.homeTurnovers);
+        addTeam(m, game->getAwayScore(), *game->getAwayStats(), obs.awayTurnovers);
+        m.games = 1;
+        m.plays = game->getStepCount();
+
+        std::lock_guard<std::mutex> guard(lock);
+        total.add(m);
+    };
+    ResultSink sink = [](unsigned int, size_t, const GameResult&) {};
+
+    runBatch(batch, run, sink, pool);
+    return total;
+}
+
+/* One table entry the tuner may change, and the values it may take. */
+struct Parameter {
+    std::string name;
+    int* value;
+    int min;
+    int max;
+    int step;
+};
+
+static std::vector<Parameter> tunableParameters(Ruleset& rules, unsigned int tune)
+{
+    std::vector<Parameter> params;
+
+    if (tune & TUNE_MODS) {
+        for (unsigned int o = 0; o < NUM_MOD_CALLS; o++) {
+            for (unsigned int d = 0; d < NUM_MOD_CALLS; d++) {
+                for (unsigned int r = 0; r < NUM_MOD_ROLLS; r++) {
+                    std::string name = std::string(CALL_NAMES[o]) + " vs " + CALL_NAMES[d]
+                        + ", roll " + std::to_string(r + 2);
+                    params.push_back({ name, &rules.defensiveMods[o][d][r], MIN_DEF_MOD, MAX_DEF_MOD, 1 });
+                }
+            }
+        }
+    }
+
+    if (tune & TUNE_GAINS) {
+        auto addGains = [&](const char* table, Gain* gains, unsigned int count, unsigned int firstRoll) {
+            for (unsigned int i = 0; i < count; i++) {
+                std::string name = std::string(table) + " roll " + std::to_string(firstRoll + i);
+                // long gains move in bigger steps, or they'd take forever to go anywhere
+                int step = gains[i].base >= 10 ? 5 : 1;
+                params.push_back({ name + " base", &gains[i].base, 0, 99, step });
+                // the fast path in rollDice() goes up to 4 dice
+                params.push_back({ name + " dice", &gains[i].dice, 0, 4, 1 });
+            }
+        };
+        addGains("short_pass", rules.shortPass, SHORT_PASS_GAINS, SHORT_PASS_FIRST_GAIN);
+        addGains("long_pass", rules.longPass, LONG_PASS_GAINS, LONG_PASS_FIRST_GAIN);
+        addGains("run", rules.run, RUN_GAINS, RUN_FIRST_GAIN);
+    }
+
+    return params;
+}
+
+/**
+ * Coordinate descent over the chosen table entries. Each entry in turn is
+ * stepped up, or failing that down, for as long as that lowers the divergence,
+ * and passes are made over all of them until one changes nothing or the rounds
+ * run out.
+ *
+ * Every candidate is played with the same seeds (common random numbers), so
+ * game i of one candidate starts from the same dice as game i of any other.
+ * The difference between two candidates is then mostly down to their tables
+ * rather than luck, and far fewer games are needed to tell them apart than to
+ * measure either one on its own. The flip side is that the tables can end up
+ * fit to the seed, so check the result with calibrate --rules and another
+ * seed.
+ */
+static Ruleset tune(const CalibrationOptions& opts, EngineContext& context,
+    ThreadPool& pool, const PlayMix& reference, const Target targets[NUM_STATS])
+{
+    Ruleset best = context.getRuleset();
+    std::vector<Parameter> params = tunableParameters(best, opts.tune);
+
+    unsigned int evaluations = 0;
+    auto evaluate = [&]() {
+        context.setRuleset(std::make_shared<const Ruleset>(best));
+        evaluations++;
+        return divergence(simulate(opts.batch, pool), reference, targets);
+    };
+
+    double bestScore = evaluate();
+    std::cerr << "tuning " << params.size() << " entries, starting divergence "
+              << bestScore << '\n';
+
+    for (unsigned int round = 0; round < opts.rounds; round++) {
+        bool changed = false;
+        for (Parameter& p : params) {
+            int start = *p.value;
+            for (int direction : { 1, -1 }) {
+                while (true) {
+                    int old = *p.value;
+                    int next = old + direction * p.step;
+                    if (next < p.min || next > p.max)
+                        break;
+
+                    *p.value = next;
+                    double score = evaluate();
+                    if (score >= bestScore) {
+                        *p.value = old;
+                        break;
+                    }
+                    bestScore = score;
+                }
+
+                if (*p.value != start)
+                    break;
+            }
+
+            if (*p.value != start) {
+                changed = true;
+                std::cerr << "  " << p.name << ": " << start << " -> " << *p.value
+                          << ", divergence " << bestScore << '\n';
+            }
+        }
+
+        std::cerr << "round " << round + 1 << " done after " << evaluations
+                  << " batches, divergence " << bestScore << '\n';
+        if (!changed)
+            break;
+    }
+
+    context.setRuleset(std::make_shared<const Ruleset>(best));
+    return best;
+}
+
+static void writeGainsHeader(std::ostream& out, const Gain* gains, unsigned int count)
+{
+    out << "    {";
+    for (unsigned int i = 0; i < count; i++)
+        out << (i > 0 ? ", " : " ") << "{ " << gains[i].base << ", " << gains[i].dice << " }";
+    out << " }";
+}
+
+/* Writes rules as a header defining a constexpr TUNED_RULESET. */
+static void writeRulesetHeader(std::ostream& out, const Ruleset& rules)
+{
+    out << "/* Written by calibrate --tune. */\n"
+        << "#ifndef __TUNED_RULESET_H\n"
+        << "#define __TUNED_RULESET_H\n\n"
+        << "#include \"engine/ruleset.h\"\n\n"
+        << "constexpr Ruleset TUNED_RULESET = {\n"
+        << "    {";
+    for (unsigned int o = 0; o < NUM_MOD_CALLS; o++) {
+        out << (o > 0 ? ",\n        {" : " {");
+        for (unsigned int d = 0; d < NUM_MOD_CALLS; d++) {
+            out << (d > 0 ? ",\n            {" : " {");
+            for (unsigned int r = 0; r < NUM_MOD_ROLLS; r++)
+                out << (r > 0 ? ", " : " ") << rules.defensiveMods[o][d][r];
+            out << " }";
+        }
+        out << " }";
+    }
+    out << " },\n";
+    writeGainsHeader(out, rules.shortPass, SHORT_PASS_GAINS);
+    out << ",\n";
+    writeGainsHeader(out, rules.longPass, LONG_PASS_GAINS);
+    out << ",\n";
+    writeGainsHeader(out, rules.run, RUN_GAINS);
+    out << "\n};\n\n#endif\n";
+}
+
+/* Writes the tuned tables wherever they were asked for. */
+static bool saveRuleset(const CalibrationOptions& opts, const Ruleset& rules)
+{
+    std::ofstream out(opts.output);
+    writeRuleset(out, rules);
+    if (!out) {
+        std::cerr << "Could not write " << opts.output << '\n';
+        return false;
+    }
+    std::cerr << "wrote tuned ruleset to " << opts.output << '\n';
+
+    if (!opts.header.empty()) {
+        std::ofstream header(opts.header);
+        writeRulesetHeader(header, rules);
+        if (!header) {
+            std::cerr << "Could not write " << opts.header << '\n';
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    CalibrationOptions opts;
+    if (!parseOptions(argc, argv, opts))
+        return 1;
+
+    PlayMix reference;
+    if (!loadReferenceMix(opts.reference, reference)) {
+        std::cerr << "Could not read training data from " << opts.reference << '\n';
+        return 1;
+    }
+
+    Target targets[NUM_STATS];
+    if (!loadTargets(opts.targets, targets))
+        std::cerr << "Could not read " << opts.targets << ", only comparing the play mix\n";
+
+    std::shared_ptr<const PlaycallModel> model;
+    try {
+        model = loadModel();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    EngineContext context(model, opts.batch.seed);
+    opts.batch.context = &context;
+
+    if (!opts.rules.empty()) {
+        try {
+            context.setRuleset(std::make_shared<const Ruleset>(loadRuleset(opts.rules)));
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    // Tuning plays a lot of batches, so keep one set of threads for all of them.
+    ThreadPool pool(opts.batch.numThreads);
+
+    if (opts.tune) {
+        Ruleset tuned = tune(opts, context, pool, reference, targets);
+        if (!saveRuleset(opts, tuned))
+            return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Measurements total = simulate(opts.batch, pool);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    reportPlayMix(total.mix, reference);
+    reportStats(total, targets);
+
+    double secs = elapsed.count();
+    std::cerr << total.games << " games, " << total.plays << " plays in " << secs
+              << " s (" << total.games / secs << " games/s)\n";
+
+    return 0;
+}
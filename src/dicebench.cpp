@@ -0,0 +1,235 @@
+/**
+ * dicebench.cpp
+ *
+ * Times the ways the engine could roll its dice, over the same mix of rolls
+ * play.cpp makes:
+ *
+ *  - scalar: one draw per die, with a branch for each breakaway six, the way
+ *    rollDice() used to work,
+ *  - block: dice rolled BLOCK_DICE at a time into a buffer by a vectorized
+ *    loop, and handed out from there, and
+ *  - engine: what the engine does now, Random::roll() for a single die and
+ *    the alias tables in dice.h for anything more.
+ *
+ * Each is timed twice: drawing every roll from one long stream, and starting
+ * a fresh stream every few rolls, as games do for each snap (see
+ * Game::callRandom()). A block only pays for itself when most of it gets used,
+ * which the second case shows it doesn't.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "engine/dice.h"
+#include "engine/utils.h"
+
+/* Dice rolled at a time by the block roller. */
+static const unsigned int BLOCK_DICE = 64;
+
+/* Default number of rolls timed for each way. */
+static const uint64_t DEFAULT_ROLLS = 20000000;
+/* Default number of rolls a fresh stream is started for. A snap rolls a
+ * handful at most. */
+static const unsigned int DEFAULT_SNAP_ROLLS = 4;
+
+/* Dice per roll, and whether it's breakaway, for the rolls made by play.cpp. */
+struct RollKind {
+    unsigned int numDice;
+    bool breakaway;
+};
+
+static const RollKind ROLL_MIX[] = { { 2, false }, { 1, true }, { 2, true },
+    { 3, true }, { 1, false }, { 2, true }, { 4, true }, { 2, false } };
+static const unsigned int ROLL_MIX_SIZE = sizeof(ROLL_MIX) / sizeof(ROLL_MIX[0]);
+
+static unsigned int rollScalar(Random& rng, unsigned int numDice, bool breakaway)
+{
+    unsigned int total = 0;
+    while (numDice-- > 0) {
+        unsigned int roll = rng.uniform(NUM_SIDES) + 1;
+        if (breakaway && roll == NUM_SIDES)
+            numDice++;
+        total += roll;
+    }
+    return total;
+}
+
+/*
+ * SplitMix64 like Random, but rolling BLOCK_DICE dice at a time, two from
+ * each draw. Every lane only depends on its own counter, so the refill loop
+ * vectorizes.
+ */
+class BlockRoller {
+private:
+    uint64_t state;
+    unsigned int used;
+    uint8_t dice[BLOCK_DICE];
+
+    void refill()
+    {
+        const uint64_t gamma = 0x9e3779b97f4a7c15ULL;
+        const unsigned int draws = BLOCK_DICE / 2;
+        uint64_t base = state;
+
+#pragma omp simd
+        for (unsigned int i = 0; i < draws; i++) {
+            uint64_t z = base + (i + 1) * gamma;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z = z ^ (z >> 31);
+            dice[2 * i] = static_cast<uint8_t>((((z >> 32) * NUM_SIDES) >> 32) + 1);
+            dice[2 * i + 1] = static_cast<uint8_t>((((z & 0xffffffffULL) * NUM_SIDES) >> 32) + 1);
+        }
+
+        state = base + draws * gamma;
+        used = 0;
+    }
+
+public:
+    explicit BlockRoller(uint64_t seed)
+        : state(seed)
+        , used(BLOCK_DICE)
+    {
+    }
+
+    unsigned int roll(unsigned int numDice, bool breakaway)
+    {
+        unsigned int total = 0;
+        while (numDice-- > 0) {
+            if (used == BLOCK_DICE)
+                refill();
+            unsigned int roll = dice[used++];
+            numDice += breakaway & (roll == NUM_SIDES);
+            total += roll;
+        }
+        return total;
+    }
+};
+
+struct ScalarWay {
+    Random rng;
+    explicit ScalarWay(uint64_t seed)
+        : rng(seed)
+    {
+    }
+    unsigned int roll(const RollKind& kind) { return rollScalar(rng, kind.numDice, kind.breakaway); }
+};
+
+struct BlockWay {
+    BlockRoller rng;
+    explicit BlockWay(uint64_t seed)
+        : rng(seed)
+    {
+    }
+    unsigned int roll(const RollKind& kind) { return rng.roll(kind.numDice, kind.breakaway); }
+};
+
+struct EngineWay {
+    Random rng;
+    explicit EngineWay(uint64_t seed)
+        : rng(seed)
+    {
+    }
+    unsigned int roll(const RollKind& kind) { return rollDice(rng, kind.numDice, kind.breakaway); }
+};
+
+/* Makes rolls rolls the way Way does, starting a fresh stream every
+ * snapRolls of them, or never if that's 0. Returns the nanoseconds per roll,
+ * and adds the rolls up into sum so they can't be optimized away. */
+template <class Way>
+static double timeRolls(uint64_t rolls, unsigned int snapRolls, uint64_t& sum)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Way way(deriveSeed(1, 0));
+    uint64_t snap = 0;
+    unsigned int sinceSnap = 0;
+    for (uint64_t i = 0; i < rolls; i++) {
+        if (snapRolls && sinceSnap++ == snapRolls) {
+            way = Way(deriveSeed(1, ++snap));
+            sinceSnap = 1;
+        }
+        sum += way.roll(ROLL_MIX[i % ROLL_MIX_SIZE]);
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rolls;
+}
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  -n, --rolls N          rolls to time each way (default " << DEFAULT_ROLLS << ")\n"
+              << "  -s, --snap-rolls N     rolls per fresh stream in the per snap timings\n"
+              << "                         (default " << DEFAULT_SNAP_ROLLS << ")\n"
+              << "  -h, --help             show this message\n";
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t rolls = DEFAULT_ROLLS;
+    unsigned int snapRolls = DEFAULT_SNAP_ROLLS;
+
+    static const struct option longOptions[] = {
+        { "rolls", required_argument, nullptr, 'n' },
+        { "snap-rolls", required_argument, nullptr, 's' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:s:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+        case 'n':
+            rolls = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 's':
+            snapRolls = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (rolls == 0 || snapRolls == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint64_t sum = 0;
+    double times[3][2];
+    for (unsigned int perSnap = 0; perSnap < 2; perSnap++) {
+        unsigned int every = perSnap ? snapRolls : 0;
+        times[0][perSnap] = timeRolls<ScalarWay>(rolls, every, sum);
+        times[1][perSnap] = timeRolls<BlockWay>(rolls, every, sum);
+        times[2][perSnap] = timeRolls<EngineWay>(rolls, every, sum);
+    }
+
+    static const char* const NAMES[3] = { "scalar", "block", "engine" };
+    std::cout << rolls << " rolls each, ns per roll (speedup over scalar)\n"
+              << std::left << std::setw(10) << "" << std::right
+              << std::setw(19) << "one stream"
+              << std::setw(19) << ("per " + std::to_string(snapRolls) + " rolls") << '\n'
+              << std::fixed << std::setprecision(2);
+    for (unsigned int w = 0; w < 3; w++) {
+        std::cout << std::left << std::setw(10) << NAMES[w] << std::right;
+        for (unsigned int perSnap = 0; perSnap < 2; perSnap++) {
+            std::cout << std::setw(10) << times[w][perSnap] << " (" << std::setw(5)
+                      << times[0][perSnap] / times[w][perSnap] << "x)";
+        }
+        std::cout << '\n';
+    }
+    // keeps the rolls from being optimized away
+    std::cerr << "checksum " << sum << '\n';
+
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include "alloctrack.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <unistd.h>
+
+thread_local AllocTag currentAllocTag __attribute__((tls_model("initial-exec"))) = ALLOC_OTHER;
+
+static const char* const TAG_NAMES[NUM_ALLOC_TAGS] = { "other", "play", "clock", "model",
+    "observers", "team" };
+
+/* One tag's counts. Every thread's allocations go here, so pad them out to
+ * at least keep tags from sharing lines. */
+struct alignas(64) TagCounts {
+    std::atomic<uint64_t> allocs { 0 };
+    std::atomic<uint64_t> bytes { 0 };
+    std::atomic<int64_t> liveAllocs { 0 };
+    std::atomic<int64_t> liveBytes { 0 };
+    std::atomic<int64_t> peakBytes { 0 };
+};
+
+/* Constant initialized, so ready for the first malloc() before main(). */
+static TagCounts tagCounts[NUM_ALLOC_TAGS];
+
+#ifdef FB_ALLOC_TRACKING
+
+/*
+ * malloc() and friends, replaced for the whole program as glibc allows, on top
+ * of glibc's own. Each block gets a header in front saying who to charge when
+ * it's freed.
+ */
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+struct alignas(16) BlockHeader {
+    /* what glibc handed out, which is further back for big alignments */
+    void* base;
+    size_t size;
+    AllocTag tag;
+};
+
+static const size_t HEADER_SIZE = sizeof(BlockHeader);
+/* What glibc's malloc() aligns to anyway. */
+static const size_t MALLOC_ALIGNMENT = 16;
+
+static inline BlockHeader* headerOf(void* ptr)
+{
+    return reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - HEADER_SIZE);
+}
+
+static void charge(AllocTag tag, size_t size)
+{
+    TagCounts& counts = tagCounts[tag];
+    counts.allocs.fetch_add(1, std::memory_order_relaxed);
+    counts.bytes.fetch_add(size, std::memory_order_relaxed);
+    counts.liveAllocs.fetch_add(1, std::memory_order_relaxed);
+    int64_t live = counts.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+    int64_t peak = counts.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !counts.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) { }
+}
+
+static void refund(AllocTag tag, size_t size)
+{
+    TagCounts& counts = tagCounts[tag];
+    counts.liveAllocs.fetch_sub(1, std::memory_order_relaxed);
+    counts.liveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+/* Sets up the header of a block glibc gave us, with room for it at offset. */
+static void* track(void* base, size_t offset, size_t size)
+{
+    if (!base)
+        return nullptr;
+
+    void* ptr = static_cast<char*>(base) + offset;
+    BlockHeader* header = headerOf(ptr);
+    header->base = base;
+    header->size = size;
+    header->tag = currentAllocTag;
+    charge(header->tag, size);
+    return ptr;
+}
+
+static void* alignedAlloc(size_t alignment, size_t size)
+{
+    if (alignment <= MALLOC_ALIGNMENT)
+        return malloc(size);
+
+    // Alignments are powers of two, so a multiple of one that's big enough to
+    // hold the header leaves the block aligned as asked.
+    size_t offset = (HEADER_SIZE + alignment - 1) & ~(alignment - 1);
+    if (size > SIZE_MAX - offset) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return track(__libc_memalign(alignment, size + offset), offset, size);
+}
+
+extern "C" {
+
+void* malloc(size_t size) noexcept
+{
+    if (size > SIZE_MAX - HEADER_SIZE) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return track(__libc_malloc(size + HEADER_SIZE), HEADER_SIZE, size);
+}
+
+void free(void* ptr) noexcept
+{
+    if (!ptr)
+        return;
+
+    BlockHeader* header = headerOf(ptr);
+    refund(header->tag, header->size);
+    __libc_free(header->base);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+    if (size && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    void* ptr = malloc(count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) noexcept
+{
+    if (!ptr)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return nullptr;
+    }
+
+    // Always moves, so the new block is charged to whoever grew it.
+    void* moved = malloc(size);
+    if (moved) {
+        size_t old = headerOf(ptr)->size;
+        memcpy(moved, ptr, old < size ? old : size);
+        free(ptr);
+    }
+    return moved;
+}
+
+void* reallocarray(void* ptr, size_t count, size_t size) noexcept
+{
+    if (size && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(ptr, count * size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept
+{
+    return alignedAlloc(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    return alignedAlloc(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) noexcept
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    void* ptr = alignedAlloc(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+
+void* valloc(size_t size) noexcept
+{
+    return alignedAlloc(sysconf(_SC_PAGESIZE), size);
+}
+
+void* pvalloc(size_t size) noexcept
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return alignedAlloc(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void* ptr) noexcept
+{
+    return ptr ? headerOf(ptr)->size : 0;
+}
+}
+
+#endif
+
+bool allocTracking()
+{
+#ifdef FB_ALLOC_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocCounts allocCounts(AllocTag tag)
+{
+    const TagCounts& counts = tagCounts[tag];
+    AllocCounts result;
+    result.allocs = counts.allocs.load(std::memory_order_relaxed);
+    result.bytes = counts.bytes.load(std::memory_order_relaxed);
+    result.liveAllocs = counts.liveAllocs.load(std::memory_order_relaxed);
+    result.liveBytes = counts.liveBytes.load(std::memory_order_relaxed);
+    result.peakBytes = counts.peakBytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+void reportAllocations(std::ostream& out, uint64_t games, uint64_t snaps)
+{
+    if (!allocTracking() || games == 0 || snaps == 0)
+        return;
+
+    // Take every count before printing, which allocates.
+    AllocCounts counts[NUM_ALLOC_TAGS];
+    for (unsigned int t = 0; t < NUM_ALLOC_TAGS; t++)
+        counts[t] = allocCounts(static_cast<AllocTag>(t));
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+
+    out << "Heap allocations by subsystem, averaged over " << games << " games and "
+        << snaps << " snaps\n"
+        << std::left << std::setw(12) << "subsystem" << std::right
+        << std::setw(14) << "allocs/game" << std::setw(14) << "bytes/game"
+        << std::setw(14) << "allocs/snap" << std::setw(14) << "bytes/snap"
+        << std::setw(12) << "live" << std::setw(14) << "live bytes"
+        << std::setw(14) << "peak bytes" << '\n';
+    for (unsigned int t = 0; t < NUM_ALLOC_TAGS; t++) {
+        const AllocCounts& c = counts[t];
+        out << std::left << std::setw(12) << TAG_NAMES[t] << std::right
+            << std::setw(14) << double(c.allocs) / games << std::setw(14) << double(c.bytes) / games
+            << std::setw(14) << double(c.allocs) / snaps << std::setw(14) << double(c.bytes) / snaps
+            << std::setw(12) << c.liveAllocs << std::setw(14) << c.liveBytes
+            << std::setw(14) << c.peakBytes << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,85 @@
+#ifndef __ALLOCTRACK_H
+#define __ALLOCTRACK_H
+
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Heap allocations by engine subsystem. Only built in with FB_ALLOC_TRACKING
+ * (cmake -DFB_ALLOC_TRACKING=ON), which replaces malloc and friends for the
+ * whole program. So everything is seen, operator new and Armadillo's own
+ * aligned allocations alike. Each allocation is charged to the tag of the
+ * innermost FB_ALLOC_SCOPE its thread is in, or to ALLOC_OTHER, and its free
+ * is charged back to the same tag, whichever thread it happens on.
+ *
+ * A subsystem whose live count keeps growing with the number of games is
+ * leaking. driver prints the counts after each batch, per game and per snap.
+ * Without FB_ALLOC_TRACKING the scopes compile to nothing.
+ */
+
+enum AllocTag {
+    /* anything not in a scope */
+    ALLOC_OTHER,
+    /* Play::runPlay() and the PlayOutcome it makes */
+    ALLOC_PLAY,
+    /* the game clock and its alarms */
+    ALLOC_CLOCK,
+    /* asking the playcall model for a call, Armadillo temporaries and all */
+    ALLOC_MODEL,
+    /* registering and notifying observers */
+    ALLOC_OBSERVERS,
+    /* TeamInfo and TeamStats */
+    ALLOC_TEAM,
+    NUM_ALLOC_TAGS
+};
+
+struct AllocCounts {
+    uint64_t allocs;
+    uint64_t bytes;
+    /* allocations not yet freed, and their bytes */
+    int64_t liveAllocs;
+    int64_t liveBytes;
+    /* most bytes live at once */
+    int64_t peakBytes;
+};
+
+/* Charged for allocations on this thread. */
+extern thread_local AllocTag currentAllocTag;
+
+/* Charges this thread's allocations to tag until destroyed. */
+class AllocScope {
+private:
+    AllocTag saved;
+
+public:
+    explicit AllocScope(AllocTag tag)
+        : saved(currentAllocTag)
+    {
+        currentAllocTag = tag;
+    }
+
+    ~AllocScope() { currentAllocTag = saved; }
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+};
+
+/* Whether allocations are being tracked, i.e. this is an FB_ALLOC_TRACKING
+ * build. */
+bool allocTracking();
+/* Counts so far for tag, over every thread. */
+AllocCounts allocCounts(AllocTag tag);
+/* Prints the counts for every tag, averaged over games and snaps. Live counts
+ * are printed as they stand, so anything still live once the games have been
+ * destroyed was leaked. */
+void reportAllocations(std::ostream& out, uint64_t games, uint64_t snaps);
+
+#ifdef FB_ALLOC_TRACKING
+#define FB_ALLOC_CONCAT2(a, b) a##b
+#define FB_ALLOC_CONCAT(a, b) FB_ALLOC_CONCAT2(a, b)
+#define FB_ALLOC_SCOPE(tag) AllocScope FB_ALLOC_CONCAT(allocScope, __LINE__)(tag)
+#else
+#define FB_ALLOC_SCOPE(tag)
+#endif
+
+#endif
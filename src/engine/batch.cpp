@@ -0,0 +1,269 @@
+#include "batch.h"
+#include "gametask.h"
+#include "metrics.h"
+#include "observers.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Number of games a worker grabs at a time. Big enough that workers rarely
+ * touch the shared counter, small enough to keep them evenly loaded.
+ */
+static const size_t GAMES_PER_CHUNK = 64;
+
+/* Games to play before the confidence intervals are trusted enough to stop
+ * on. Until then a few lopsided games can make them look much too narrow.
+ */
+static const size_t MIN_GAMES_TO_STOP = 1000;
+
+/*
+ * What the workers of a batch share: the next game to hand out, and the
+ * running totals the stopping rule is checked against.
+ */
+struct BatchProgress {
+    std::atomic<size_t> next { 0 };
+    std::atomic<bool> stopped { false };
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::mutex lock;
+    Moments winShare;
+    Moments margin;
+
+    /* Adds a worker's last chunk of games, and stops the batch if that's
+     * enough. */
+    void add(const StoppingRule& rule, const Moments& chunkWins, const Moments& chunkMargins);
+    /* Number of games played, once every worker has finished. */
+    size_t played(const BatchConfig& config) const
+    {
+        return std::min(next.load(), config.numGames);
+    }
+};
+
+static bool stopsEarly(const StoppingRule& rule)
+{
+    return rule.winRateHalfWidth > 0 || rule.marginHalfWidth > 0 || rule.timeLimit > 0;
+}
+
+void BatchProgress::add(const StoppingRule& rule, const Moments& chunkWins,
+    const Moments& chunkMargins)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    winShare.add(chunkWins);
+    margin.add(chunkMargins);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    bool outOfTime = rule.timeLimit > 0 && elapsed.count() >= rule.timeLimit;
+
+    bool precise = (rule.winRateHalfWidth > 0 || rule.marginHalfWidth > 0)
+        && margin.n >= MIN_GAMES_TO_STOP
+        && (rule.winRateHalfWidth <= 0 || winShare.halfWidth() <= rule.winRateHalfWidth)
+        && (rule.marginHalfWidth <= 0 || margin.halfWidth() <= rule.marginHalfWidth);
+
+    if (outOfTime || precise)
+        stopped.store(true, std::memory_order_relaxed);
+}
+
+const char* const RESULT_COLUMN_NAMES[NUM_RESULT_COLUMNS] = {
+    "home_score",
+    "away_score",
+    "num_plays",
+    "home_passing_yards",
+    "home_rushing_yards",
+    "home_passing_plays",
+    "home_completions",
+    "home_running_plays",
+    "home_sacks",
+    "home_interceptions",
+    "home_fumbles",
+    "away_passing_yards",
+    "away_rushing_yards",
+    "away_passing_plays",
+    "away_completions",
+    "away_running_plays",
+    "away_sacks",
+    "away_interceptions",
+    "away_fumbles"
+};
+
+void ResultColumns::resize(size_t n)
+{
+    seeds.resize(n);
+    for (std::vector<int32_t>& column : columns)
+        column.resize(n);
+}
+
+/* Stores one team's stats, starting at the given column. */
+static void storeStats(ResultColumns& cols, size_t index, ResultColumn first,
+    const TeamStats& stats)
+{
+    cols.columns[first + 0][index] = stats.passingYards;
+    cols.columns[first + 1][index] = stats.rushingYards;
+    cols.columns[first + 2][index] = stats.passingPlays;
+    cols.columns[first + 3][index] = stats.completions;
+    cols.columns[first + 4][index] = stats.runningPlays;
+    cols.columns[first + 5][index] = stats.sacks;
+    cols.columns[first + 6][index] = stats.interceptions;
+    cols.columns[first + 7][index] = stats.fumbles;
+}
+
+void ResultColumns::store(size_t index, const GameResult& result)
+{
+    seeds[index] = result.seed;
+    columns[HOME_SCORE][index] = result.homeScore;
+    columns[AWAY_SCORE][index] = result.awayScore;
+    columns[NUM_PLAYS][index] = result.numPlays;
+    storeStats(*this, index, HOME_PASSING_YARDS, result.homeStats);
+    storeStats(*this, index, AWAY_PASSING_YARDS, result.awayStats);
+}
+
+void runHeadless(Game* game)
+{
+    ObservedGame<> observed(game);
+    observed.gameLoop();
+}
+
+static GameResult resultOf(const Game& game)
+{
+    GameResult result;
+    result.seed = game.getSeed();
+    result.homeScore = game.getHomeScore();
+    result.awayScore = game.getAwayScore();
+    result.numPlays = game.getStepCount();
+    result.homeStats = *game.getHomeStats();
+    result.awayStats = *game.getAwayStats();
+    return result;
+}
+
+GameResult playGame(const EngineContext* context, Team* home, Team* away,
+    uint64_t seed, const GameRunner& run)
+{
+    Game game(context, home, away, seed);
+    run(&game);
+    return resultOf(game);
+}
+
+/* Given each game of a chunk as it finishes, with its index in the batch. */
+typedef std::function<void(size_t index, const GameResult& result)> ChunkSink;
+
+/* Plays games [start, end) of the batch all at once, interleaved. */
+static void playChunkInterleaved(const BatchConfig& config, Team* home, Team* away,
+    size_t start, size_t end, const ChunkSink& finish)
+{
+    std::vector<std::unique_ptr<Game>> owned;
+    std::vector<Game*> games;
+    for (size_t i = start; i < end; i++) {
+        owned.push_back(std::make_unique<Game>(config.context, home, away, deriveSeed(config.seed, i)));
+        games.push_back(owned.back().get());
+    }
+
+    playInterleaved(games, [&](size_t game) {
+        finish(start + game, resultOf(*games[game]));
+    });
+}
+
+static void runWorker(const BatchConfig& config, const GameRunner& run,
+    const ResultSink& sink, unsigned int worker, BatchProgress& progress)
+{
+    FB_TRACE_SCOPE("worker", "batch");
+    Team* home = makeTeam(*config.context, config.home);
+    Team* away = makeTeam(*config.context, config.away);
+    bool checking = stopsEarly(config.stop);
+
+    while (!progress.stopped.load(std::memory_order_relaxed)) {
+        size_t start = progress.next.fetch_add(GAMES_PER_CHUNK, std::memory_order_relaxed);
+        if (start >= config.numGames)
+            break;
+        size_t end = std::min(start + GAMES_PER_CHUNK, config.numGames);
+        FB_TRACE_SCOPE("chunk", "batch");
+
+        Moments wins, margins;
+        auto finish = [&](size_t i, const GameResult& result) {
+            countGame(result.numPlays);
+            if (checking) {
+                int margin = int(result.homeScore) - int(result.awayScore);
+                margins.add(margin);
+                wins.add(margin > 0 ? 1 : margin == 0 ? 0.5 : 0);
+            }
+            sink(worker, i, result);
+        };
+
+        if (config.interleave) {
+            playChunkInterleaved(config, home, away, start, end, finish);
+        } else {
+            for (size_t i = start; i < end; i++)
+                finish(i, playGame(config.context, home, away, deriveSeed(config.seed, i), run));
+        }
+
+        if (checking)
+            progress.add(config.stop, wins, margins);
+    }
+
+    delete home;
+    delete away;
+}
+
+/* Loads both teams' models up front, so that workers never have to wait on a
+ * model being loaded. Throws std::runtime_error if one can't be.
+ */
+static void loadModels(const BatchConfig& config)
+{
+    std::vector<std::string> names;
+    for (const TeamConfig* team : { &config.home, &config.away }) {
+        if (team->type == AI_TEAM && !team->model.empty())
+            names.push_back(team->model);
+    }
+
+    if (!names.empty())
+        config.context->getModelCache().preload(names);
+}
+
+size_t runBatch(const BatchConfig& config, const GameRunner& run,
+    const ResultSink& sink)
+{
+    FB_TRACE_SCOPE("batch", "batch");
+    unsigned int numThreads = std::max(1u, config.numThreads);
+    loadModels(config);
+    BatchProgress progress;
+
+    if (numThreads == 1) {
+        runWorker(config, run, sink, 0, progress);
+        return progress.played(config);
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < numThreads; i++)
+        workers.emplace_back(runWorker, std::cref(config), std::cref(run),
+            std::cref(sink), i, std::ref(progress));
+
+    for (std::thread& t : workers)
+        t.join();
+
+    return progress.played(config);
+}
+
+size_t runBatch(const BatchConfig& config, const GameRunner& run,
+    const ResultSink& sink, ThreadPool& pool)
+{
+    FB_TRACE_SCOPE("batch", "batch");
+    unsigned int numWorkers = std::max(1u, config.numThreads);
+    TaskCounter finished(numWorkers);
+    loadModels(config);
+    BatchProgress progress;
+
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        pool.submit([&, i] {
+            runWorker(config, run, sink, i, progress);
+            finished.finish();
+        });
+    }
+
+    finished.wait();
+    return progress.played(config);
+}
@@ -0,0 +1,145 @@
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include "game.h"
+#include "team.h"
+#include "threadpool.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * Runs large numbers of independent games across several threads.
+ *
+ * Game i of a batch is seeded with deriveSeed(seed, i), so a batch gives the
+ * same results no matter how many threads it's run on, and any single game in
+ * it can be recorded or replayed on its own later.
+ */
+
+/**
+ * Lets a batch stop before all of its games are played: once the 95%
+ * confidence intervals on the home team's win rate (a tie counting as half a
+ * win) and average margin are as narrow as asked, or once it has run for
+ * timeLimit seconds, whichever comes first. Zero turns a limit off, so by
+ * default every game is played.
+ *
+ * Workers add their results to the running totals after every chunk of games
+ * they play, and check the rule then, so a batch can overshoot its target by
+ * a chunk per worker. Chunks are handed out in order, and a chunk that's been
+ * started is always finished, so the games played are always the first n of
+ * the batch.
+ */
+struct StoppingRule {
+    double winRateHalfWidth = 0;
+    double marginHalfWidth = 0;
+    double timeLimit = 0;
+};
+
+/* Describes a batch of games between two kinds of teams. The context is
+ * shared by all of the workers, and must outlive the batch.
+ */
+struct BatchConfig {
+    const EngineContext* context;
+    uint64_t seed;
+    /* the most games to play */
+    size_t numGames;
+    unsigned int numThreads;
+    TeamConfig home;
+    TeamConfig away;
+    StoppingRule stop;
+    /* Have each worker play a whole chunk of games at once as coroutines (see
+     * gametask.h), asking the model for all of their calls in one go. The
+     * games have no observers, so the GameRunner isn't used. Results are the
+     * same either way.
+     */
+    bool interleave = false;
+};
+
+/* The final result of one game in a batch. */
+struct GameResult {
+    uint64_t seed;
+    unsigned int homeScore;
+    unsigned int awayScore;
+    /* Number of steps the game took, i.e. plays including kickoffs, PATs,
+     * and so on.
+     */
+    unsigned int numPlays;
+    TeamStats homeStats;
+    TeamStats awayStats;
+};
+
+/* The fields of a GameResult (other than the seed), as columns. */
+enum ResultColumn {
+    HOME_SCORE,
+    AWAY_SCORE,
+    NUM_PLAYS,
+    HOME_PASSING_YARDS,
+    HOME_RUSHING_YARDS,
+    HOME_PASSING_PLAYS,
+    HOME_COMPLETIONS,
+    HOME_RUNNING_PLAYS,
+    HOME_SACKS,
+    HOME_INTERCEPTIONS,
+    HOME_FUMBLES,
+    AWAY_PASSING_YARDS,
+    AWAY_RUSHING_YARDS,
+    AWAY_PASSING_PLAYS,
+    AWAY_COMPLETIONS,
+    AWAY_RUNNING_PLAYS,
+    AWAY_SACKS,
+    AWAY_INTERCEPTIONS,
+    AWAY_FUMBLES,
+    NUM_RESULT_COLUMNS
+};
+
+/* snake_case names for each column, e.g. "home_passing_yards" */
+extern const char* const RESULT_COLUMN_NAMES[NUM_RESULT_COLUMNS];
+
+/**
+ * Results of a batch stored one array per field, so they can be scanned or
+ * handed off (e.g. to NumPy) without copying. Results are stored by game
+ * index, so workers can fill it in without any locking.
+ */
+struct ResultColumns {
+    std::vector<uint64_t> seeds;
+    std::vector<int32_t> columns[NUM_RESULT_COLUMNS];
+
+    /* Makes room for n games. */
+    void resize(size_t n);
+    void store(size_t index, const GameResult& result);
+};
+
+/* Plays one game to completion. Lets callers attach observers, e.g. by
+ * running the game through an ObservedGame. Called from the worker threads.
+ */
+typedef std::function<void(Game* game)> GameRunner;
+
+/* Given each game's result. worker is in [0, numThreads), and a worker is only
+ * ever called from one thread, so per-worker state needs no locking. It's
+ * called on the thread that played the game, right after its GameRunner.
+ */
+typedef std::function<void(unsigned int worker, size_t index,
+    const GameResult& result)>
+    ResultSink;
+
+/* Runs the game loop with no observers attached. */
+void runHeadless(Game* game);
+
+/* Plays a single game between home and away with the given seed. */
+GameResult playGame(const EngineContext* context, Team* home, Team* away,
+    uint64_t seed, const GameRunner& run);
+
+/* Runs the games in the batch, returning once they have all finished, or once
+ * config.stop says that's enough. Returns how many were played.
+ */
+size_t runBatch(const BatchConfig& config, const GameRunner& run,
+    const ResultSink& sink);
+/* Same as above, but runs on an existing pool instead of starting up new
+ * threads. config.numThreads tasks are submitted to the pool, so that is the
+ * most workers the batch will use at once.
+ */
+size_t runBatch(const BatchConfig& config, const GameRunner& run,
+    const ResultSink& sink, ThreadPool& pool);
+
+#endif
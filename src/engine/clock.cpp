@@ -1,5 +1,7 @@
 #include "clock.h"
+#include "alloctrack.h"
 #include "playcall.h"
+#include <ctime>
 #include <string>
 
 Clock::Clock()
@@ -120,15 +122,27 @@ int Clock::runClock(PlayOutcome* outcome)
 
 void Clock::setAlarm(ClockListener* listener, AlarmType alarm)
 {
+    FB_ALLOC_SCOPE(ALLOC_CLOCK);
     (*alarms)[alarm]->push_back(listener);
 }
 
+void Clock::restore(unsigned int quarter, int ticks)
+{
+    setQuarter(quarter);
+    this->ticks = ticks;
+}
+
 std::string Clock::ticksToTime()
+{
+    return ticksToTime(getTicks());
+}
+
+std::string Clock::ticksToTime(unsigned int ticks)
 {
     const char* format = "%M:%S";
 
-    unsigned int minutes = getMinutes();
-    unsigned int seconds = getSeconds();
+    unsigned int minutes = ticks * SECONDS_PER_TICK / 60;
+    unsigned int seconds = (ticks * SECONDS_PER_TICK) % 60;
 
     struct tm* time = new tm();
     time->tm_sec = seconds;
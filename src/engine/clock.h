@@ -79,6 +79,8 @@ public:
      * MM:SS
      */
     std::string ticksToTime();
+    /* Same, for a given number of ticks left rather than this clock's. */
+    static std::string ticksToTime(unsigned int ticks);
     /* Advances quarter and sets time reamining to 15:00 . */
     unsigned int advanceQuarter();
     /* Returns the current quarter. */
@@ -95,6 +97,10 @@ public:
      * alarm occur
      */
     void setAlarm(ClockListener* listener, AlarmType alarm);
+    /* Jumps straight to the given quarter and time remaining, without
+     * triggering any alarms. Used when restoring a saved game.
+     */
+    void restore(unsigned int quarter, int ticks);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef __CONTEXT_H
+#define __CONTEXT_H
+
+#include "../learn/model.h"
+#include "ruleset.h"
+#include "utils.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Everything the engine needs that isn't part of any one game: the playcall
+ * model, the ruleset plays are decided by, and a source of seeds for new
+ * games. Nothing in the engine is global, so any number of contexts, with
+ * different models even, can be running games side by side in one process.
+ *
+ * Teams can also ask for a model of their own by file name. Those come from a
+ * ModelCache, which unless a context is given one of its own is the one
+ * ModelCache::shared() for the whole process, so that however many contexts
+ * there are, each model is only ever loaded once.
+ *
+ * Models and rulesets are read-only, so a const EngineContext can be shared
+ * by as many threads as you like. The seed source is not, so a thread that
+ * wants to call nextSeed() should have its own copy. Copying a context is
+ * cheap, since the models themselves are shared.
+ */
+class EngineContext {
+private:
+    std::shared_ptr<const PlaycallModel> model;
+    std::shared_ptr<ModelCache> models;
+    std::shared_ptr<const Ruleset> rules;
+    Random seeds;
+
+public:
+    /* Uses model as the default, with the process's shared cache for any
+     * others. */
+    EngineContext(std::shared_ptr<const PlaycallModel> model, uint64_t seed)
+        : EngineContext(model, ModelCache::shared(), seed)
+    {
+    }
+
+    EngineContext(std::shared_ptr<const PlaycallModel> model,
+        std::shared_ptr<ModelCache> models, uint64_t seed)
+        : model(model)
+        , models(models)
+        , rules(defaultRuleset())
+        , seeds(seed)
+    {
+    }
+
+    /* The default playcall model for AI teams created from this context. */
+    std::shared_ptr<const PlaycallModel> getModel() const { return model; }
+
+    /* The model saved in the given file, or the default one if the name is
+     * empty. Loads the model if this is the first time anyone has asked for
+     * it, and throws std::runtime_error if it can't be loaded.
+     */
+    std::shared_ptr<const PlaycallModel> getModel(const std::string& name) const
+    {
+        return name.empty() ? model : models->get(name);
+    }
+
+    /* Where models other than the default come from. */
+    ModelCache& getModelCache() const { return *models; }
+
+    /* The tables plays are decided by, DEFAULT_RULESET unless replaced. */
+    const Ruleset& getRuleset() const { return *rules; }
+    /* Only safe before any games are running from this context. */
+    void setRuleset(std::shared_ptr<const Ruleset> ruleset) { rules = ruleset; }
+
+    /* Returns a fresh seed for a game that doesn't need a particular one. */
+    uint64_t nextSeed() { return seeds.next(); }
+};
+
+#endif
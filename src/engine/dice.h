@@ -0,0 +1,191 @@
+#ifndef __DICE_H
+#define __DICE_H
+
+#include "utils.h"
+#include <cstdint>
+
+/**
+ * Dice rolls in a single draw.
+ *
+ * Every roll in the engine is some fixed number of dice, with or without
+ * breakaway, so instead of rolling the dice one by one we work out the exact
+ * distribution of their sum at compile time and sample it directly. Sampling
+ * uses an alias table: one random number picks a column and decides between
+ * the column's own sum and its alias, so a roll costs one draw and one lookup
+ * however many dice are involved.
+ *
+ * All weights are integers over a common denominator, so the tables are exact
+ * rather than rounded, and rolls are distributed just as if the dice had been
+ * rolled one at a time.
+ *
+ * With breakaway there is no largest possible sum, since any number of sixes
+ * can come up. The table covers every roll with at most DICE_TABLE_ROLLS dice
+ * thrown in total, and has one extra column for everything beyond that. Landing
+ * in that column is roughly a one in a million event, and is handled exactly by
+ * breakawayTail().
+ */
+
+/* Most dice a breakaway table accounts for, bonus dice included. 6^12 still
+ * leaves plenty of room in 64 bits once multiplied by the number of columns.
+ */
+const unsigned int DICE_TABLE_ROLLS = 12;
+
+/* Sum of the rolls beyond the first rolled dice, for numDice breakaway dice
+ * once we know more than rolled were needed. Only called for the leftover
+ * column of a breakaway table.
+ */
+unsigned int breakawayTail(Random& rng, unsigned int numDice, unsigned int rolled);
+
+namespace dice_detail {
+
+constexpr uint64_t power(uint64_t base, unsigned int exp)
+{
+    uint64_t result = 1;
+    while (exp-- > 0)
+        result *= base;
+    return result;
+}
+
+constexpr uint64_t choose(unsigned int n, unsigned int k)
+{
+    uint64_t result = 1;
+    for (unsigned int i = 1; i <= k; i++)
+        result = result * (n - k + i) / i;
+    return result;
+}
+
+/* Number of ways n dice with the given number of sides can add up to sum. */
+constexpr uint64_t ways(unsigned int n, unsigned int sides, unsigned int sum)
+{
+    if (n == 0)
+        return sum == 0 ? 1 : 0;
+
+    uint64_t total = 0;
+    for (unsigned int face = 1; face <= sides && face <= sum; face++)
+        total += ways(n - 1, sides, sum - face);
+    return total;
+}
+
+/* Marks the leftover column of a breakaway table. */
+const uint16_t TAIL = 0xffff;
+
+template <unsigned int N, bool Breakaway>
+struct DiceTable {
+    /* Most sixes a breakaway table accounts for. */
+    static constexpr unsigned int MAX_SIXES = Breakaway ? DICE_TABLE_ROLLS - N : 0;
+    /* Sums from N up to the largest one in the table, plus the tail. */
+    static constexpr unsigned int SIZE = Breakaway
+        ? NUM_SIDES * MAX_SIXES + (NUM_SIDES - 2) * N + 2
+        : (NUM_SIDES - 1) * N + 1;
+    /* What all the weights add up to, and so the width of every column. */
+    static constexpr uint64_t TOTAL = power(NUM_SIDES, Breakaway ? DICE_TABLE_ROLLS : N);
+
+    /* A draw y in column i gives sum[i] if y < threshold[i], else alias[i]. */
+    uint64_t threshold[SIZE];
+    uint16_t sum[SIZE];
+    uint16_t alias[SIZE];
+
+    constexpr DiceTable()
+        : threshold()
+        , sum()
+        , alias()
+    {
+        static_assert(N > 0 && N + MAX_SIXES <= DICE_TABLE_ROLLS, "too many dice for a table");
+
+        uint64_t weight[SIZE] = {};
+        for (unsigned int i = 0; i < SIZE; i++)
+            sum[i] = static_cast<uint16_t>(N + i);
+
+        if constexpr (Breakaway) {
+            // Every die ends on a non-six, and the sixes before it add up.
+            // With k sixes in all the probability is (N+k-1 choose k) ways of
+            // placing them, times the ways the N final dice (1 to 5 each) can
+            // make up the rest, over 6^(N+k).
+            uint64_t covered = 0;
+            for (unsigned int i = 0; i + 1 < SIZE; i++) {
+                for (unsigned int k = 0; k <= MAX_SIXES && NUM_SIDES * k <= i; k++) {
+                    weight[i] += choose(N + k - 1, k)
+                        * ways(N, NUM_SIDES - 1, N + i - NUM_SIDES * k)
+                        * power(NUM_SIDES, MAX_SIXES - k);
+                }
+                covered += weight[i];
+            }
+            weight[SIZE - 1] = TOTAL - covered;
+            sum[SIZE - 1] = TAIL;
+        } else {
+            for (unsigned int i = 0; i < SIZE; i++)
+                weight[i] = ways(N, NUM_SIDES, N + i);
+        }
+
+        // Vose's alias method, in integers. Scaling every weight by SIZE
+        // makes each column exactly TOTAL wide.
+        unsigned int small[SIZE] = {}, large[SIZE] = {};
+        unsigned int numSmall = 0, numLarge = 0;
+        for (unsigned int i = 0; i < SIZE; i++) {
+            weight[i] *= SIZE;
+            if (weight[i] < TOTAL)
+                small[numSmall++] = i;
+            else
+                large[numLarge++] = i;
+        }
+
+        while (numSmall > 0 && numLarge > 0) {
+            unsigned int s = small[--numSmall];
+            unsigned int l = large[--numLarge];
+            threshold[s] = weight[s];
+            alias[s] = sum[l];
+            weight[l] -= TOTAL - weight[s];
+            if (weight[l] < TOTAL)
+                small[numSmall++] = l;
+            else
+                large[numLarge++] = l;
+        }
+
+        while (numLarge > 0) {
+            unsigned int l = large[--numLarge];
+            threshold[l] = TOTAL;
+            alias[l] = sum[l];
+        }
+        while (numSmall > 0) {
+            unsigned int s = small[--numSmall];
+            threshold[s] = TOTAL;
+            alias[s] = sum[s];
+        }
+    }
+};
+
+template <unsigned int N, bool Breakaway>
+inline constexpr DiceTable<N, Breakaway> diceTable {};
+
+} // namespace dice_detail
+
+/**
+ * Returns the sum of N six sided dice, where with Breakaway every 6 earns a
+ * bonus die. Same distribution as rollDice(rng, N, Breakaway).
+ */
+template <unsigned int N, bool Breakaway = false>
+inline unsigned int rollDice(Random& rng)
+{
+    if constexpr (N == 0) {
+        return 0;
+    } else if constexpr (N == 1 && !Breakaway) {
+        return rng.roll();
+    } else {
+        using Table = dice_detail::DiceTable<N, Breakaway>;
+        const Table& table = dice_detail::diceTable<N, Breakaway>;
+
+        uint64_t x = rng.uniform64(Table::SIZE * Table::TOTAL);
+        uint64_t column = x / Table::TOTAL;
+        uint16_t result = x % Table::TOTAL < table.threshold[column]
+            ? table.sum[column]
+            : table.alias[column];
+
+        if constexpr (Breakaway) {
+            if (result == dice_detail::TAIL)
+                return breakawayTail(rng, N, DICE_TABLE_ROLLS);
+        }
+        return result;
+    }
+}
+
+#endif
@@ -1,6 +1,9 @@
 #include "game.h"
 #include "clock.h"
 #include "gamestates.h"
+#include "perfcounters.h"
+#include "record.h"
+#include "trace.h"
 #include "utils.h"
 #include <algorithm>
 
@@ -73,11 +76,29 @@ void Situation::notify(PlayOutcome* outcome)
     clock->runClock(outcome);
 }
 
-Game::Game(Team* homeTeam, Team* awayTeam)
+Game::Game(EngineContext* context, Team* homeTeam, Team* awayTeam)
+    : Game(context, homeTeam, awayTeam, context->nextSeed())
 {
+}
 
-    home = new TeamInfo(homeTeam);
-    away = new TeamInfo(awayTeam);
+Game::Game(const EngineContext* context, Team* homeTeam, Team* awayTeam, uint64_t seed)
+    : context(context)
+    , seed(seed)
+    , rng(seed)
+    , stepCount(0)
+    , curOutcome(nullptr)
+    , lastOutcome()
+    , lastEvents(0)
+    , lastOffenseCall(RUN)
+    , haveCalls(false)
+    , nextOffenseCall(RUN)
+    , nextDefenseCall(RUN)
+{
+    {
+        FB_ALLOC_SCOPE(ALLOC_TEAM);
+        home = new TeamInfo(homeTeam);
+        away = new TeamInfo(awayTeam);
+    }
     offense = home;
     defense = away;
 
@@ -85,12 +106,15 @@ Game::Game(Team* homeTeam, Team* awayTeam)
     situation->clock->setAlarm(this, HALFTIME);
     situation->clock->setAlarm(this, FINAL);
 
-    playObs = new std::vector<PlayByPlayObserver*>();
-    sitObs = new std::vector<SituationObserver*>();
-    registerPlayByPlayObs(situation);
+    {
+        FB_ALLOC_SCOPE(ALLOC_OBSERVERS);
+        playObs = new std::vector<PlayByPlayObserver*>();
+        sitObs = new std::vector<SituationObserver*>();
+        registerPlayByPlayObs(situation);
+    }
 
     stateMachine = new StateMachine<Game>(this);
-    stateMachine->changeState(Kickoff::getInstance());
+    stateMachine->changeState(GameStateId::KICKOFF);
 }
 
 Game::~Game()
@@ -100,6 +124,8 @@ Game::~Game()
     delete situation->clock;
     delete situation;
     delete stateMachine;
+    delete home;
+    delete away;
 }
 
 TeamStats* Game::getHomeStats() const
@@ -132,6 +158,104 @@ Situation* Game::getSituation() const
     return situation;
 }
 
+const EngineContext* Game::getContext() const
+{
+    return context;
+}
+
+uint64_t Game::getSeed() const
+{
+    return seed;
+}
+
+unsigned int Game::getStepCount() const
+{
+    return stepCount;
+}
+
+unsigned int Game::getLastEvents() const
+{
+    return lastEvents;
+}
+
+PlayOutcome* Game::getLastOutcome()
+{
+    return &lastOutcome;
+}
+
+bool Game::isHomeOnOffense() const
+{
+    return offense == home;
+}
+
+Team* Game::getOffenseTeam() const
+{
+    return offense->team;
+}
+
+Team* Game::getDefenseTeam() const
+{
+    return defense->team;
+}
+
+PlayCall Game::getLastOffenseCall() const
+{
+    return lastOffenseCall;
+}
+
+GameCheckpoint Game::checkpoint() const
+{
+    GameCheckpoint cp {};
+
+    cp.step = stepCount;
+    cp.rngState = rng.getState();
+    cp.state = stateMachine->getCurrentState();
+    cp.homeOnOffense = offense == home;
+    cp.down = situation->down;
+    cp.distance = situation->distance;
+    cp.fieldPos = situation->fieldPos;
+    cp.quarter = situation->clock->getQuarter();
+    cp.ticks = situation->clock->getTicks();
+    cp.homeScore = home->score;
+    cp.awayScore = away->score;
+    cp.homeTimeouts = home->timeouts;
+    cp.awayTimeouts = away->timeouts;
+    cp.homeStats = *home->stats;
+    cp.awayStats = *away->stats;
+
+    return cp;
+}
+
+void Game::restore(const GameCheckpoint& cp)
+{
+    stepCount = cp.step;
+    rng.setState(cp.rngState);
+    stateMachine->setState(cp.state);
+
+    if (cp.homeOnOffense)
+        setHomePossession();
+    else
+        setAwayPossession();
+
+    situation->down = cp.down;
+    situation->distance = cp.distance;
+    situation->fieldPos = cp.fieldPos;
+    situation->clock->restore(cp.quarter, cp.ticks);
+
+    home->score = cp.homeScore;
+    away->score = cp.awayScore;
+    home->timeouts = cp.homeTimeouts;
+    away->timeouts = cp.awayTimeouts;
+    *home->stats = cp.homeStats;
+    *away->stats = cp.awayStats;
+
+    // Whatever the last step was, it wasn't the one before the checkpoint, and
+    // any calls handed in were meant for another snap.
+    lastOutcome = PlayOutcome();
+    lastEvents = 0;
+    haveCalls = false;
+}
+
 void Game::registerPlayByPlayObs(PlayByPlayObserver* obs)
 {
     playObs->push_back(obs);
@@ -183,9 +307,9 @@ void Game::updateClock(PlayOutcome* outcome)
     }
 
     if (situation->clock->getQuarter() == 3) {
-        stateMachine->changeState(Halftime::getInstance());
+        stateMachine->changeState(GameStateId::HALFTIME);
     } else if (situation->clock->getQuarter() == 5) {
-        stateMachine->changeState(Final::getInstance());
+        stateMachine->changeState(GameStateId::FINAL);
     }
 }
 
@@ -213,10 +337,10 @@ void Game::onClockEvent(AlarmType alarm)
 {
     switch (alarm) {
     case HALFTIME:
-        stateMachine->changeState(Halftime::getInstance());
+        stateMachine->changeState(GameStateId::HALFTIME);
         break;
     case FINAL:
-        stateMachine->changeState(Final::getInstance());
+        stateMachine->changeState(GameStateId::FINAL);
         break;
     case TWO_MIN_WARN:
         break;
@@ -227,12 +351,40 @@ void Game::onClockEvent(AlarmType alarm)
  * Have the offense and defense call their plays, and then return the outcome of
  * the play.
  */
-PlayOutcome* Game::callPlays() const
+PlayOutcome* Game::callPlays()
+{
+    // Each snap draws from its own substreams of the game's seed, picked by
+    // the step number: one for each team's call and one for the play. So no
+    // matter how many numbers earlier snaps, or the other team, used up, the
+    // same snap of two games from the same seed rolls the same dice. That's
+    // what lets two strategies be compared game by game (driver --compare).
+    rng = Random(deriveSeed(deriveSeed(seed, stepCount), 2));
+
+    PlayCall offenseCall = nextOffenseCall;
+    PlayCall defenseCall = nextDefenseCall;
+    if (!haveCalls) {
+        Random offenseRng = callRandom(true);
+        Random defenseRng = callRandom(false);
+        offenseCall = offense->team->callPlay(situation, offenseRng);
+        defenseCall = defense->team->callPlay(situation, defenseRng);
+    }
+    haveCalls = false;
+    lastOffenseCall = offenseCall;
+    Play play(offenseCall, defenseCall, situation, &rng, &context->getRuleset());
+    curOutcome = play.runPlay();
+    return curOutcome;
+}
+
+Random Game::callRandom(bool offense) const
+{
+    return Random(deriveSeed(deriveSeed(seed, stepCount), offense ? 0 : 1));
+}
+
+void Game::setCalls(PlayCall offenseCall, PlayCall defenseCall)
 {
-    PlayCall offenseCall = offense->team->callPlay(situation);
-    PlayCall defenseCall = defense->team->callPlay(situation);
-    Play* play = new Play(offenseCall, defenseCall, situation);
-    return play->runPlay();
+    nextOffenseCall = offenseCall;
+    nextDefenseCall = defenseCall;
+    haveCalls = true;
 }
 
 void Game::updateDownAndDistance(PlayOutcome* outcome)
@@ -251,6 +403,7 @@ void Game::updateDownAndDistance(PlayOutcome* outcome)
 
 void Game::notifySitObs()
 {
+    FB_ALLOC_SCOPE(ALLOC_OBSERVERS);
     std::vector<SituationObserver*>::iterator it = sitObs->begin();
     while (it != sitObs->end()) {
         (*it)->onSituationChange(situation);
@@ -260,6 +413,7 @@ void Game::notifySitObs()
 
 void Game::notifyPlayByPlay(PlayOutcome* outcome)
 {
+    FB_ALLOC_SCOPE(ALLOC_OBSERVERS);
     std::vector<PlayByPlayObserver*>::iterator it = playObs->begin();
     while (it != playObs->end()) {
         (*it)->notify(outcome);
@@ -267,8 +421,68 @@ void Game::notifyPlayByPlay(PlayOutcome* outcome)
     }
 }
 
+bool Game::isOver() const
+{
+    return stateMachine->inState(GameStateId::FINAL);
+}
+
+bool Game::atSnap() const
+{
+    return stateMachine->inState(GameStateId::PLAY_FROM_SCRIMMAGE);
+}
+
+/**
+ * Turnovers are any change of possession the offense didn't choose, so punts
+ * and missed field goals don't count.
+ */
+static inline bool isTurnover(const PlayOutcome& outcome)
+{
+    return outcome.changePoss && outcome.result != PUNT_RETURN
+        && outcome.result != FIELD_GOAL_MISS;
+}
+
+void Game::step()
+{
+    FB_TRACE_SNAP();
+    unsigned int quarter = situation->clock->getQuarter();
+    bool wasOver = isOver();
+    curOutcome = nullptr;
+
+    stateMachine->update();
+    stepCount++;
+
+    lastEvents = 0;
+    if (curOutcome) {
+        lastOutcome = *curOutcome;
+        lastEvents |= PLAY_EVENT;
+        delete curOutcome;
+        curOutcome = nullptr;
+
+        if (lastOutcome.touchdown)
+            lastEvents |= TOUCHDOWN_EVENT;
+        if (isTurnover(lastOutcome))
+            lastEvents |= TURNOVER_EVENT;
+        if (lastOutcome.changePoss || lastOutcome.touchdown
+            || lastOutcome.result == FIELD_GOAL_MADE)
+            lastEvents |= DRIVE_END_EVENT;
+    }
+
+    bool gameEnded = isOver() && !wasOver;
+    if (situation->clock->getQuarter() != quarter || gameEnded) {
+        lastEvents |= QUARTER_END_EVENT;
+        if (quarter == 2 || gameEnded)
+            lastEvents |= DRIVE_END_EVENT;
+    }
+
+    if (lastEvents & DRIVE_END_EVENT)
+        FB_TRACE_DRIVE_END();
+}
+
 void Game::gameLoop()
 {
-    while (!stateMachine->inState(*(Final::getInstance())))
-        stateMachine->update();
+    FB_PERF_SCOPE(PERF_GAME);
+    FB_TRACE_GAME();
+    while (!isOver())
+        step();
 }
+
@@ -1,14 +1,25 @@
 #ifndef __GAME_H
 #define __GAME_H
 
+#include "alloctrack.h"
 #include "clock.h"
+#include "context.h"
+#include "playcall.h"
 #include "states.h"
 #include "team.h"
 #include "utils.h"
 #include <vector>
 
 struct PlayOutcome;
+struct GameCheckpoint;
 class Team;
+class Game;
+
+/* Game has its own specialization of StateMachine, defined in gamestates.h.
+ * Include that header before using a Game's state machine.
+ */
+template <>
+class StateMachine<Game>;
 
 /**
  * An abstract object to be given the outcome of every play as soon as it
@@ -27,6 +38,28 @@ public:
     virtual void onSituationChange(Situation* situation) = 0;
 };
 
+/**
+ * Kinds of events that can happen during one step of a game. Used as bit flags,
+ * so that observers attached through ObservedGame (see observers.h) can
+ * subscribe only to the events they care about.
+ *
+ * SNAP_EVENT: right before a play from scrimmage, with the current situation
+ * PLAY_EVENT: right after a play from scrimmage, with its outcome
+ * TOUCHDOWN_EVENT: either team scored a touchdown on the play
+ * TURNOVER_EVENT: interception, fumble lost, or turnover on downs
+ * DRIVE_END_EVENT: the drive ended in a score, a change of possession, or the
+ * end of a half
+ * QUARTER_END_EVENT: the step ran out the clock on a quarter
+ */
+enum GameEvent : unsigned int {
+    SNAP_EVENT = 1 << 0,
+    PLAY_EVENT = 1 << 1,
+    TOUCHDOWN_EVENT = 1 << 2,
+    TURNOVER_EVENT = 1 << 3,
+    DRIVE_END_EVENT = 1 << 4,
+    QUARTER_END_EVENT = 1 << 5
+};
+
 /**
  * set of possible game states. this is soon to be deprecated as we move to a
  * more sophisticated state machine model.
@@ -60,6 +93,7 @@ public:
         , distance(10)
         , fieldPos(25)
     {
+        FB_ALLOC_SCOPE(ALLOC_CLOCK);
         clock = new Clock();
     }
     virtual ~Situation() { }
@@ -96,8 +130,9 @@ struct TeamStats {
 /*
  * Holds data associated to a team during a game, such as score and timeouts.
  *
- * I didn't bother with a destructor because both pointers here need a longer
- * lifespan that a TeamInfo object.
+ * The team is owned by whoever created the game, but the stats belong to the
+ * TeamInfo and are freed along with the Game. Copy them out if you need them
+ * after the game is gone.
  */
 struct TeamInfo {
     Team* team;
@@ -112,8 +147,14 @@ struct TeamInfo {
         team = t;
         score = 0;
         timeouts = 3;
+        FB_ALLOC_SCOPE(ALLOC_TEAM);
         stats = new TeamStats();
     }
+
+    ~TeamInfo()
+    {
+        delete stats;
+    }
 };
 
 /**
@@ -151,6 +192,32 @@ private:
     /* Observers to be given the situation before very snap. */
     std::vector<SituationObserver*>* sitObs;
 
+    /* Where the game gets everything that isn't its own. Not owned. */
+    const EngineContext* context;
+
+    /* Every random event in the game comes from seed, by way of substreams
+     * for each snap (see callPlays()). rng holds the current play's. Given the
+     * same seed and teams, a game will always play out the same way.
+     */
+    uint64_t seed;
+    Random rng;
+    /* Number of times the state machine has been updated so far. */
+    unsigned int stepCount;
+
+    /* The outcome of the play currently being run, set by callPlays(). */
+    PlayOutcome* curOutcome;
+    /* What happened during the most recent step. lastOutcome is only
+     * meaningful if PLAY_EVENT is set in lastEvents.
+     */
+    PlayOutcome lastOutcome;
+    unsigned int lastEvents;
+    /* What the offense called on the most recent play from scrimmage. */
+    PlayCall lastOffenseCall;
+    /* Calls for the next snap made outside the game, see setCalls(). */
+    bool haveCalls;
+    PlayCall nextOffenseCall;
+    PlayCall nextDefenseCall;
+
     /* swaps the offense and defense pointers */
     void swapOffense();
 
@@ -159,8 +226,10 @@ public:
      * Sets up a game. Sets up the home team to start with the ball at their own
      * 25 yard line, because I haven't bothered with kickoffs yet.
      */
-    Game(Team* homeTeam, Team* awayTeam);
-    /* Frees up observer lists and situation objects. */
+    Game(const EngineContext* context, Team* homeTeam, Team* awayTeam, uint64_t seed);
+    /* Same as above, but takes the next seed from the context. */
+    Game(EngineContext* context, Team* homeTeam, Team* awayTeam);
+    /* Frees up observer lists, situation, and team info objects. */
     virtual ~Game();
     /* Adds an observer to be given the outcome of every play */
     void registerPlayByPlayObs(PlayByPlayObserver* obs);
@@ -170,10 +239,28 @@ public:
      * each outcome. Terminates when no time left in the 4th quarter.
      */
     void gameLoop();
+    /* Runs a single play (or kickoff, PAT, etc.) by updating the state
+     * machine once.
+     */
+    void step();
+    /* True once the game has reached the Final state. */
+    bool isOver() const;
+    /* True if the next step will be a play from scrimmage. */
+    bool atSnap() const;
     /* Changes possession, sets sitation to 1st and 10 at correct spot. */
     void changePossession();
-    /* Gets both teams' playcalls and returns the play outcome. */
-    PlayOutcome* callPlays() const;
+    /* Gets both teams' playcalls and returns the play outcome. The outcome is
+     * owned by the game, and freed at the end of the current step.
+     */
+    PlayOutcome* callPlays();
+    /* The random numbers the offense's (or defense's) call on the next snap
+     * is made with. */
+    Random callRandom(bool offense) const;
+    /* Has the next snap use these calls instead of asking the teams, e.g.
+     * because a game running as a coroutine already has (see gametask.h).
+     * They should have been made with callRandom(), or the game won't replay.
+     */
+    void setCalls(PlayCall offenseCall, PlayCall defenseCall);
     /* Update offensive/defensive stats with play outcome */
     void updateStats(PlayOutcome* outcome);
 
@@ -183,8 +270,28 @@ public:
     unsigned int getHomeScore() const;
     unsigned int getAwayScore() const;
     /* More getters */
+    bool isHomeOnOffense() const;
+    Team* getOffenseTeam() const;
+    Team* getDefenseTeam() const;
     Situation* getSituation() const;
     StateMachine<Game>* getStateMachine() const;
+    const EngineContext* getContext() const;
+    uint64_t getSeed() const;
+    unsigned int getStepCount() const;
+    /* Bitwise OR of the GameEvents that happened in the last step. */
+    unsigned int getLastEvents() const;
+    /* The outcome of the last play from scrimmage. */
+    PlayOutcome* getLastOutcome();
+    /* The offense's call on the last play from scrimmage. */
+    PlayCall getLastOffenseCall() const;
+
+    /* Saves everything needed to pick the game back up from this point. */
+    GameCheckpoint checkpoint() const;
+    /* Puts the game back into the exact state it was in when cp was taken.
+     * The game must have been created with the same seed and teams. Until the
+     * next step, there are no last events or outcome.
+     */
+    void restore(const GameCheckpoint& cp);
 
     /* methods for notifiying these observers. */
     void notifySitObs();
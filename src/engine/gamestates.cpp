@@ -1,10 +1,16 @@
 #include "gamestates.h"
+#include "metrics.h"
+#include "trace.h"
 
-Kickoff* Kickoff::getInstance()
-{
-    static Kickoff instance;
+static const char* const STATE_NAMES[NUM_GAME_STATES] = { "none", "Kickoff", "ExtraPoint",
+    "PlayFromScrimmage", "Touchdown", "Halftime", "Final" };
+/* State changes as they appear in traces. */
+static const char* const ENTER_NAMES[NUM_GAME_STATES] = { "enter none", "enter Kickoff", "enter ExtraPoint",
+    "enter PlayFromScrimmage", "enter Touchdown", "enter Halftime", "enter Final" };
 
-    return &instance;
+const char* gameStateName(GameStateId state)
+{
+    return STATE_NAMES[static_cast<unsigned int>(state)];
 }
 
 void Kickoff::enter(Game* game)
@@ -19,7 +25,7 @@ void Kickoff::execute(Game* game)
 {
     // TODO: implement kickoff logic
     game->changePossession();
-    game->getStateMachine()->changeState(PlayFromScrimmage::getInstance());
+    game->getStateMachine()->changeState(GameStateId::PLAY_FROM_SCRIMMAGE);
 }
 
 void Kickoff::exit(Game* game)
@@ -43,10 +49,10 @@ void PlayFromScrimmage::execute(Game* game)
         game->changePossession();
 
     if (outcome->touchdown) {
-        game->getStateMachine()->changeState(Touchdown::getInstance());
+        game->getStateMachine()->changeState(GameStateId::TOUCHDOWN);
     } else if (outcome->result == FIELD_GOAL_MADE) {
         game->giveOffensePoints(3);
-        game->getStateMachine()->changeState(Kickoff::getInstance());
+        game->getStateMachine()->changeState(GameStateId::KICKOFF);
     }
 }
 
@@ -54,20 +60,6 @@ void PlayFromScrimmage::exit(Game* game)
 {
 }
 
-PlayFromScrimmage* PlayFromScrimmage::getInstance()
-{
-    static PlayFromScrimmage instance;
-
-    return &instance;
-}
-
-Touchdown* Touchdown::getInstance()
-{
-    static Touchdown instance;
-
-    return &instance;
-}
-
 void Touchdown::enter(Game* game)
 {
 }
@@ -75,20 +67,13 @@ void Touchdown::enter(Game* game)
 void Touchdown::execute(Game* game)
 {
     game->giveOffensePoints(7);
-    game->getStateMachine()->changeState(ExtraPoint::getInstance());
+    game->getStateMachine()->changeState(GameStateId::EXTRA_POINT);
 }
 
 void Touchdown::exit(Game* game)
 {
 }
 
-ExtraPoint* ExtraPoint::getInstance()
-{
-    static ExtraPoint instance;
-
-    return &instance;
-}
-
 void ExtraPoint::enter(Game* game)
 {
     Situation* sit = game->getSituation();
@@ -99,20 +84,13 @@ void ExtraPoint::enter(Game* game)
 
 void ExtraPoint::execute(Game* game)
 {
-    game->getStateMachine()->changeState(Kickoff::getInstance());
+    game->getStateMachine()->changeState(GameStateId::KICKOFF);
 }
 
 void ExtraPoint::exit(Game* game)
 {
 }
 
-Halftime* Halftime::getInstance()
-{
-    static Halftime instance;
-
-    return &instance;
-}
-
 void Halftime::enter(Game* game)
 {
 }
@@ -120,20 +98,13 @@ void Halftime::enter(Game* game)
 void Halftime::execute(Game* game)
 {
     game->setAwayPossession();
-    game->getStateMachine()->changeState(Kickoff::getInstance());
+    game->getStateMachine()->changeState(GameStateId::KICKOFF);
 }
 
 void Halftime::exit(Game* game)
 {
 }
 
-Final* Final::getInstance()
-{
-    static Final instance;
-
-    return &instance;
-}
-
 void Final::enter(Game* game)
 {
 }
@@ -145,3 +116,85 @@ void Final::execute(Game* game)
 void Final::exit(Game* game)
 {
 }
+
+void StateMachine<Game>::update() const
+{
+    FB_TRACE_SCOPE(gameStateName(curState), "state");
+    countStateExecution(curState);
+    switch (curState) {
+    case GameStateId::KICKOFF:
+        Kickoff::execute(owner);
+        break;
+    case GameStateId::EXTRA_POINT:
+        ExtraPoint::execute(owner);
+        break;
+    case GameStateId::PLAY_FROM_SCRIMMAGE:
+        PlayFromScrimmage::execute(owner);
+        break;
+    case GameStateId::TOUCHDOWN:
+        Touchdown::execute(owner);
+        break;
+    case GameStateId::HALFTIME:
+        Halftime::execute(owner);
+        break;
+    case GameStateId::FINAL:
+        Final::execute(owner);
+        break;
+    case GameStateId::NONE:
+        break;
+    }
+}
+
+void StateMachine<Game>::changeState(GameStateId newState)
+{
+    assert(newState != GameStateId::NONE && "[StateMachine::changeState] Trying to change to a null state");
+
+    switch (curState) {
+    case GameStateId::KICKOFF:
+        Kickoff::exit(owner);
+        break;
+    case GameStateId::EXTRA_POINT:
+        ExtraPoint::exit(owner);
+        break;
+    case GameStateId::PLAY_FROM_SCRIMMAGE:
+        PlayFromScrimmage::exit(owner);
+        break;
+    case GameStateId::TOUCHDOWN:
+        Touchdown::exit(owner);
+        break;
+    case GameStateId::HALFTIME:
+        Halftime::exit(owner);
+        break;
+    case GameStateId::FINAL:
+        Final::exit(owner);
+        break;
+    case GameStateId::NONE:
+        break;
+    }
+
+    curState = newState;
+    FB_TRACE_INSTANT(ENTER_NAMES[static_cast<int>(curState)], "state");
+
+    switch (curState) {
+    case GameStateId::KICKOFF:
+        Kickoff::enter(owner);
+        break;
+    case GameStateId::EXTRA_POINT:
+        ExtraPoint::enter(owner);
+        break;
+    case GameStateId::PLAY_FROM_SCRIMMAGE:
+        PlayFromScrimmage::enter(owner);
+        break;
+    case GameStateId::TOUCHDOWN:
+        Touchdown::enter(owner);
+        break;
+    case GameStateId::HALFTIME:
+        Halftime::enter(owner);
+        break;
+    case GameStateId::FINAL:
+        Final::enter(owner);
+        break;
+    case GameStateId::NONE:
+        break;
+    }
+}
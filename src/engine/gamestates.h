@@ -14,44 +14,55 @@
  *
  * All state control flow is handled in these classes.
  *
- * IMPORTANT NOTE: All of these classes use the singleton pattern. Use the
- * static getInstance() method to access. No further remarks on this.
+ * The set of states is closed, so rather than going through State<Game> and
+ * a singleton for each state, the game's StateMachine keeps a GameStateId and
+ * switches on it. The state classes hold no data, just static functions, which
+ * means nothing here is shared between games and any number of games can run
+ * at once.
  */
 
+/* Identifies each of the states below. NONE is only used before a game's
+ * state machine has been given its first state.
+ */
+enum class GameStateId : unsigned char {
+    NONE,
+    KICKOFF,
+    EXTRA_POINT,
+    PLAY_FROM_SCRIMMAGE,
+    TOUCHDOWN,
+    HALFTIME,
+    FINAL
+};
+
+const unsigned int NUM_GAME_STATES = static_cast<unsigned int>(GameStateId::FINAL) + 1;
+
+/* The state's name, e.g. "PlayFromScrimmage", for traces and metrics. */
+const char* gameStateName(GameStateId state);
+
 /* Represents a game where the teams have lined up for a kickoff.
  * It sets up, executes the kickoff, and then hands the state machine
  * off to PlayFromScrimmage.
  */
-class Kickoff : public State<Game> {
-private:
-    Kickoff() { }
-
-public:
-    static Kickoff* getInstance();
+struct Kickoff {
     /* Sets the ball on the 35 yard line for the kick */
-    void enter(Game* game);
+    static void enter(Game* game);
     /* Swaps possession to the other team, 1st and 10 at their own 25 */
-    void execute(Game* game);
-    void exit(Game* game);
+    static void execute(Game* game);
+    static void exit(Game* game);
 };
 
 /* Represents a PAT attempt, either a kick or a two point attempt. The offense
  * is able to call either a kick or go for two, and the score is updated
  * accordingly before moving the state to kickoff.
  */
-class ExtraPoint : public State<Game> {
-private:
-    ExtraPoint() { }
-
-public:
-    static ExtraPoint* getInstance();
+struct ExtraPoint {
     /* Sets up at the 3 yard line for the extra point attempt */
-    void enter(Game* game);
+    static void enter(Game* game);
     /* Gets playcalls and simulates the PAT. Updates scores and moves control
      * to the kickoff
      */
-    void execute(Game* game);
-    void exit(Game* game);
+    static void execute(Game* game);
+    static void exit(Game* game);
 };
 
 /* Represents any typical play, where the offense snaps the ball and a touchdown
@@ -60,62 +71,86 @@ public:
  * These don't currently keep track of the down and distance, but I plan to move
  * towards that.
  */
-class PlayFromScrimmage : public State<Game> {
-private:
-    PlayFromScrimmage() { }
-
-public:
-    static PlayFromScrimmage* getInstance();
-    void enter(Game* game);
+struct PlayFromScrimmage {
+    static void enter(Game* game);
     /* Gets both teams playcalls and simulated a play. Depending on the outcome
      * control may move into one of many states.
      */
-    void execute(Game* game);
-    void exit(Game* game);
+    static void execute(Game* game);
+    static void exit(Game* game);
 };
 
 /* One team has just scored a touchdown. For the sake of my sanity, it is always
  * assumed that the team scoring will be stored in the Game's offense pointer,
  * so make sure you do this on turnovers!
  */
-class Touchdown : public State<Game> {
-private:
-    Touchdown() { }
-
-public:
-    static Touchdown* getInstance();
-    void enter(Game* game);
+struct Touchdown {
+    static void enter(Game* game);
     /* Give six points to the offense and change state to ExtraPoint */
-    void execute(Game* game);
-    void exit(Game* game);
+    static void execute(Game* game);
+    static void exit(Game* game);
 };
 
 /* A game that has reached halftime and is ready to restart play.
  */
-class Halftime : public State<Game> {
-private:
-    Halftime() { }
-
-public:
-    static Halftime* getInstance();
-    void enter(Game* game);
+struct Halftime {
+    static void enter(Game* game);
     /* Set up for the away team to kickoff. */
-    void execute(Game* game);
-    void exit(Game* game);
+    static void execute(Game* game);
+    static void exit(Game* game);
 };
 
 /* A Game that has ended. Checking for this state is a good way to tell
  * whether the game is still going.
  */
-class Final : public State<Game> {
+struct Final {
+    static void enter(Game* game);
+    static void execute(Game* game);
+    static void exit(Game* game);
+};
+
+/* The state machine used by Game. Same interface as the general StateMachine,
+ * except states are passed around as GameStateIds.
+ */
+template <>
+class StateMachine<Game> {
 private:
-    Final() { }
+    Game* owner;
+    GameStateId curState;
 
 public:
-    static Final* getInstance();
-    void enter(Game* game);
-    void execute(Game* game);
-    void exit(Game* game);
+    /* Note: the state is NONE after a call to the constructor! */
+    StateMachine(Game* own)
+        : owner(own)
+        , curState(GameStateId::NONE)
+    {
+    }
+
+    /* Calls the current state's execute function. */
+    void update() const;
+
+    /* Changes state to newState, calling exit on the current state and enter
+     * on the new one.
+     */
+    void changeState(GameStateId newState);
+
+    /* Sets the current state without calling exit or enter. Only meant for
+     * restoring a game that was saved in the middle of some state.
+     */
+    void setState(GameStateId state)
+    {
+        curState = state;
+    }
+
+    /* getters... */
+    GameStateId getCurrentState() const { return curState; }
+    Game* getOwner() const { return owner; }
+
+    /* Checks whether the game is currently in the given state. */
+    bool inState(GameStateId state) const
+    {
+        return curState == state;
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
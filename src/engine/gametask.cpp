@@ -0,0 +1,163 @@
+#include "gametask.h"
+#include "../learn/model.h"
+#include <utility>
+
+GameTask& GameTask::operator=(GameTask&& other) noexcept
+{
+    if (this != &other) {
+        if (handle)
+            handle.destroy();
+        handle = other.handle;
+        other.handle = nullptr;
+    }
+    return *this;
+}
+
+GameTask::~GameTask()
+{
+    if (handle)
+        handle.destroy();
+}
+
+void GameTask::resume()
+{
+    // A finished coroutine can't be resumed again.
+    if (done())
+        return;
+
+    handle.resume();
+    if (handle.promise().error)
+        std::rethrow_exception(std::exchange(handle.promise().error, nullptr));
+}
+
+void SnapCalls::await_suspend(std::coroutine_handle<GameTask::promise_type> waiting)
+{
+    promise = &waiting.promise();
+    promise->requests[0] = { game->getOffenseTeam(), game->getSituation(), game->callRandom(true), RUN };
+    promise->requests[1] = { game->getDefenseTeam(), game->getSituation(), game->callRandom(false), RUN };
+}
+
+void SnapCalls::await_resume()
+{
+    game->setCalls(promise->requests[0].call, promise->requests[1].call);
+}
+
+GameTask playAsync(Game* game)
+{
+    return playAsync(ObservedGame<>(game));
+}
+
+/* The calls in a round that need the same model. */
+struct ModelBatch {
+    const PlaycallModel* model;
+    std::vector<PlayRequest*> requests;
+    std::vector<Situation*> situations;
+    std::vector<Random*> rngs;
+    std::vector<PlayCall> calls;
+};
+
+/* Finishes the calls that needed the model, with one trip through it. */
+static void callBatch(ModelBatch& batch)
+{
+    size_t n = batch.requests.size();
+    batch.situations.clear();
+    batch.rngs.clear();
+    for (PlayRequest* request : batch.requests) {
+        batch.situations.push_back(request->situation);
+        batch.rngs.push_back(&request->rng);
+    }
+    batch.calls.resize(n);
+
+    getPlayCalls(*batch.model, batch.situations.data(), batch.rngs.data(), batch.calls.data(), n);
+    for (size_t i = 0; i < n; i++)
+        batch.requests[i]->call = batch.calls[i];
+    batch.requests.clear();
+}
+
+InterleavedGames::InterleavedGames(const std::vector<Game*>& games)
+    : waiting(games.size(), 0)
+    , numLeft(games.size())
+{
+    tasks.reserve(games.size());
+    for (size_t i = 0; i < games.size(); i++) {
+        tasks.push_back(playAsync(games[i]));
+        ready.push_back(i);
+    }
+}
+
+InterleavedGames::~InterleavedGames() = default;
+
+std::vector<PendingCall> InterleavedGames::playRound(const std::function<void(size_t game)>& finished)
+{
+    std::vector<PendingCall> pending;
+
+    // Play every game that can go up to its next snap, dropping those that
+    // finish.
+    size_t kept = 0;
+    for (size_t i : ready) {
+        tasks[i].resume();
+        if (tasks[i].done()) {
+            numLeft--;
+            finished(i);
+        } else {
+            ready[kept++] = i;
+        }
+    }
+    ready.resize(kept);
+
+    // Make whatever calls can be made on the spot, sort the ones that need a
+    // model by model, and set aside games with calls left pending.
+    kept = 0;
+    for (size_t i : ready) {
+        for (unsigned int side = 0; side < 2; side++) {
+            PlayRequest& request = tasks[i].requests()[side];
+            const PlaycallModel* model = nullptr;
+            switch (request.team->prepareCall(request.situation, request.rng, request.call, model)) {
+            case CALL_MADE:
+                break;
+            case CALL_NEEDS_MODEL: {
+                size_t b = 0;
+                while (b < batches.size() && batches[b].model != model)
+                    b++;
+                if (b == batches.size())
+                    batches.push_back({ model, {}, {}, {}, {} });
+                batches[b].requests.push_back(&request);
+                break;
+            }
+            case CALL_PENDING:
+                waiting[i]++;
+                pending.push_back({ i, &request });
+                break;
+            }
+        }
+        if (waiting[i] == 0)
+            ready[kept++] = i;
+    }
+    ready.resize(kept);
+
+    for (ModelBatch& batch : batches) {
+        if (!batch.requests.empty())
+            callBatch(batch);
+    }
+
+    return pending;
+}
+
+void InterleavedGames::answer(const PendingCall& pending)
+{
+    if (--waiting[pending.game] == 0)
+        ready.push_back(pending.game);
+}
+
+void playInterleaved(const std::vector<Game*>& games,
+    const std::function<void(size_t game)>& finished)
+{
+    InterleavedGames interleaved(games);
+    while (!interleaved.done()) {
+        for (const PendingCall& call : interleaved.playRound(finished)) {
+            PlayRequest& request = *call.request;
+            request.call = request.team->callPlay(request.situation, request.rng);
+            interleaved.answer(call);
+        }
+    }
+}
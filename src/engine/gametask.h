@@ -0,0 +1,171 @@
+#ifndef __GAMETASK_H
+#define __GAMETASK_H
+
+#include "game.h"
+#include "observers.h"
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <vector>
+
+/**
+ * Games as C++20 coroutines. Game::gameLoop() asks each team for its call
+ * right in the middle of a snap, and waits for however long that takes. A
+ * game played by playAsync() instead suspends before every snap with the two
+ * calls it needs as PlayRequests, and carries on once whoever resumes it has
+ * filled them in. So one thread can keep any number of games going, and
+ * answer their calls however suits it: all at once through the model, or as
+ * players get back to it, without ever blocking on one game.
+ *
+ * Every call is made with the random numbers Game::callRandom() gives it, so
+ * a game played this way plays out exactly as it would through gameLoop(),
+ * in whatever order its calls are answered.
+ */
+
+/* A call a suspended game is waiting on. Whoever resumes the game fills in
+ * call. */
+struct PlayRequest {
+    Team* team;
+    Situation* situation;
+    /* what the call must be made with, see Game::callRandom() */
+    Random rng;
+    PlayCall call;
+};
+
+class GameTask {
+public:
+    struct promise_type {
+        /* the offense's call, then the defense's */
+        PlayRequest requests[2];
+        std::exception_ptr error;
+
+        GameTask get_return_object()
+        {
+            return GameTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit GameTask(std::coroutine_handle<promise_type> handle)
+        : handle(handle)
+    {
+    }
+
+public:
+    GameTask(GameTask&& other) noexcept
+        : handle(other.handle)
+    {
+        other.handle = nullptr;
+    }
+    GameTask& operator=(GameTask&& other) noexcept;
+    GameTask(const GameTask&) = delete;
+    GameTask& operator=(const GameTask&) = delete;
+    ~GameTask();
+
+    /* Plays the game up to its next snap, or to the end. Rethrows anything
+     * the game threw. Does nothing once the game is over. */
+    void resume();
+    bool done() const { return handle.done(); }
+    /* What the game is waiting on, while it's suspended at a snap: the
+     * offense's call, then the defense's. */
+    PlayRequest* requests() { return handle.promise().requests; }
+};
+
+/* What a game co_awaits before a snap. Suspends with both teams' requests
+ * filled in, and hands the game their calls when it's resumed.
+ */
+class SnapCalls {
+private:
+    Game* game;
+    GameTask::promise_type* promise;
+
+public:
+    explicit SnapCalls(Game* game)
+        : game(game)
+        , promise(nullptr)
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<GameTask::promise_type> waiting);
+    void await_resume();
+};
+
+/* Same as ObservedGame::gameLoop(), but as a coroutine that suspends before
+ * every snap until both teams' calls are in. Starts out suspended.
+ */
+template <class... Observers>
+GameTask playAsync(ObservedGame<Observers...> observed)
+{
+    Game* game = observed.getGame();
+    while (!game->isOver()) {
+        if (game->atSnap())
+            co_await SnapCalls(game);
+        observed.step();
+    }
+}
+
+/* Same as above, with no observers. */
+GameTask playAsync(Game* game);
+
+/* A call InterleavedGames left pending, and the game waiting on it. */
+struct PendingCall {
+    size_t game;
+    PlayRequest* request;
+};
+
+struct ModelBatch;
+
+/**
+ * Games played interleaved on one thread, a round at a time. Each round,
+ * every game that isn't waiting on a call is played up to its next snap, then
+ * all of their calls are made together: those that need a model in one batch
+ * per model, the rest one at a time through Team::prepareCall(). Calls a team
+ * leaves pending (e.g. a UserTeam's) are handed back, and their games sit out
+ * until answer() says they've been made, so a game waiting on a player never
+ * holds up the others.
+ */
+class InterleavedGames {
+private:
+    std::vector<GameTask> tasks;
+    /* games to play in the next round: not over, and not waiting on a call */
+    std::vector<size_t> ready;
+    /* pending calls each game is waiting on */
+    std::vector<unsigned int> waiting;
+    size_t numLeft;
+    /* usually one or two models, so a list beats a map */
+    std::vector<ModelBatch> batches;
+
+public:
+    explicit InterleavedGames(const std::vector<Game*>& games);
+    ~InterleavedGames();
+
+    InterleavedGames(const InterleavedGames&) = delete;
+    InterleavedGames& operator=(const InterleavedGames&) = delete;
+
+    /* Plays a round, calling finished with each game's index as it ends.
+     * Returns the calls left pending, which stay valid until answered. */
+    std::vector<PendingCall> playRound(const std::function<void(size_t game)>& finished);
+    /* Says a pending call has been filled in. Its game carries on next round
+     * once it has all of its calls. */
+    void answer(const PendingCall& pending);
+    /* True once every game is over. */
+    bool done() const { return numLeft == 0; }
+};
+
+/* Plays every game to the end with InterleavedGames, calling finished with
+ * each game's index as it ends. Any calls left pending are made there and
+ * then with Team::callPlay(), which for a UserTeam waits on stdin; anything
+ * that mustn't block should run InterleavedGames itself.
+ */
+void playInterleaved(const std::vector<Game*>& games,
+    const std::function<void(size_t game)>& finished);
+
+#endif
@@ -0,0 +1,93 @@
+#include "metrics.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> metricsEnabled { false };
+
+/* Every thread's slot. Kept after the threads exit, so their counts aren't
+ * lost. */
+static std::mutex slotsLock;
+static std::vector<std::unique_ptr<MetricSlot>> slots;
+static thread_local MetricSlot* threadSlot = nullptr;
+
+void enableMetrics()
+{
+    metricsEnabled.store(true, std::memory_order_relaxed);
+}
+
+MetricSlot& metricSlot()
+{
+    if (!threadSlot) {
+        std::lock_guard<std::mutex> guard(slotsLock);
+        slots.push_back(std::make_unique<MetricSlot>());
+        threadSlot = slots.back().get();
+    }
+    return *threadSlot;
+}
+
+void countInferenceBatch(size_t n)
+{
+    if (!metricsEnabled.load(std::memory_order_relaxed))
+        return;
+
+    unsigned int bucket = 0;
+    while (bucket < NUM_BATCH_SIZE_BUCKETS - 1 && n > BATCH_SIZE_BOUNDS[bucket])
+        bucket++;
+
+    MetricSlot& slot = metricSlot();
+    bumpMetric(slot.batchSizes[bucket]);
+    bumpMetric(slot.batchSituations, n);
+}
+
+MetricTotals metricTotals()
+{
+    MetricTotals totals;
+    std::lock_guard<std::mutex> guard(slotsLock);
+    for (const std::unique_ptr<MetricSlot>& slot : slots) {
+        totals.games += slot->games.load(std::memory_order_relaxed);
+        totals.plays += slot->plays.load(std::memory_order_relaxed);
+        for (unsigned int s = 0; s < NUM_GAME_STATES; s++)
+            totals.stateExecutions[s] += slot->stateExecutions[s].load(std::memory_order_relaxed);
+        for (unsigned int b = 0; b < NUM_BATCH_SIZE_BUCKETS; b++)
+            totals.batchSizes[b] += slot->batchSizes[b].load(std::memory_order_relaxed);
+        totals.batchSituations += slot->batchSituations.load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+void writeMetrics(std::ostream& out, const MetricTotals& totals)
+{
+    out << "# HELP fb_games_total Games simulated.\n"
+        << "# TYPE fb_games_total counter\n"
+        << "fb_games_total " << totals.games << '\n'
+        << "# HELP fb_plays_total Plays simulated.\n"
+        << "# TYPE fb_plays_total counter\n"
+        << "fb_plays_total " << totals.plays << '\n';
+
+    out << "# HELP fb_state_executions_total Steps run in each game state.\n"
+        << "# TYPE fb_state_executions_total counter\n";
+    for (unsigned int s = 0; s < NUM_GAME_STATES; s++) {
+        GameStateId state = static_cast<GameStateId>(s);
+        if (state != GameStateId::NONE)
+            out << "fb_state_executions_total{state=\"" << gameStateName(state) << "\"} "
+                << totals.stateExecutions[s] << '\n';
+    }
+
+    // Prometheus histograms count everything up to each bound.
+    out << "# HELP fb_inference_batch_size Situations per trip through the playcall model.\n"
+        << "# TYPE fb_inference_batch_size histogram\n";
+    uint64_t count = 0;
+    for (unsigned int b = 0; b < NUM_BATCH_SIZE_BUCKETS; b++) {
+        count += totals.batchSizes[b];
+        out << "fb_inference_batch_size_bucket{le=\"";
+        if (b < NUM_BATCH_SIZE_BUCKETS - 1)
+            out << BATCH_SIZE_BOUNDS[b];
+        else
+            out << "+Inf";
+        out << "\"} " << count << '\n';
+    }
+    out << "fb_inference_batch_size_sum " << totals.batchSituations << '\n'
+        << "fb_inference_batch_size_count " << count << '\n';
+}
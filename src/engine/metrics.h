@@ -0,0 +1,81 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include "gamestates.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Running counts of what the engine has done, for a long lived service to
+ * report (see fb-daemon --metrics-port): games and plays, how often each game
+ * state has run, and how many situations each trip through the playcall
+ * model had.
+ *
+ * Nothing is counted until enableMetrics(). After that each thread counts
+ * into a slot of its own, with plain relaxed stores since it's the only
+ * writer, so counting never takes a lock or bounces a cache line between
+ * cores. Slots are only added together when the metrics are written out.
+ */
+
+/* Upper bounds of the inference batch size histogram's buckets, past which
+ * is everything else. */
+const size_t BATCH_SIZE_BOUNDS[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+const unsigned int NUM_BATCH_SIZE_BUCKETS = sizeof(BATCH_SIZE_BOUNDS) / sizeof(BATCH_SIZE_BOUNDS[0]) + 1;
+
+/* One thread's counts. Padded out so that no two threads share a line. */
+struct alignas(64) MetricSlot {
+    std::atomic<uint64_t> games { 0 };
+    std::atomic<uint64_t> plays { 0 };
+    std::atomic<uint64_t> stateExecutions[NUM_GAME_STATES] = {};
+    /* model calls by batch size, not cumulative */
+    std::atomic<uint64_t> batchSizes[NUM_BATCH_SIZE_BUCKETS] = {};
+    std::atomic<uint64_t> batchSituations { 0 };
+};
+
+/* Added up over every slot. */
+struct MetricTotals {
+    uint64_t games = 0;
+    uint64_t plays = 0;
+    uint64_t stateExecutions[NUM_GAME_STATES] = {};
+    uint64_t batchSizes[NUM_BATCH_SIZE_BUCKETS] = {};
+    uint64_t batchSituations = 0;
+};
+
+extern std::atomic<bool> metricsEnabled;
+
+/* Starts counting. */
+void enableMetrics();
+/* This thread's slot, made the first time. */
+MetricSlot& metricSlot();
+/* Every slot added up. Safe to call while the engine is running. */
+MetricTotals metricTotals();
+/* Writes metricTotals() in Prometheus' text format, all prefixed with fb_. */
+void writeMetrics(std::ostream& out, const MetricTotals& totals);
+
+/* Adds n to a counter only this thread writes to. */
+inline void bumpMetric(std::atomic<uint64_t>& counter, uint64_t n = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void countGame(uint64_t plays)
+{
+    if (metricsEnabled.load(std::memory_order_relaxed)) {
+        MetricSlot& slot = metricSlot();
+        bumpMetric(slot.games);
+        bumpMetric(slot.plays, plays);
+    }
+}
+
+inline void countStateExecution(GameStateId state)
+{
+    if (metricsEnabled.load(std::memory_order_relaxed))
+        bumpMetric(metricSlot().stateExecutions[static_cast<unsigned int>(state)]);
+}
+
+/* Counts a trip through the playcall model with n situations. */
+void countInferenceBatch(size_t n);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef __OBSERVERS_H
+#define __OBSERVERS_H
+
+#include "game.h"
+#include "perfcounters.h"
+#include "trace.h"
+#include <tuple>
+
+/**
+ * Observers fixed at compile time.
+ *
+ * The observer lists on Game are handy, but every observer gets a virtual call
+ * on every snap whether it cares about that play or not. An ObservedGame
+ * instead takes its observers as template parameters, and only calls an
+ * observer for the kinds of events it subscribed to. With no observers at all
+ * the checks compile away, and the loop is the same as Game::gameLoop().
+ *
+ * An observer is any class with
+ *
+ *     static constexpr unsigned int events = TOUCHDOWN_EVENT | ...;
+ *     void onGameEvent(GameEvent event, Game* game);
+ *
+ * onGameEvent() is called once for each subscribed event in a step. For
+ * SNAP_EVENT the game's Situation is about to be played, and for every other
+ * event game->getLastOutcome() holds the play that was just run.
+ */
+
+/* Union of the events any of the observers subscribed to. */
+template <class... Observers>
+constexpr unsigned int subscribedEvents = (0u | ... | Observers::events);
+
+template <class... Observers>
+class ObservedGame {
+private:
+    Game* game;
+    std::tuple<Observers&...> observers;
+
+    /* Calls obs before a snap, if it subscribed to SNAP_EVENT. */
+    template <class Observer>
+    static void dispatchSnap(Observer& obs, Game* game)
+    {
+        if constexpr ((Observer::events & SNAP_EVENT) != 0)
+            obs.onGameEvent(SNAP_EVENT, game);
+    }
+
+    /* Calls obs for each event it subscribed to that is set in events. */
+    template <class Observer>
+    static void dispatch(Observer& obs, Game* game, unsigned int events)
+    {
+        constexpr unsigned int mask = Observer::events & ~SNAP_EVENT;
+        if constexpr ((mask & PLAY_EVENT) != 0)
+            if (events & PLAY_EVENT)
+                obs.onGameEvent(PLAY_EVENT, game);
+        if constexpr ((mask & TOUCHDOWN_EVENT) != 0)
+            if (events & TOUCHDOWN_EVENT)
+                obs.onGameEvent(TOUCHDOWN_EVENT, game);
+        if constexpr ((mask & TURNOVER_EVENT) != 0)
+            if (events & TURNOVER_EVENT)
+                obs.onGameEvent(TURNOVER_EVENT, game);
+        if constexpr ((mask & DRIVE_END_EVENT) != 0)
+            if (events & DRIVE_END_EVENT)
+                obs.onGameEvent(DRIVE_END_EVENT, game);
+        if constexpr ((mask & QUARTER_END_EVENT) != 0)
+            if (events & QUARTER_END_EVENT)
+                obs.onGameEvent(QUARTER_END_EVENT, game);
+    }
+
+public:
+    /* The game and observers are not owned, and must outlive this object. */
+    ObservedGame(Game* game, Observers&... obs)
+        : game(game)
+        , observers(obs...)
+    {
+    }
+
+    /* Runs one step of the game, notifying the observers along the way. */
+    void step()
+    {
+        constexpr unsigned int subscribed = subscribedEvents<Observers...>;
+
+        if constexpr ((subscribed & SNAP_EVENT) != 0) {
+            if (game->atSnap()) {
+                FB_ALLOC_SCOPE(ALLOC_OBSERVERS);
+                std::apply([this](Observers&... obs) {
+                    (dispatchSnap(obs, game), ...);
+                },
+                    observers);
+            }
+        }
+
+        game->step();
+
+        if constexpr ((subscribed & ~SNAP_EVENT) != 0) {
+            unsigned int events = game->getLastEvents();
+            if (events & subscribed) {
+                FB_ALLOC_SCOPE(ALLOC_OBSERVERS);
+                std::apply([this, events](Observers&... obs) {
+                    (dispatch(obs, game, events), ...);
+                },
+                    observers);
+            }
+        }
+    }
+
+    /* Same as Game::gameLoop(), but with the observers attached. */
+    void gameLoop()
+    {
+        FB_PERF_SCOPE(PERF_GAME);
+        FB_TRACE_GAME();
+        while (!game->isOver())
+            step();
+    }
+
+    Game* getGame() const { return game; }
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "perfcounters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <string>
+
+static const char* const PHASE_NAMES[NUM_PERF_PHASES] = { "game", "play", "playcall" };
+
+/* perf_event_open() config for each counter, all PERF_TYPE_HARDWARE */
+static const uint64_t COUNTER_CONFIGS[NUM_PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_MISSES
+};
+
+/* Totals of threads that have exited. */
+static std::mutex finishedLock;
+static PerfTotals finished;
+/* Why the counters couldn't be opened, if they couldn't. */
+static std::string openError;
+
+void PerfTotals::add(const PerfTotals& other)
+{
+    for (unsigned int p = 0; p < NUM_PERF_PHASES; p++) {
+        calls[p] += other.calls[p];
+        for (unsigned int c = 0; c < NUM_PERF_COUNTERS; c++)
+            counts[p][c] += other.counts[p][c];
+    }
+}
+
+/*
+ * One thread's counters and totals.
+ */
+struct PerfThread {
+    int fds[NUM_PERF_COUNTERS];
+    bool opened = false;
+    bool failed = false;
+    PerfTotals totals;
+
+    bool open();
+    ~PerfThread();
+};
+
+static int openCounter(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+bool PerfThread::open()
+{
+    for (unsigned int c = 0; c < NUM_PERF_COUNTERS; c++) {
+        fds[c] = openCounter(COUNTER_CONFIGS[c], c == 0 ? -1 : fds[0]);
+        if (fds[c] < 0) {
+            std::lock_guard<std::mutex> guard(finishedLock);
+            openError = std::strerror(errno);
+            for (unsigned int i = 0; i < c; i++)
+                close(fds[i]);
+            return false;
+        }
+    }
+
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+PerfThread::~PerfThread()
+{
+    if (opened) {
+        for (int fd : fds)
+            close(fd);
+    }
+
+    std::lock_guard<std::mutex> guard(finishedLock);
+    finished.add(totals);
+}
+
+static thread_local PerfThread perfThread;
+
+bool readPerfCounters(uint64_t values[NUM_PERF_COUNTERS])
+{
+    PerfThread& thread = perfThread;
+    if (!thread.opened) {
+        if (thread.failed)
+            return false;
+        thread.opened = thread.open();
+        thread.failed = !thread.opened;
+        if (thread.failed)
+            return false;
+    }
+
+    // With PERF_FORMAT_GROUP, one read gets the whole group: the number of
+    // counters, then their values in the order they were opened.
+    uint64_t group[1 + NUM_PERF_COUNTERS];
+    if (read(thread.fds[0], group, sizeof(group)) != sizeof(group))
+        return false;
+
+    for (unsigned int c = 0; c < NUM_PERF_COUNTERS; c++)
+        values[c] = group[1 + c];
+    return true;
+}
+
+void addPerfSample(PerfPhase phase, uint64_t calls, const uint64_t start[NUM_PERF_COUNTERS],
+    const uint64_t end[NUM_PERF_COUNTERS])
+{
+    PerfTotals& totals = perfThread.totals;
+    totals.calls[phase] += calls;
+    for (unsigned int c = 0; c < NUM_PERF_COUNTERS; c++)
+        totals.counts[phase][c] += end[c] - start[c];
+}
+
+PerfTotals perfTotals()
+{
+    PerfTotals totals = perfThread.totals;
+    std::lock_guard<std::mutex> guard(finishedLock);
+    totals.add(finished);
+    return totals;
+}
+
+/* Prints one row of per-call averages. */
+static void reportRow(std::ostream& out, const char* name, const uint64_t counts[NUM_PERF_COUNTERS],
+    uint64_t calls)
+{
+    double n = calls;
+    out << std::left << std::setw(16) << name << std::right << std::setw(12) << calls
+        << std::setw(14) << counts[PERF_CYCLES] / n
+        << std::setw(14) << counts[PERF_INSTRUCTIONS] / n
+        << std::setw(8) << (counts[PERF_CYCLES] ? double(counts[PERF_INSTRUCTIONS]) / counts[PERF_CYCLES] : 0)
+        << std::setw(14) << counts[PERF_BRANCH_MISSES] / n
+        << std::setw(14) << counts[PERF_CACHE_MISSES] / n << '\n';
+}
+
+void reportPerf(std::ostream& out)
+{
+    PerfTotals totals = perfTotals();
+    {
+        std::lock_guard<std::mutex> guard(finishedLock);
+        if (!openError.empty()) {
+            out << "Hardware counters unavailable: " << openError << '\n';
+            return;
+        }
+    }
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+
+    out << "Hardware counters (user space, per call, phases include what they call)\n"
+        << std::left << std::setw(16) << "phase" << std::right << std::setw(12) << "calls"
+        << std::setw(14) << "cycles" << std::setw(14) << "instructions" << std::setw(8) << "IPC"
+        << std::setw(14) << "branch misses" << std::setw(14) << "cache misses" << '\n';
+    for (unsigned int p = 0; p < NUM_PERF_PHASES; p++) {
+        if (totals.calls[p] > 0)
+            reportRow(out, PHASE_NAMES[p], totals.counts[p], totals.calls[p]);
+    }
+    if (totals.calls[PERF_GAME] > 0 && totals.calls[PERF_PLAY] > 0)
+        reportRow(out, "game, per play", totals.counts[PERF_GAME], totals.calls[PERF_PLAY]);
+
+    out.flags(flags);
+    out.precision(precision);
+}
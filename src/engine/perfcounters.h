@@ -0,0 +1,98 @@
+#ifndef __PERFCOUNTERS_H
+#define __PERFCOUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Hardware performance counters around the hot parts of the engine: cycles,
+ * instructions, branch misses and cache misses, counted in user space through
+ * Linux's perf_event_open(). Only built in with FB_PERF (cmake -DFB_PERF=ON);
+ * otherwise FB_PERF_SCOPE is empty and costs nothing.
+ *
+ * Each thread opens its own group of counters the first time it enters a
+ * phase, and keeps its own totals, which are added to everyone else's when
+ * the thread exits. Phases are inclusive, so a play's counts are also part of
+ * its game's. Reading the counters is a system call, so scopes add a little
+ * overhead of their own to whatever encloses them.
+ */
+
+enum PerfPhase {
+    /* a whole game, from the first step to the last */
+    PERF_GAME,
+    /* Play::runPlay() */
+    PERF_PLAY,
+    /* asking the playcall model for a call */
+    PERF_PLAYCALL,
+    NUM_PERF_PHASES
+};
+
+enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+    NUM_PERF_COUNTERS
+};
+
+struct PerfTotals {
+    uint64_t calls[NUM_PERF_PHASES] = {};
+    uint64_t counts[NUM_PERF_PHASES][NUM_PERF_COUNTERS] = {};
+
+    void add(const PerfTotals& other);
+};
+
+/* Reads this thread's counters, opening them if this is the first time.
+ * Returns false if they can't be opened, e.g. because perf_event_paranoid
+ * doesn't allow it.
+ */
+bool readPerfCounters(uint64_t values[NUM_PERF_COUNTERS]);
+/* Adds what the counters went up by between start and end, over that many
+ * calls, to this thread's totals for phase. */
+void addPerfSample(PerfPhase phase, uint64_t calls, const uint64_t start[NUM_PERF_COUNTERS],
+    const uint64_t end[NUM_PERF_COUNTERS]);
+
+/* Totals from every thread that has exited, plus the calling thread's. Call
+ * it once the workers are done. */
+PerfTotals perfTotals();
+/* Prints perfTotals() per phase, per call (i.e. per game for PERF_GAME and
+ * per play for PERF_PLAY), and the whole game loop per play. */
+void reportPerf(std::ostream& out);
+
+/* Counts one pass through a phase, from construction to destruction. */
+class PerfScope {
+private:
+    PerfPhase phase;
+    uint64_t calls;
+    bool counting;
+    uint64_t start[NUM_PERF_COUNTERS];
+
+public:
+    /* calls is how many calls into the phase this counts as, for batches. */
+    explicit PerfScope(PerfPhase phase, uint64_t calls = 1)
+        : phase(phase)
+        , calls(calls)
+    {
+        counting = readPerfCounters(start);
+    }
+
+    ~PerfScope()
+    {
+        uint64_t end[NUM_PERF_COUNTERS];
+        if (counting && readPerfCounters(end))
+            addPerfSample(phase, calls, start, end);
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+};
+
+#ifdef FB_PERF
+#define FB_PERF_SCOPE(phase) PerfScope perfScope_##phase(phase)
+#define FB_PERF_SCOPE_N(phase, calls) PerfScope perfScope_##phase(phase, calls)
+#else
+#define FB_PERF_SCOPE(phase)
+#define FB_PERF_SCOPE_N(phase, calls)
+#endif
+
+#endif
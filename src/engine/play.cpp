@@ -1,32 +1,41 @@
+#include "alloctrack.h"
+#include "dice.h"
 #include "game.h"
+#include "perfcounters.h"
 #include "playcall.h"
+#include "ruleset.h"
+#include "trace.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <iostream>
 
-Play::Play(PlayCall offense, PlayCall defense, Situation* sit)
+Play::Play(PlayCall offense, PlayCall defense, Situation* sit, Random* rng,
+    const Ruleset* ruleset)
 {
     offCall = offense;
     defCall = defense;
     context = sit;
+    dice = rng;
+    rules = ruleset;
 }
 
 /**
  * Used to add a fumble to the end of a play. Call this after a PlayOutcome
  * has been fully constructed by some other means.
  */
-static void addFumble(PlayOutcome* outcome)
+static void addFumble(Random& rng, PlayOutcome* outcome)
 {
-    int result = rollDice(1, false) - rollDice(1, false);
+    int result = rollDice<1>(rng) - rollDice<1>(rng);
     if (result > 0) {
         outcome->changePoss = true;
         outcome->result = FUMBLE;
         if (result == 3)
-            outcome->yardsGained -= rollDice(2, true);
+            outcome->yardsGained -= rollDice<2, true>(rng);
         else if (result == 4)
-            outcome->yardsGained -= rollDice(2, true) + 10;
+            outcome->yardsGained -= rollDice<2, true>(rng) + 10;
         else if (result == 5)
-            outcome->yardsGained -= rollDice(2, true) + 20;
+            outcome->yardsGained -= rollDice<2, true>(rng) + 20;
     }
 }
 
@@ -69,9 +78,9 @@ static inline PlayOutcome* offensiveTouchdown(PlayResult result)
 /**
  * Returns play ending in an interception.
  */
-static inline PlayOutcome* interception()
+static inline PlayOutcome* interception(Random& rng)
 {
-    return newOutcome(INTERCEPTION, rollDice(3, true) - rollDice(2, true), true,
+    return newOutcome(INTERCEPTION, rollDice<3, true>(rng) - rollDice<2, true>(rng), true,
         false);
 }
 
@@ -86,58 +95,64 @@ static inline PlayOutcome* incomplete()
 /**
  * Returns a play resulting in a completed pass.
  */
-static inline PlayOutcome* completion(unsigned int baseGain, unsigned int additionalDice,
+static inline PlayOutcome* completion(Random& rng, unsigned int baseGain, unsigned int additionalDice,
     bool breakaway)
 {
-    return newOutcome(COMPLETED_PASS, baseGain + rollDice(additionalDice, breakaway),
+    return newOutcome(COMPLETED_PASS, baseGain + rollDice(rng, additionalDice, breakaway),
         false, false);
 }
 
+/* A completion for the yards in a table entry. */
+static inline PlayOutcome* completion(Random& rng, const Gain& gain, bool breakaway)
+{
+    return completion(rng, gain.base, gain.dice, breakaway);
+}
+
 /**
  * Returns a play ending in a sack, with no fumble.
  */
-static inline PlayOutcome* sack()
+static inline PlayOutcome* sack(Random& rng)
 {
-    return newOutcome(SACK, -2 - rollDice(1, true), false, false);
+    return newOutcome(SACK, -2 - rollDice<1, true>(rng), false, false);
 }
 
-static inline PlayOutcome* qbScramble()
+static inline PlayOutcome* qbScramble(Random& rng)
 {
-    return newOutcome(HANDOFF, rollDice(2, true) - 4, false, false);
+    return newOutcome(HANDOFF, rollDice<2, true>(rng) - 4, false, false);
 }
 
 /**
  * QB gets pressured when dropping back. Returns a random event to follow this.
  */
-static PlayOutcome* qbPressure()
+static PlayOutcome* qbPressure(Random& rng)
 {
     PlayOutcome* outcome;
-    unsigned int roll = rollDice(2, false);
+    unsigned int roll = rollDice<2>(rng);
 
     switch (roll) {
     case 2:
     case 3:
-        outcome = interception();
+        outcome = interception(rng);
         break;
     case 4:
     case 5:
     case 6:
-        outcome = sack();
+        outcome = sack(rng);
         break;
     case 7:
     case 8:
         outcome = incomplete();
         break;
     case 9:
-        outcome = qbScramble();
+        outcome = qbScramble(rng);
     case 10:
-        outcome = completion(0, 1, true);
+        outcome = completion(rng, 0, 1, true);
         break;
     case 11:
-        outcome = completion(0, 2, true);
+        outcome = completion(rng, 0, 2, true);
         break;
     case 12:
-        outcome = completion(0, 3, true);
+        outcome = completion(rng, 0, 3, true);
         break;
     }
 
@@ -147,21 +162,21 @@ static PlayOutcome* qbPressure()
 /**
  * Returns a play ending in a random mishap.
  */
-static PlayOutcome* mishap()
+static PlayOutcome* mishap(Random& rng)
 {
     PlayOutcome* outcome;
-    unsigned int roll = rollDice(2, false);
+    unsigned int roll = rollDice<2>(rng);
 
     switch (roll) {
     case 2:
     case 3:
     case 4:
     case 5:
-        outcome = sack();
-        addFumble(outcome);
+        outcome = sack(rng);
+        addFumble(rng, outcome);
         break;
     case 6:
-        outcome = interception();
+        outcome = interception(rng);
     case 7:
     case 8:
         outcome = incomplete();
@@ -169,11 +184,11 @@ static PlayOutcome* mishap()
     case 9:
     case 10:
     case 11:
-        outcome = completion(0, 2, true);
-        addFumble(outcome);
+        outcome = completion(rng, 0, 2, true);
+        addFumble(rng, outcome);
         break;
     case 12:
-        outcome = completion(0, 3, true);
+        outcome = completion(rng, 0, 3, true);
         break;
     }
 
@@ -185,13 +200,13 @@ static PlayOutcome* mishap()
  * plus the sum of an additional number of dice. The negative flag indicates that
  * the play lost yards, and the multiplier divides the roll of the dice.
  */
-static inline PlayOutcome* handoff(int base,
+static inline PlayOutcome* handoff(Random& rng, int base,
     unsigned int additionalDice,
     bool negative,
     int multiplier,
     bool breakaway)
 {
-    int roll = rollDice(additionalDice);
+    int roll = rollDice(rng, additionalDice);
     roll += multiplier - 1;
     if (negative)
         roll = -roll;
@@ -202,16 +217,22 @@ static inline PlayOutcome* handoff(int base,
  * A streamlined version of handoff that looks more like completion().
  * Ignores the multiplier and negative yard flag.
  */
-static inline PlayOutcome* handoff(int base, unsigned int additionalDice,
+static inline PlayOutcome* handoff(Random& rng, int base, unsigned int additionalDice,
     bool breakaway)
 {
-    return handoff(base, additionalDice, false, 1, breakaway);
+    return handoff(rng, base, additionalDice, false, 1, breakaway);
 }
 
-static inline PlayOutcome* fumbledSnap()
+/* A handoff for the yards in a table entry. */
+static inline PlayOutcome* handoff(Random& rng, const Gain& gain, bool breakaway)
+{
+    return handoff(rng, gain.base, gain.dice, breakaway);
+}
+
+static inline PlayOutcome* fumbledSnap(Random& rng)
 {
     PlayOutcome* outcome = newOutcome(SACK, -1, false, false);
-    addFumble(outcome);
+    addFumble(rng, outcome);
     return outcome;
 }
 
@@ -220,33 +241,22 @@ static inline PlayOutcome* fumbledSnap()
 #define NEVER -1
 #define DEFAULT 0
 
-/* An array containing all possible defensive modifiers.
- * The indexing goes [offensive call][defensive call][dice roll]
- */
-static const int DEFENSIVE_MODS[][3][11] = {
-    { { 1, 0, 0, 0, 0, 0, 0, -1, -1, -1, -2 },
-        { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 },
-        { 1, 1, 0, 0, 0, 0, 0, 0, 0, -1, -1 } },
-    { { 1, 1, 0, 0, 0, 0, 0, 0, 0, -1, -1 },
-        { 1, 0, 0, 0, 0, 0, 0, -1, -1, -1, -2 },
-        { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 } },
-    { { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 },
-        { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 },
-        { 1, 0, 0, 0, 0, 0, 0, -1, -1, -1, -2 } }
-};
-
 /**
  * Calculates modifier to add to offensive roll based on defensive play call.
  *
- * The breakaway modifier can be set to ALWAYS, NEVER, or DEFAULT.
+ * The modifiers come from the ruleset's defensiveMods table. The breakaway
+ * modifier can be set to ALWAYS, NEVER, or DEFAULT.
  */
-static int calcDefModifier(PlayCall offense, PlayCall defense, int& breakaway)
+static int calcDefModifier(Random& rng, const Ruleset& rules, PlayCall offense,
+    PlayCall defense, int& breakaway)
 {
-    // My play calling logic on fourth down is not fantastic...
-    if (offense == PUNT || defense == PUNT || offense == FIELD_GOAL)
+    // My play calling logic on fourth down is not fantastic... A defense
+    // left to guess on fourth down (e.g. against a player who goes for it)
+    // can "call" a punt or field goal too, and there's no row for those.
+    if (offense == PUNT || defense == PUNT || offense == FIELD_GOAL || defense == FIELD_GOAL)
         return 0;
 
-    unsigned int roll = rollDice(2, false);
+    unsigned int roll = rollDice<2>(rng);
 
     // We need to deal with setting breakaway for a select few special cases.
     // Really don't think this gets any better
@@ -291,13 +301,13 @@ static int calcDefModifier(PlayCall offense, PlayCall defense, int& breakaway)
         }
     }
 
-    return DEFENSIVE_MODS[offense][defense][roll - 2];
+    return rules.defensiveMods[offense][defense][roll - 2];
 }
 
 /**
  * Calculate outcome of a short pass play based on value of dice roll.
  */
-static PlayOutcome* shortPassOutcome(unsigned int roll)
+static PlayOutcome* shortPassOutcome(Random& rng, const Ruleset& rules, unsigned int roll)
 {
     PlayOutcome* outcome;
     switch (roll) {
@@ -307,10 +317,10 @@ static PlayOutcome* shortPassOutcome(unsigned int roll)
         break;
     case 3:
     case 4:
-        outcome = interception();
+        outcome = interception(rng);
         break;
     case 5:
-        outcome = mishap();
+        outcome = mishap(rng);
         break;
     case 6:
     case 7:
@@ -318,41 +328,28 @@ static PlayOutcome* shortPassOutcome(unsigned int roll)
         outcome = incomplete();
         break;
     case 8:
-        outcome = qbPressure();
+        outcome = qbPressure(rng);
         break;
     case 10:
-        outcome = completion(0, 1, false);
-        break;
     case 11:
-        outcome = completion(1, 1, false);
-        break;
     case 12:
-        outcome = completion(0, 2, false);
+        outcome = completion(rng, rules.shortPass[roll - SHORT_PASS_FIRST_GAIN], false);
         break;
     case 13:
-        outcome = completion(0, 2, true);
-        break;
     case 14:
-        outcome = completion(5, 2, true);
-        break;
     case 15:
-        outcome = completion(10, 2, true);
-        break;
     case 16:
-        outcome = completion(15, 2, true);
-        break;
     case 17:
-        outcome = completion(30, 3, true);
-        break;
     case 18:
-        outcome = completion(50, 3, true);
+        outcome = completion(rng, rules.shortPass[roll - SHORT_PASS_FIRST_GAIN], true);
         break;
     case 19:
     case 20:
         outcome = offensiveTouchdown(COMPLETED_PASS);
         break;
     default:
-        // TODO error here
+        // runPlay() keeps rolls in range, so this is never reached
+        outcome = incomplete();
         break;
     }
 
@@ -362,7 +359,7 @@ static PlayOutcome* shortPassOutcome(unsigned int roll)
 /**
  * Calculate outcome of a long pass play based on value of dice roll.
  */
-static PlayOutcome* longPassOutcome(unsigned int roll)
+static PlayOutcome* longPassOutcome(Random& rng, const Ruleset& rules, unsigned int roll)
 {
     PlayOutcome* outcome;
     switch (roll) {
@@ -372,13 +369,13 @@ static PlayOutcome* longPassOutcome(unsigned int roll)
         break;
     case 3:
     case 4:
-        outcome = interception();
+        outcome = interception(rng);
         break;
     case 5:
-        outcome = mishap();
+        outcome = mishap(rng);
         break;
     case 6:
-        outcome = sack();
+        outcome = sack(rng);
         break;
     case 7:
     case 9:
@@ -387,25 +384,17 @@ static PlayOutcome* longPassOutcome(unsigned int roll)
         outcome = incomplete();
         break;
     case 8:
-        outcome = qbPressure();
+        outcome = qbPressure(rng);
         break;
     case 12:
-        outcome = completion(2, 2, false);
+        outcome = completion(rng, rules.longPass[roll - LONG_PASS_FIRST_GAIN], false);
         break;
     case 13:
-        outcome = completion(0, 3, true);
-        break;
     case 14:
-        outcome = completion(5, 3, true);
-        break;
     case 15:
-        outcome = completion(10, 3, true);
-        break;
     case 16:
-        outcome = completion(15, 3, true);
-        break;
     case 17:
-        outcome = completion(40, 4, true);
+        outcome = completion(rng, rules.longPass[roll - LONG_PASS_FIRST_GAIN], true);
         break;
     case 18:
     case 19:
@@ -413,7 +402,8 @@ static PlayOutcome* longPassOutcome(unsigned int roll)
         outcome = offensiveTouchdown(COMPLETED_PASS);
         break;
     default:
-        // TODO error
+        // runPlay() keeps rolls in range, so this is never reached
+        outcome = incomplete();
         break;
     }
 
@@ -423,7 +413,7 @@ static PlayOutcome* longPassOutcome(unsigned int roll)
 /**
  * Calculate outcome of a running play based on value of dice roll.
  */
-static PlayOutcome* runOutcome(unsigned int roll)
+static PlayOutcome* runOutcome(Random& rng, const Ruleset& rules, unsigned int roll)
 {
     PlayOutcome* outcome;
     switch (roll) {
@@ -432,64 +422,53 @@ static PlayOutcome* runOutcome(unsigned int roll)
         outcome = defensiveTouchdown(FUMBLE);
         break;
     case 3:
-        outcome = fumbledSnap();
+        outcome = fumbledSnap(rng);
         break;
     case 4: {
         /* We need to roll again to determine where the fumble occurs. BUT
            if you roll another 3 or 4, this weird cyle of fumbling starts and
            I would like to avoid this entirely. */
-        unsigned int spotOfFumble = rollDice(3, false);
+        unsigned int spotOfFumble = rollDice<3>(rng);
         if (spotOfFumble < 5)
             spotOfFumble = 5;
-        outcome = runOutcome(spotOfFumble);
-        addFumble(outcome);
+        outcome = runOutcome(rng, rules, spotOfFumble);
+        addFumble(rng, outcome);
     } break;
     case 5:
-        outcome = handoff(0, 1, true, 1, false);
+        outcome = handoff(rng, 0, 1, true, 1, false);
         break;
     case 6:
-        outcome = handoff(0, 1, true, 2, false);
+        outcome = handoff(rng, 0, 1, true, 2, false);
         break;
     case 7:
-        outcome = handoff(0, 1, true, 3, false);
+        outcome = handoff(rng, 0, 1, true, 3, false);
         break;
     case 8:
-        outcome = handoff(0, 0, false);
+        outcome = handoff(rng, 0, 0, false);
         break;
     case 9:
     case 10:
-        outcome = handoff(0, 1, false, 2, false);
+        outcome = handoff(rng, 0, 1, false, 2, false);
         break;
     case 11:
-        outcome = handoff(0, 1, false);
-        break;
     case 12:
-        outcome = handoff(1, 1, false);
-        break;
     case 13:
-        outcome = handoff(0, 2, false);
+        outcome = handoff(rng, rules.run[roll - RUN_FIRST_GAIN], false);
         break;
     case 14:
-        outcome = handoff(0, 2, true);
-        break;
     case 15:
-        outcome = handoff(0, 3, true);
-        break;
     case 16:
-        outcome = handoff(5, 3, true);
-        break;
     case 17:
-        outcome = handoff(20, 4, true);
-        break;
     case 18:
-        outcome = handoff(40, 4, true);
+        outcome = handoff(rng, rules.run[roll - RUN_FIRST_GAIN], true);
         break;
     case 19:
     case 20:
         outcome = offensiveTouchdown(HANDOFF);
         break;
     default:
-        // TODO error
+        // runPlay() keeps rolls in range, so this is never reached
+        outcome = handoff(rng, 0, 0, false);
         break;
     }
 
@@ -499,35 +478,35 @@ static PlayOutcome* runOutcome(unsigned int roll)
 /**
  * Takes in the roll and returns the distance the punt travels in the air.
  */
-static int getPuntDistance(unsigned int roll)
+static int getPuntDistance(Random& rng, unsigned int roll)
 {
     int distance;
 
     switch (roll) {
     case 2:
-        distance = rollDice(2, true) + 20;
+        distance = rollDice<2, true>(rng) + 20;
         break;
     case 3:
-        distance = rollDice(2, true) + 25;
+        distance = rollDice<2, true>(rng) + 25;
         break;
     case 4:
-        distance = rollDice(2, true) + 30;
+        distance = rollDice<2, true>(rng) + 30;
         break;
     case 5:
     case 6:
     case 7:
     case 8:
-        distance = rollDice(3, true) + 30;
+        distance = rollDice<3, true>(rng) + 30;
         break;
     case 9:
     case 10:
-        distance = rollDice(3, true) + 35;
+        distance = rollDice<3, true>(rng) + 35;
         break;
     case 11:
-        distance = rollDice(3, true) + 40;
+        distance = rollDice<3, true>(rng) + 40;
         break;
     case 12:
-        distance = rollDice(3, true) + 45;
+        distance = rollDice<3, true>(rng) + 45;
         break;
     }
 
@@ -538,9 +517,9 @@ static int getPuntDistance(unsigned int roll)
  * Determines the number of yards gained on the punt return. This requires
  * knowing the value of the dice roll used for determining the kick's distance.
  */
-static int getPuntReturn(unsigned int distanceRoll)
+static int getPuntReturn(Random& rng, unsigned int distanceRoll)
 {
-    unsigned int roll = rollDice(1, false);
+    unsigned int roll = rollDice<1>(rng);
     int returnYards;
 
     switch (roll) {
@@ -548,45 +527,45 @@ static int getPuntReturn(unsigned int distanceRoll)
         if (distanceRoll == 2) {
             returnYards = 0;
         } else if (distanceRoll <= 6) {
-            returnYards = rollDice(2, true);
+            returnYards = rollDice<2, true>(rng);
         } else {
-            returnYards = rollDice(3, true);
+            returnYards = rollDice<3, true>(rng);
         }
         break;
     case 2:
         if (distanceRoll == 2) {
             returnYards = 0;
         } else if (distanceRoll <= 5) {
-            returnYards = rollDice(2, true);
+            returnYards = rollDice<2, true>(rng);
         } else {
-            returnYards = rollDice(3, true);
+            returnYards = rollDice<3, true>(rng);
         }
         break;
     case 3:
         if (distanceRoll <= 3) {
             returnYards = 0;
         } else if (distanceRoll <= 8) {
-            returnYards = rollDice(2, true);
+            returnYards = rollDice<2, true>(rng);
         } else {
-            returnYards = rollDice(3, true);
+            returnYards = rollDice<3, true>(rng);
         }
         break;
     case 4:
         if (distanceRoll <= 3) {
             returnYards = 0;
         } else if (distanceRoll <= 10) {
-            returnYards = rollDice(2, true);
+            returnYards = rollDice<2, true>(rng);
         } else {
-            returnYards = rollDice(3, true);
+            returnYards = rollDice<3, true>(rng);
         }
         break;
     case 5:
         if (distanceRoll <= 8) {
             returnYards = 0;
         } else if (distanceRoll <= 10) {
-            returnYards = rollDice(2, true);
+            returnYards = rollDice<2, true>(rng);
         } else if (distanceRoll <= 11) {
-            returnYards = rollDice(3, true);
+            returnYards = rollDice<3, true>(rng);
         } else {
             returnYards = 0;
         }
@@ -642,9 +621,9 @@ static inline unsigned int getMadeKickThresh(unsigned int fieldPos)
  * either a FIELD_GOAL_MADE or a FIELD_GOAL_MISS. There is not yet an option for
  * a blocked attempt. If FIELD_GOAL_MISS, the changePoss flag is set.
  */
-static PlayOutcome* fieldGoalOutcome(Situation* context)
+static PlayOutcome* fieldGoalOutcome(Random& rng, Situation* context)
 {
-    unsigned int roll = rollDice(3);
+    unsigned int roll = rollDice<3>(rng);
     unsigned int threshold = getMadeKickThresh(context->fieldPos);
 
     if (roll >= threshold)
@@ -659,38 +638,43 @@ static PlayOutcome* fieldGoalOutcome(Situation* context)
  * relative to the line of scrimmage at the time of the punt, and the changePoss
  * flag is set to true.
  */
-static PlayOutcome* puntOutcome()
+static PlayOutcome* puntOutcome(Random& rng)
 {
-    unsigned int roll = rollDice(2, false);
-    int distance = getPuntDistance(roll);
+    unsigned int roll = rollDice<2>(rng);
+    int distance = getPuntDistance(rng, roll);
 
-    int returnYards = getPuntReturn(roll);
+    int returnYards = getPuntReturn(rng, roll);
 
     return newOutcome(PUNT_RETURN, distance - returnYards, true, false);
 }
 
 PlayOutcome* Play::runPlay()
 {
+    FB_PERF_SCOPE(PERF_PLAY);
+    FB_TRACE_SCOPE("resolve play", "play");
+    FB_ALLOC_SCOPE(ALLOC_PLAY);
     int breakaway = DEFAULT;
-    int modifier = calcDefModifier(offCall, defCall, breakaway);
-    int result = rollDice(3, false) + modifier;
+    int modifier = calcDefModifier(*dice, *rules, offCall, defCall, breakaway);
+    // Rulesets keep modifiers in range, but the outcome tables only go from
+    // MIN_PLAY_ROLL to MAX_PLAY_ROLL, so make sure.
+    int result = std::clamp(int(rollDice<3>(*dice)) + modifier, MIN_PLAY_ROLL, MAX_PLAY_ROLL);
 
     PlayOutcome* outcome;
     switch (offCall) {
     case SHORT_PASS:
-        outcome = shortPassOutcome(result);
+        outcome = shortPassOutcome(*dice, *rules, result);
         break;
     case LONG_PASS:
-        outcome = longPassOutcome(result);
+        outcome = longPassOutcome(*dice, *rules, result);
         break;
     case RUN:
-        outcome = runOutcome(result);
+        outcome = runOutcome(*dice, *rules, result);
         break;
     case PUNT:
-        outcome = puntOutcome();
+        outcome = puntOutcome(*dice);
         break;
     case FIELD_GOAL:
-        outcome = fieldGoalOutcome(context);
+        outcome = fieldGoalOutcome(*dice, context);
         break;
     }
 
@@ -2,6 +2,8 @@
 #define __PLAYCALL_H
 
 struct Situation;
+struct Ruleset;
+class Random;
 /**
  * These are the possible playcall types, for both offense and defense.
  */
@@ -61,9 +63,14 @@ private:
     PlayCall offCall;
     PlayCall defCall;
     Situation* context;
+    /* All dice for the play are rolled from here. Owned by the Game. */
+    Random* dice;
+    /* Tables for the outcome. Owned by the EngineContext. */
+    const Ruleset* rules;
 
 public:
-    Play(PlayCall offense, PlayCall defense, Situation* sit);
+    Play(PlayCall offense, PlayCall defense, Situation* sit, Random* rng,
+        const Ruleset* ruleset);
     /**
      * Calculates the outcome of a given play based on both teams' playcalls.
      */
@@ -0,0 +1,321 @@
+#include "playlog.h"
+#include "clock.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/* Bits of an index entry holding the number of plays in the game. */
+static const unsigned int COUNT_BITS = 16;
+static const uint64_t COUNT_MASK = (uint64_t(1) << COUNT_BITS) - 1;
+
+/* Plays in each extent of the file a PlayLogWriter hands to a worker (1 MB).
+ * Always room for the longest game the index can hold.
+ */
+static const uint64_t EXTENT_PLAYS = uint64_t(1) << 17;
+static_assert(EXTENT_PLAYS >= COUNT_MASK, "a game must fit in one extent");
+
+void PlayLogger::onGameEvent(GameEvent event, Game* game)
+{
+    if (event == SNAP_EVENT) {
+        Situation* sit = game->getSituation();
+        pending.quarter = sit->clock->getQuarter();
+        pending.ticks = sit->clock->getTicks();
+        pending.down = sit->down;
+        pending.distance = std::clamp(sit->distance, 0, 255);
+        pending.fieldPos = std::clamp(sit->fieldPos, 0, 255);
+        pending.flags = game->isHomeOnOffense() ? LOGGED_HOME_OFFENSE : 0;
+        if (pending.distance != sit->distance || pending.fieldPos != sit->fieldPos)
+            pending.flags |= LOGGED_SATURATED;
+        atSnap = true;
+        return;
+    }
+
+    if (!atSnap)
+        return;
+    atSnap = false;
+
+    const PlayOutcome* outcome = game->getLastOutcome();
+    pending.result = outcome->result;
+    pending.yardsGained = std::clamp(outcome->yardsGained, -128, 127);
+    if (pending.yardsGained != outcome->yardsGained)
+        pending.flags |= LOGGED_SATURATED;
+    if (outcome->touchdown)
+        pending.flags |= LOGGED_TOUCHDOWN;
+    if (outcome->changePoss)
+        pending.flags |= LOGGED_CHANGE_POSS;
+    plays.push_back(pending);
+}
+
+PlayLogWriter::PlayLogWriter(const std::string& path, size_t numGames,
+    unsigned int numWorkers)
+    : segments(std::max(1u, numWorkers))
+    , index(numGames, 0)
+    , numExtents(0)
+    , closed(false)
+    , failed(false)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("could not create play log " + path);
+}
+
+PlayLogWriter::~PlayLogWriter()
+{
+    try {
+        close();
+    } catch (const std::runtime_error&) {
+    }
+}
+
+void PlayLogWriter::fail(const std::string& why)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (error.empty())
+        error = why;
+    failed.store(true, std::memory_order_relaxed);
+}
+
+bool PlayLogWriter::claimExtent(Segment& segment)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    uint64_t first = numExtents * EXTENT_PLAYS;
+    off_t start = sizeof(PlayLogHeader) + first * sizeof(LoggedPlay);
+    off_t end = start + EXTENT_PLAYS * sizeof(LoggedPlay);
+    // The file stays sparse, so only the pages actually written take space.
+    if (ftruncate(fd, end) < 0) {
+        guard.unlock();
+        fail("could not grow play log");
+        return false;
+    }
+
+    // Plays start right after the header, so extents aren't page aligned.
+    // Map from the page the extent starts in; a page shared with the
+    // previous extent is the same page of the file either way.
+    off_t mapStart = start & ~static_cast<off_t>(sysconf(_SC_PAGESIZE) - 1);
+    size_t length = end - mapStart;
+    void* map = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mapStart);
+    if (map == MAP_FAILED) {
+        guard.unlock();
+        fail("could not map play log");
+        return false;
+    }
+
+    maps.emplace_back(map, length);
+    numExtents++;
+    segment.plays = reinterpret_cast<LoggedPlay*>(static_cast<char*>(map) + (start - mapStart));
+    segment.first = first;
+    segment.used = 0;
+    return true;
+}
+
+void PlayLogWriter::add(unsigned int worker, size_t game, const std::vector<LoggedPlay>& plays)
+{
+    if (failed.load(std::memory_order_relaxed))
+        return;
+    if (plays.size() > COUNT_MASK) {
+        fail("too many plays in game " + std::to_string(game) + " to log");
+        return;
+    }
+
+    Segment& segment = segments.at(worker);
+    if ((!segment.plays || segment.used + plays.size() > EXTENT_PLAYS) && !claimExtent(segment))
+        return;
+
+    std::memcpy(segment.plays + segment.used, plays.data(), plays.size() * sizeof(LoggedPlay));
+    index.at(game) = (segment.first + segment.used) << COUNT_BITS | plays.size();
+    segment.used += plays.size();
+}
+
+void PlayLogWriter::truncate(size_t numGames)
+{
+    if (numGames < index.size())
+        index.resize(numGames);
+}
+
+/* pwrite()s all of data, retrying short writes. */
+static bool writeAt(int fd, const void* data, size_t length, off_t offset)
+{
+    const char* p = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t n = pwrite(fd, p, length, offset);
+        if (n <= 0)
+            return false;
+        p += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+void PlayLogWriter::close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (closed)
+        return;
+    closed = true;
+
+    for (const std::pair<void*, size_t>& map : maps)
+        munmap(map.first, map.second);
+    maps.clear();
+
+    // Whoever has the last extent likely hasn't filled it, so end the plays
+    // where they stopped. Unused ends of other extents stay as gaps.
+    uint64_t numPlays = numExtents * EXTENT_PLAYS;
+    for (const Segment& segment : segments) {
+        if (segment.plays && segment.first + EXTENT_PLAYS == numPlays)
+            numPlays = segment.first + segment.used;
+    }
+
+    PlayLogHeader header = {};
+    header.magic = PLAY_LOG_MAGIC;
+    header.version = PLAY_LOG_VERSION;
+    header.recordSize = sizeof(LoggedPlay);
+    header.numGames = index.size();
+    header.indexOffset = sizeof(header) + numPlays * sizeof(LoggedPlay);
+
+    size_t indexLength = index.size() * sizeof(uint64_t);
+    bool ok = writeAt(fd, index.data(), indexLength, header.indexOffset)
+        && ftruncate(fd, header.indexOffset + indexLength) == 0
+        && writeAt(fd, &header, sizeof(header), 0);
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+    if (!error.empty())
+        throw std::runtime_error(error);
+    if (!ok)
+        throw std::runtime_error("could not write play log");
+}
+
+PlayLog::PlayLog(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("could not open play log " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(PlayLogHeader)) {
+        ::close(fd);
+        throw std::runtime_error(path + " is not a play log");
+    }
+
+    length = st.st_size;
+    map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("could not map play log " + path);
+
+    header = static_cast<const PlayLogHeader*>(map);
+    bool ok = header->magic == PLAY_LOG_MAGIC
+        && header->version == PLAY_LOG_VERSION
+        && header->recordSize == sizeof(LoggedPlay)
+        && header->indexOffset >= sizeof(PlayLogHeader)
+        && header->indexOffset % sizeof(uint64_t) == 0
+        && header->indexOffset <= length
+        && header->numGames <= (length - header->indexOffset) / sizeof(uint64_t);
+    if (!ok) {
+        munmap(map, length);
+        throw std::runtime_error(path + " is not a valid play log");
+    }
+
+    const char* base = static_cast<const char*>(map);
+    plays = reinterpret_cast<const LoggedPlay*>(base + sizeof(PlayLogHeader));
+    index = reinterpret_cast<const uint64_t*>(base + header->indexOffset);
+    // reads jump straight to one game, so don't bother reading ahead
+    madvise(map, length, MADV_RANDOM);
+}
+
+PlayLog::~PlayLog()
+{
+    munmap(map, length);
+}
+
+std::span<const LoggedPlay> PlayLog::game(uint64_t game) const
+{
+    if (game >= header->numGames)
+        throw std::out_of_range("no game " + std::to_string(game) + " in the play log");
+
+    uint64_t first = index[game] >> COUNT_BITS;
+    uint64_t count = index[game] & COUNT_MASK;
+    uint64_t numPlays = (header->indexOffset - sizeof(PlayLogHeader)) / sizeof(LoggedPlay);
+    if (first + count > numPlays)
+        throw std::out_of_range("index entry for game " + std::to_string(game) + " is corrupt");
+
+    return std::span<const LoggedPlay>(plays + first, count);
+}
+
+static const char* downName(Down down)
+{
+    switch (down) {
+    case FIRST:
+        return "First down";
+    case SECOND:
+        return "Second down";
+    case THIRD:
+        return "Third down";
+    case FOURTH:
+        return "Fourth down";
+    default:
+        return "";
+    }
+}
+
+static const char* resultName(PlayResult result)
+{
+    switch (result) {
+    case COMPLETED_PASS:
+        return "Pass completed";
+    case INCOMPLETE_PASS:
+        return "Pass incomplete";
+    case FUMBLE:
+        return "Fumble";
+    case INTERCEPTION:
+        return "Interception";
+    case HANDOFF:
+        return "Run";
+    case SACK:
+        return "Sacked";
+    case FIELD_GOAL_MADE:
+        return "Field goal is good!";
+    case FIELD_GOAL_MISS:
+        return "Field goal is missed";
+    case PUNT_RETURN:
+        return "Punt";
+    default:
+        return "";
+    }
+}
+
+void describeSituation(std::ostream& out, Down down, int distance, int fieldPos,
+    unsigned int ticks, unsigned int quarter)
+{
+    out << downName(down) << " and "
+        << (fieldPos + distance >= 100 ? "goal" : std::to_string(distance))
+        << " from the " << fieldPos << " yard line\n"
+        << Clock::ticksToTime(ticks) << " remaining in quarter " << quarter << '\n';
+}
+
+void describeOutcome(std::ostream& out, PlayResult result, int yardsGained,
+    bool touchdown, bool changePoss)
+{
+    if (touchdown)
+        out << "TOUCHDOWN! ";
+    if (changePoss)
+        out << "TURNOVER! ";
+    out << resultName(result) << " for " << yardsGained << " yards\n";
+}
+
+void renderPlays(std::ostream& out, std::span<const LoggedPlay> plays)
+{
+    for (const LoggedPlay& play : plays) {
+        describeSituation(out, static_cast<Down>(play.down), play.distance, play.fieldPos,
+            play.ticks, play.quarter);
+        describeOutcome(out, static_cast<PlayResult>(play.result), play.yardsGained,
+            play.flags & LOGGED_TOUCHDOWN, play.flags & LOGGED_CHANGE_POSS);
+    }
+}
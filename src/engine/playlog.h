@@ -0,0 +1,187 @@
+#ifndef __PLAYLOG_H
+#define __PLAYLOG_H
+
+#include "game.h"
+#include "playcall.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Play by play for whole batches, without formatting any text while the games
+ * run. Each snap is logged as an 8 byte LoggedPlay, and the log file keeps an
+ * index of where each game's plays start, so the play by play for any one game
+ * can be read straight out of a log of millions, and only turned into text
+ * then.
+ *
+ * A log file is a PlayLogHeader, then every game's plays (in whatever order
+ * the games finished, with gaps between them wherever a writer left part of
+ * an extent unused), then the index: one entry per game in the batch, the
+ * offset of its first play (counted in plays) shifted up 16 bits, plus how
+ * many plays it has.
+ */
+
+/* "FBL1" */
+const uint32_t PLAY_LOG_MAGIC = 0x314C4246;
+const uint32_t PLAY_LOG_VERSION = 1;
+
+/* Bits in LoggedPlay::flags. */
+enum LoggedPlayFlag {
+    LOGGED_TOUCHDOWN = 1 << 0,
+    LOGGED_CHANGE_POSS = 1 << 1,
+    LOGGED_HOME_OFFENSE = 1 << 2,
+    /* some field didn't fit, and was stored as the nearest value that did */
+    LOGGED_SATURATED = 1 << 3
+};
+
+/* One play from scrimmage: the situation at the snap, and how it went. */
+struct LoggedPlay {
+    uint8_t quarter;
+    /* clock ticks left in the quarter */
+    uint8_t ticks;
+    uint8_t down;
+    /* yards to go, capped at 255 */
+    uint8_t distance;
+    uint8_t fieldPos;
+    /* capped to [-128, 127] */
+    int8_t yardsGained;
+    uint8_t result;
+    uint8_t flags;
+};
+
+static_assert(sizeof(LoggedPlay) == 8, "LoggedPlay should be 8 bytes");
+
+struct PlayLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t numGames;
+    uint64_t indexOffset;
+};
+
+/**
+ * Logs every play from scrimmage in a game into a vector, which is cleared
+ * first. Attach it through an ObservedGame.
+ */
+class PlayLogger {
+private:
+    std::vector<LoggedPlay>& plays;
+    LoggedPlay pending;
+    bool atSnap;
+
+public:
+    static constexpr unsigned int events = SNAP_EVENT | PLAY_EVENT;
+
+    explicit PlayLogger(std::vector<LoggedPlay>& plays)
+        : plays(plays)
+        , atSnap(false)
+    {
+        plays.clear();
+    }
+
+    void onGameEvent(GameEvent event, Game* game);
+};
+
+/**
+ * Writes a play log for a batch of numGames games, played by up to numWorkers
+ * workers at once, in any order.
+ *
+ * Each worker writes into an extent of the file of its own, mapped into
+ * memory, and only takes a lock to claim a new extent once its current one is
+ * full. The kernel writes the pages out whenever it likes, and the index is
+ * only written at the end.
+ */
+class PlayLogWriter {
+private:
+    /* The extent a worker is currently filling. */
+    struct alignas(64) Segment {
+        LoggedPlay* plays = nullptr;
+        /* where plays[0] is in the log, counted in plays */
+        uint64_t first = 0;
+        size_t used = 0;
+    };
+
+    int fd;
+    std::vector<Segment> segments;
+    std::vector<uint64_t> index;
+    /* guards everything below */
+    std::mutex lock;
+    std::vector<std::pair<void*, size_t>> maps;
+    uint64_t numExtents;
+    bool closed;
+    /* what went wrong in add(), if anything, for close() to throw */
+    std::string error;
+    std::atomic<bool> failed;
+
+    /* Notes the first thing that went wrong, and stops logging. */
+    void fail(const std::string& why);
+    /* Grows the file by an extent and hands it to segment. Returns false,
+     * having called fail(), if it couldn't. */
+    bool claimExtent(Segment& segment);
+
+public:
+    /* Throws std::runtime_error if the file can't be created. */
+    PlayLogWriter(const std::string& path, size_t numGames, unsigned int numWorkers);
+    ~PlayLogWriter();
+
+    PlayLogWriter(const PlayLogWriter&) = delete;
+    PlayLogWriter& operator=(const PlayLogWriter&) = delete;
+
+    /* Logs the plays of game number game in the batch. A worker must only
+     * ever be used from one thread at a time. Never throws, since it's called
+     * from the batch's workers: if the game can't be logged, it and every
+     * game after it are left out, and close() throws to say why.
+     */
+    void add(unsigned int worker, size_t game, const std::vector<LoggedPlay>& plays);
+    /* Drops the games from numGames on, e.g. ones a batch stopped before
+     * playing. Only call it once the workers are done. */
+    void truncate(size_t numGames);
+    /* Writes the index and header. Throws std::runtime_error if anything
+     * along the way couldn't be written, add() included. */
+    void close();
+};
+
+/**
+ * A play log mapped into memory.
+ */
+class PlayLog {
+private:
+    void* map;
+    size_t length;
+    const PlayLogHeader* header;
+    const LoggedPlay* plays;
+    const uint64_t* index;
+
+public:
+    /* Throws std::runtime_error if the file can't be read or isn't a play
+     * log. */
+    explicit PlayLog(const std::string& path);
+    ~PlayLog();
+
+    PlayLog(const PlayLog&) = delete;
+    PlayLog& operator=(const PlayLog&) = delete;
+
+    uint64_t numGames() const { return header->numGames; }
+    /* The plays of game number game in the batch. Throws std::out_of_range
+     * if there is no such game. */
+    std::span<const LoggedPlay> game(uint64_t game) const;
+};
+
+/* The text the driver's live observers print: the scoreboard before a snap,
+ * and the commentary after it. */
+void describeSituation(std::ostream& out, Down down, int distance, int fieldPos,
+    unsigned int ticks, unsigned int quarter);
+void describeOutcome(std::ostream& out, PlayResult result, int yardsGained,
+    bool touchdown, bool changePoss);
+
+/* Writes logged plays out as play by play text. */
+void renderPlays(std::ostream& out, std::span<const LoggedPlay> plays);
+
+#endif
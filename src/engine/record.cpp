@@ -0,0 +1,284 @@
+#include "record.h"
+#include <stdexcept>
+
+/* Magic number at the start of every serialized record: "FBG3". Records from
+ * before they kept the ruleset's digest started with "FBG2", and ones from
+ * before teams had their own models with "FBGR".
+ */
+static const uint32_t RECORD_MAGIC = 0x33474246;
+
+GameRecord recordGame(const EngineContext& context, uint64_t seed,
+    const TeamConfig& home, const TeamConfig& away, unsigned int interval)
+{
+    GameRecord record;
+    record.engineVersion = ENGINE_VERSION;
+    record.rulesDigest = rulesetDigest(context.getRuleset());
+    record.seed = seed;
+    record.home = home;
+    record.away = away;
+    record.checkpointInterval = interval > 0 ? interval : 1;
+
+    Team* homeTeam = makeTeam(context, home);
+    Team* awayTeam = makeTeam(context, away);
+    Game* game = new Game(&context, homeTeam, awayTeam, seed);
+
+    while (!game->isOver()) {
+        if (game->getStepCount() % record.checkpointInterval == 0)
+            record.checkpoints.push_back(game->checkpoint());
+        game->step();
+    }
+
+    record.numSteps = game->getStepCount();
+    record.homeScore = game->getHomeScore();
+    record.awayScore = game->getAwayScore();
+
+    delete game;
+    delete homeTeam;
+    delete awayTeam;
+
+    return record;
+}
+
+template <typename T>
+static void writeValue(std::ostream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::istream& in, T& value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+static void writeString(std::ostream& out, const std::string& str)
+{
+    writeValue(out, static_cast<uint16_t>(str.size()));
+    out.write(str.data(), str.size());
+}
+
+static bool readString(std::istream& in, std::string& str)
+{
+    uint16_t size;
+    if (!readValue(in, size))
+        return false;
+
+    str.resize(size);
+    return static_cast<bool>(in.read(str.data(), size));
+}
+
+/* Stats and checkpoints are written a field at a time, so that no padding
+ * between them ends up in the file. */
+static void writeStats(std::ostream& out, const TeamStats& stats)
+{
+    writeValue(out, static_cast<int32_t>(stats.passingYards));
+    writeValue(out, static_cast<int32_t>(stats.rushingYards));
+    writeValue(out, static_cast<uint32_t>(stats.passingPlays));
+    writeValue(out, static_cast<uint32_t>(stats.completions));
+    writeValue(out, static_cast<uint32_t>(stats.runningPlays));
+    writeValue(out, static_cast<uint32_t>(stats.sacks));
+    writeValue(out, static_cast<uint32_t>(stats.interceptions));
+    writeValue(out, static_cast<uint32_t>(stats.fumbles));
+}
+
+static bool readStats(std::istream& in, TeamStats& stats)
+{
+    int32_t passingYards, rushingYards;
+    uint32_t passingPlays, completions, runningPlays, sacks, interceptions, fumbles;
+
+    bool ok = readValue(in, passingYards)
+        && readValue(in, rushingYards)
+        && readValue(in, passingPlays)
+        && readValue(in, completions)
+        && readValue(in, runningPlays)
+        && readValue(in, sacks)
+        && readValue(in, interceptions)
+        && readValue(in, fumbles);
+    if (!ok)
+        return false;
+
+    stats.passingYards = passingYards;
+    stats.rushingYards = rushingYards;
+    stats.passingPlays = passingPlays;
+    stats.completions = completions;
+    stats.runningPlays = runningPlays;
+    stats.sacks = sacks;
+    stats.interceptions = interceptions;
+    stats.fumbles = fumbles;
+    return true;
+}
+
+static void writeCheckpoint(std::ostream& out, const GameCheckpoint& cp)
+{
+    writeValue(out, static_cast<uint32_t>(cp.step));
+    writeValue(out, cp.rngState.counter);
+    writeValue(out, cp.rngState.diceCounter);
+    writeValue(out, cp.rngState.diceUsed);
+    writeValue(out, static_cast<uint8_t>(cp.state));
+    writeValue(out, static_cast<uint8_t>(cp.homeOnOffense));
+    writeValue(out, static_cast<uint8_t>(cp.down));
+    writeValue(out, static_cast<int32_t>(cp.distance));
+    writeValue(out, static_cast<int32_t>(cp.fieldPos));
+    writeValue(out, static_cast<uint32_t>(cp.quarter));
+    writeValue(out, static_cast<int32_t>(cp.ticks));
+    writeValue(out, static_cast<uint32_t>(cp.homeScore));
+    writeValue(out, static_cast<uint32_t>(cp.awayScore));
+    writeValue(out, static_cast<uint32_t>(cp.homeTimeouts));
+    writeValue(out, static_cast<uint32_t>(cp.awayTimeouts));
+    writeStats(out, cp.homeStats);
+    writeStats(out, cp.awayStats);
+}
+
+static bool readCheckpoint(std::istream& in, GameCheckpoint& cp)
+{
+    uint32_t step, quarter, homeScore, awayScore, homeTimeouts, awayTimeouts;
+    uint8_t state, homeOnOffense, down;
+    int32_t distance, fieldPos, ticks;
+
+    bool ok = readValue(in, step)
+        && readValue(in, cp.rngState.counter)
+        && readValue(in, cp.rngState.diceCounter)
+        && readValue(in, cp.rngState.diceUsed)
+        && readValue(in, state)
+        && readValue(in, homeOnOffense)
+        && readValue(in, down)
+        && readValue(in, distance)
+        && readValue(in, fieldPos)
+        && readValue(in, quarter)
+        && readValue(in, ticks)
+        && readValue(in, homeScore)
+        && readValue(in, awayScore)
+        && readValue(in, homeTimeouts)
+        && readValue(in, awayTimeouts)
+        && readStats(in, cp.homeStats)
+        && readStats(in, cp.awayStats);
+    if (!ok || state >= NUM_GAME_STATES || cp.rngState.diceUsed > 2)
+        return false;
+
+    cp.step = step;
+    cp.state = static_cast<GameStateId>(state);
+    cp.homeOnOffense = homeOnOffense != 0;
+    cp.down = static_cast<Down>(down);
+    cp.distance = distance;
+    cp.fieldPos = fieldPos;
+    cp.quarter = quarter;
+    cp.ticks = ticks;
+    cp.homeScore = homeScore;
+    cp.awayScore = awayScore;
+    cp.homeTimeouts = homeTimeouts;
+    cp.awayTimeouts = awayTimeouts;
+    return true;
+}
+
+void writeRecord(std::ostream& out, const GameRecord& record)
+{
+    writeValue(out, RECORD_MAGIC);
+    writeValue(out, record.engineVersion);
+    writeValue(out, record.rulesDigest);
+    writeValue(out, record.seed);
+    writeValue(out, static_cast<uint8_t>(record.home.type));
+    writeValue(out, static_cast<uint8_t>(record.away.type));
+    writeString(out, record.home.model);
+    writeString(out, record.away.model);
+    writeValue(out, record.checkpointInterval);
+    writeValue(out, record.numSteps);
+    writeValue(out, record.homeScore);
+    writeValue(out, record.awayScore);
+    writeValue(out, static_cast<uint32_t>(record.checkpoints.size()));
+    for (const GameCheckpoint& cp : record.checkpoints)
+        writeCheckpoint(out, cp);
+}
+
+bool readRecord(std::istream& in, GameRecord& record)
+{
+    uint32_t magic;
+    uint8_t homeType, awayType;
+    uint32_t numCheckpoints;
+
+    if (!readValue(in, magic) || magic != RECORD_MAGIC)
+        return false;
+
+    bool ok = readValue(in, record.engineVersion)
+        && readValue(in, record.rulesDigest)
+        && readValue(in, record.seed)
+        && readValue(in, homeType)
+        && readValue(in, awayType)
+        && readString(in, record.home.model)
+        && readString(in, record.away.model)
+        && readValue(in, record.checkpointInterval)
+        && readValue(in, record.numSteps)
+        && readValue(in, record.homeScore)
+        && readValue(in, record.awayScore)
+        && readValue(in, numCheckpoints);
+    if (!ok)
+        return false;
+
+    record.home.type = static_cast<TeamType>(homeType);
+    record.away.type = static_cast<TeamType>(awayType);
+    // The count could be anything in a damaged file, so only keep as many
+    // checkpoints as there really are rather than reserving for all of them.
+    record.checkpoints.clear();
+    for (uint32_t i = 0; i < numCheckpoints; i++) {
+        GameCheckpoint cp;
+        if (!readCheckpoint(in, cp))
+            return false;
+        record.checkpoints.push_back(cp);
+    }
+
+    return true;
+}
+
+GameReplay::GameReplay(const EngineContext& context, const GameRecord& record)
+    : context(context)
+    , record(record)
+{
+    if (record.engineVersion != ENGINE_VERSION)
+        throw std::runtime_error("[GameReplay] record was made by a different engine version");
+    if (record.rulesDigest != rulesetDigest(context.getRuleset()))
+        throw std::runtime_error("[GameReplay] record was played by a different ruleset");
+
+    home = makeTeam(context, record.home);
+    away = makeTeam(context, record.away);
+    game = new Game(&context, home, away, record.seed);
+}
+
+GameReplay::~GameReplay()
+{
+    delete game;
+    delete home;
+    delete away;
+}
+
+Game* GameReplay::seek(unsigned int step)
+{
+    // Find the last checkpoint at or before the step we want. Only bother
+    // restoring it if it gets us closer than where we already are.
+    const GameCheckpoint* best = nullptr;
+    for (const GameCheckpoint& cp : record.checkpoints) {
+        if (cp.step > step)
+            break;
+        best = &cp;
+    }
+
+    unsigned int current = game->getStepCount();
+    if (best && (current > step || best->step > current))
+        game->restore(*best);
+
+    while (game->getStepCount() < step && !game->isOver())
+        game->step();
+
+    return game;
+}
+
+Game* GameReplay::finish()
+{
+    while (!game->isOver())
+        game->step();
+
+    return game;
+}
+
+Game* GameReplay::getGame() const
+{
+    return game;
+}
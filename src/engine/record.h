@@ -0,0 +1,114 @@
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include "game.h"
+#include "gamestates.h"
+#include "team.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/**
+ * Everything needed to record a game and play it back later.
+ *
+ * A game is fully determined by its seed, the two teams' configs, the ruleset
+ * and the version of the engine that played it. On top of that we keep a checkpoint
+ * of the full game state every so often, so that getting to a play in the
+ * middle of a game only means simulating from the nearest checkpoint rather
+ * than from the opening kickoff.
+ *
+ * Only games between teams whose playcalls depend on nothing but the game's
+ * Random (e.g. AITeam) can be replayed. A UserTeam will just ask for its plays
+ * all over again.
+ */
+
+/* Bump this whenever a change to the engine means the same seed no longer
+ * plays out the same game. Records from other versions can't be replayed.
+ */
+const uint32_t ENGINE_VERSION = 4;
+
+/* A snapshot of a game in between two steps of the state machine. */
+struct GameCheckpoint {
+    /* Number of steps the game had taken when this was saved. */
+    unsigned int step;
+    Random::State rngState;
+    GameStateId state;
+    bool homeOnOffense;
+    Down down;
+    int distance;
+    int fieldPos;
+    unsigned int quarter;
+    int ticks;
+    unsigned int homeScore;
+    unsigned int awayScore;
+    unsigned int homeTimeouts;
+    unsigned int awayTimeouts;
+    TeamStats homeStats;
+    TeamStats awayStats;
+};
+
+/* A recorded game. Checkpoints are sorted by step, and the first one is always
+ * taken before the opening kickoff.
+ */
+struct GameRecord {
+    uint32_t engineVersion;
+    /* rulesetDigest() of the rules the game was played by */
+    uint64_t rulesDigest;
+    uint64_t seed;
+    TeamConfig home;
+    TeamConfig away;
+    unsigned int checkpointInterval;
+    /* Total number of steps in the game, and the final score. Handy for
+     * checking that a replay matches the original.
+     */
+    unsigned int numSteps;
+    unsigned int homeScore;
+    unsigned int awayScore;
+    std::vector<GameCheckpoint> checkpoints;
+};
+
+/* Plays a whole game, saving a checkpoint every interval steps. */
+GameRecord recordGame(const EngineContext& context, uint64_t seed,
+    const TeamConfig& home, const TeamConfig& away, unsigned int interval);
+
+/* Writes/reads a record in a compact binary format. readRecord returns false
+ * if the stream doesn't contain a valid record.
+ */
+void writeRecord(std::ostream& out, const GameRecord& record);
+bool readRecord(std::istream& in, GameRecord& record);
+
+/**
+ * Rebuilds a recorded game, and lets you jump to any step within it.
+ *
+ * The teams and game are owned by the GameReplay, so the Game returned by
+ * seek() is only valid as long as the replay is.
+ */
+class GameReplay {
+private:
+    const EngineContext& context;
+    const GameRecord& record;
+    Team* home;
+    Team* away;
+    Game* game;
+
+public:
+    /* The context and record must outlive the replay, and the context must
+     * have the same model the game was recorded with. Throws
+     * std::runtime_error if the record was made by a different version of the
+     * engine, or the context has a different ruleset.
+     */
+    GameReplay(const EngineContext& context, const GameRecord& record);
+    ~GameReplay();
+
+    /* Puts the game in the state it was in right before the given step was
+     * run, starting from the closest checkpoint. Seeking past the end of the
+     * game leaves it in the Final state.
+     */
+    Game* seek(unsigned int step);
+    /* Plays the rest of the game from wherever it currently is. */
+    Game* finish();
+    Game* getGame() const;
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "results.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+/* Packs one team's stats, clamping any that don't fit their field. */
+static uint64_t packStats(const TeamStats& stats, bool& saturated)
+{
+    const int64_t values[NUM_PACKED_STATS] = {
+        stats.passingYards,
+        stats.rushingYards,
+        stats.passingPlays,
+        stats.completions,
+        stats.runningPlays,
+        stats.sacks,
+        stats.interceptions,
+        stats.fumbles
+    };
+
+    uint64_t packed = 0;
+    for (unsigned int s = 0; s < NUM_PACKED_STATS; s++) {
+        unsigned int width = PACKED_STAT_BITS[s];
+        bool isSigned = s <= PACKED_RUSHING_YARDS;
+        int64_t lo = isSigned ? -(int64_t(1) << (width - 1)) : 0;
+        int64_t hi = isSigned ? (int64_t(1) << (width - 1)) - 1 : (int64_t(1) << width) - 1;
+
+        int64_t value = values[s];
+        if (value < lo || value > hi) {
+            value = value < lo ? lo : hi;
+            saturated = true;
+        }
+        packed |= (static_cast<uint64_t>(value) & ((uint64_t(1) << width) - 1)) << packedStatShift(s);
+    }
+
+    return packed;
+}
+
+static uint16_t clamp16(unsigned int value, bool& saturated)
+{
+    if (value > UINT16_MAX) {
+        saturated = true;
+        return UINT16_MAX;
+    }
+    return value;
+}
+
+PackedResult packResult(const GameResult& result)
+{
+    bool saturated = false;
+    PackedResult packed;
+    packed.seed = result.seed;
+    packed.homeScore = clamp16(result.homeScore, saturated);
+    packed.awayScore = clamp16(result.awayScore, saturated);
+    packed.numPlays = clamp16(result.numPlays, saturated);
+    packed.homeStats = packStats(result.homeStats, saturated);
+    packed.awayStats = packStats(result.awayStats, saturated);
+
+    packed.flags = 0;
+    if (result.homeScore > result.awayScore)
+        packed.flags |= HOME_WIN;
+    else if (result.awayScore > result.homeScore)
+        packed.flags |= AWAY_WIN;
+    if (result.homeScore == 0 || result.awayScore == 0)
+        packed.flags |= SHUTOUT;
+    if (saturated)
+        packed.flags |= SATURATED;
+
+    return packed;
+}
+
+static TeamStats unpackStats(uint64_t packed)
+{
+    TeamStats stats;
+    stats.passingYards = packedStat(packed, PACKED_PASSING_YARDS);
+    stats.rushingYards = packedStat(packed, PACKED_RUSHING_YARDS);
+    stats.passingPlays = packedStat(packed, PACKED_PASSING_PLAYS);
+    stats.completions = packedStat(packed, PACKED_COMPLETIONS);
+    stats.runningPlays = packedStat(packed, PACKED_RUNNING_PLAYS);
+    stats.sacks = packedStat(packed, PACKED_SACKS);
+    stats.interceptions = packedStat(packed, PACKED_INTERCEPTIONS);
+    stats.fumbles = packedStat(packed, PACKED_FUMBLES);
+    return stats;
+}
+
+GameResult unpackResult(const PackedResult& result)
+{
+    GameResult unpacked;
+    unpacked.seed = result.seed;
+    unpacked.homeScore = result.homeScore;
+    unpacked.awayScore = result.awayScore;
+    unpacked.numPlays = result.numPlays;
+    unpacked.homeStats = unpackStats(result.homeStats);
+    unpacked.awayStats = unpackStats(result.awayStats);
+    return unpacked;
+}
+
+static PackedResultsHeader makeHeader(uint64_t count)
+{
+    PackedResultsHeader header = {};
+    header.magic = RESULTS_MAGIC;
+    header.version = RESULTS_VERSION;
+    header.recordSize = sizeof(PackedResult);
+    header.count = count;
+    return header;
+}
+
+PackedResults::PackedResults(size_t capacity)
+    : map(nullptr)
+    , mapLength(capacity * sizeof(PackedResult))
+    , records(nullptr)
+    , maxRecords(capacity)
+    , count(0)
+    , fd(-1)
+{
+    if (mapLength == 0)
+        return;
+
+    // Reserve the address space now, but let the kernel hand out pages only
+    // as they're written.
+    map = mmap(nullptr, mapLength, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+        throw std::bad_alloc();
+    records = static_cast<PackedResult*>(map);
+}
+
+PackedResults::PackedResults(const std::string& path, size_t capacity)
+    : mapLength(sizeof(PackedResultsHeader) + capacity * sizeof(PackedResult))
+    , maxRecords(capacity)
+    , count(0)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("could not create results file " + path);
+
+    // The file starts out sparse, so this costs no disk space yet.
+    if (ftruncate(fd, mapLength) < 0) {
+        ::close(fd);
+        throw std::runtime_error("could not size results file " + path);
+    }
+
+    map = mmap(nullptr, mapLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("could not map results file " + path);
+    }
+
+    *static_cast<PackedResultsHeader*>(map) = makeHeader(0);
+    records = reinterpret_cast<PackedResult*>(static_cast<char*>(map) + sizeof(PackedResultsHeader));
+}
+
+PackedResults::PackedResults(const std::string& path)
+    : fd(-1)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        throw std::runtime_error("could not open results file " + path);
+
+    struct stat st;
+    if (fstat(file, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(PackedResultsHeader)) {
+        ::close(file);
+        throw std::runtime_error(path + " is not a results file");
+    }
+
+    mapLength = st.st_size;
+    map = mmap(nullptr, mapLength, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("could not map results file " + path);
+
+    const PackedResultsHeader* header = static_cast<const PackedResultsHeader*>(map);
+    bool ok = header->magic == RESULTS_MAGIC
+        && header->version == RESULTS_VERSION
+        && header->recordSize == sizeof(PackedResult)
+        && header->count <= (mapLength - sizeof(PackedResultsHeader)) / sizeof(PackedResult);
+    if (!ok) {
+        munmap(map, mapLength);
+        throw std::runtime_error(path + " is not a valid results file");
+    }
+
+    records = reinterpret_cast<PackedResult*>(static_cast<char*>(map) + sizeof(PackedResultsHeader));
+    maxRecords = header->count;
+    count = header->count;
+    madvise(map, mapLength, MADV_SEQUENTIAL);
+}
+
+PackedResults::~PackedResults()
+{
+    if (fd >= 0) {
+        try {
+            close();
+        } catch (const std::runtime_error&) {
+        }
+    } else if (map) {
+        munmap(map, mapLength);
+    }
+}
+
+void PackedResults::resize(size_t n)
+{
+    if (n > maxRecords)
+        throw std::length_error("more results than the store has room for");
+    count = n;
+}
+
+size_t PackedResults::append(const PackedResult* results, size_t n)
+{
+    size_t start = count.load(std::memory_order_relaxed);
+    do {
+        if (n > maxRecords - start)
+            throw std::length_error("more results than the store has room for");
+    } while (!count.compare_exchange_weak(start, start + n, std::memory_order_relaxed));
+
+    std::memcpy(records + start, results, n * sizeof(PackedResult));
+    return start;
+}
+
+void PackedResults::close()
+{
+    if (fd < 0)
+        return;
+
+    size_t n = size();
+    static_cast<PackedResultsHeader*>(map)->count = n;
+    munmap(map, mapLength);
+    map = nullptr;
+    records = nullptr;
+
+    bool ok = ftruncate(fd, sizeof(PackedResultsHeader) + n * sizeof(PackedResult)) == 0;
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+    if (!ok)
+        throw std::runtime_error("could not finish writing results file");
+}
+
+void writeResults(std::ostream& out, const PackedResults& results)
+{
+    PackedResultsHeader header = makeHeader(results.size());
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(results.data()), results.size() * sizeof(PackedResult));
+}
@@ -0,0 +1,218 @@
+#ifndef __RESULTS_H
+#define __RESULTS_H
+
+#include "batch.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Game results packed into 32 bytes each, for batches too big to keep a
+ * GameResult (88 bytes) per game, and stores to keep them in: either plain
+ * memory or a file mapped into memory, so a batch's results can go straight
+ * to disk without ever all being in RAM at once.
+ *
+ * A file of results is a PackedResultsHeader followed by the records back to
+ * back.
+ */
+
+/* "FBR1" */
+const uint32_t RESULTS_MAGIC = 0x31524246;
+const uint32_t RESULTS_VERSION = 1;
+
+/* Bits in PackedResult::flags. A game neither team won was a tie. */
+enum ResultFlag {
+    HOME_WIN = 1 << 0,
+    AWAY_WIN = 1 << 1,
+    /* at least one team didn't score */
+    SHUTOUT = 1 << 2,
+    /* some count didn't fit in its field, and was stored as the nearest
+     * value that did */
+    SATURATED = 1 << 3
+};
+
+/* The TeamStats counters, in the order they are packed from the low bit up. */
+enum PackedStat {
+    PACKED_PASSING_YARDS,
+    PACKED_RUSHING_YARDS,
+    PACKED_PASSING_PLAYS,
+    PACKED_COMPLETIONS,
+    PACKED_RUNNING_PLAYS,
+    PACKED_SACKS,
+    PACKED_INTERCEPTIONS,
+    PACKED_FUMBLES,
+    NUM_PACKED_STATS
+};
+
+/* Width in bits of each counter. Yards are signed, the rest aren't. */
+constexpr unsigned int PACKED_STAT_BITS[NUM_PACKED_STATS] = { 12, 12, 8, 8, 8, 6, 5, 5 };
+
+constexpr unsigned int packedStatShift(unsigned int stat)
+{
+    return stat == 0 ? 0 : packedStatShift(stat - 1) + PACKED_STAT_BITS[stat - 1];
+}
+
+static_assert(packedStatShift(NUM_PACKED_STATS) <= 64, "TeamStats must pack into 64 bits");
+
+struct PackedResult {
+    uint64_t seed;
+    uint16_t homeScore;
+    uint16_t awayScore;
+    uint16_t numPlays;
+    uint16_t flags;
+    uint64_t homeStats;
+    uint64_t awayStats;
+};
+
+static_assert(sizeof(PackedResult) == 32, "PackedResult should be 32 bytes");
+
+/* Reads one counter out of a packed TeamStats. */
+inline int packedStat(uint64_t stats, PackedStat stat)
+{
+    unsigned int width = PACKED_STAT_BITS[stat];
+    unsigned int shift = packedStatShift(stat);
+    if (stat <= PACKED_RUSHING_YARDS)
+        return static_cast<int64_t>(stats << (64 - shift - width)) >> (64 - width);
+    return (stats >> shift) & ((uint64_t(1) << width) - 1);
+}
+
+PackedResult packResult(const GameResult& result);
+GameResult unpackResult(const PackedResult& result);
+
+/* Sums over a set of results. */
+struct ResultTotals {
+    uint64_t games = 0;
+    uint64_t plays = 0;
+    uint64_t homeScore = 0;
+    uint64_t awayScore = 0;
+    uint64_t homeWins = 0;
+    uint64_t awayWins = 0;
+    int64_t home[NUM_PACKED_STATS] = {};
+    int64_t away[NUM_PACKED_STATS] = {};
+
+    void add(const PackedResult& result)
+    {
+        games++;
+        plays += result.numPlays;
+        homeScore += result.homeScore;
+        awayScore += result.awayScore;
+        homeWins += (result.flags & HOME_WIN) != 0;
+        awayWins += (result.flags & AWAY_WIN) != 0;
+        for (unsigned int s = 0; s < NUM_PACKED_STATS; s++) {
+            home[s] += packedStat(result.homeStats, static_cast<PackedStat>(s));
+            away[s] += packedStat(result.awayStats, static_cast<PackedStat>(s));
+        }
+    }
+};
+
+/* Totals over the results that pred returns true for. */
+template <class Pred>
+ResultTotals sumResults(const PackedResult* results, size_t n, Pred pred)
+{
+    ResultTotals totals;
+    for (size_t i = 0; i < n; i++) {
+        if (pred(results[i]))
+            totals.add(results[i]);
+    }
+    return totals;
+}
+
+template <class Pred>
+size_t countResults(const PackedResult* results, size_t n, Pred pred)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += pred(results[i]) ? 1 : 0;
+    return count;
+}
+
+/* Indexes of the results pred returns true for. */
+template <class Pred>
+std::vector<size_t> filterResults(const PackedResult* results, size_t n, Pred pred)
+{
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < n; i++) {
+        if (pred(results[i]))
+            matches.push_back(i);
+    }
+    return matches;
+}
+
+struct PackedResultsHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t reserved2;
+};
+
+/**
+ * A fixed capacity array of packed results, in memory or mapped from a file.
+ * Either way the space is only reserved up front, and pages are only really
+ * allocated as results are written to them.
+ *
+ * Results can be added two ways: workers that know each game's index in the
+ * batch can resize() the store once and write straight into it, and workers
+ * that don't care about order can append() blocks of them at a time. Writing
+ * after a resize(), or appending, is safe from many threads at once, but
+ * don't mix the two.
+ */
+class PackedResults {
+private:
+    void* map;
+    size_t mapLength;
+    PackedResult* records;
+    size_t maxRecords;
+    std::atomic<size_t> count;
+    /* file descriptor of a store being written to a file, else -1 */
+    int fd;
+
+public:
+    /* Room for capacity results in memory. */
+    explicit PackedResults(size_t capacity);
+    /* Room for capacity results in a new file at path, which is left holding
+     * however many there are once the store is closed. Throws
+     * std::runtime_error if the file can't be created.
+     */
+    PackedResults(const std::string& path, size_t capacity);
+    /* Maps an existing results file. The mapping is private, so changes to
+     * the results aren't written back. Throws std::runtime_error if the file
+     * can't be read or isn't a results file.
+     */
+    explicit PackedResults(const std::string& path);
+    ~PackedResults();
+
+    PackedResults(const PackedResults&) = delete;
+    PackedResults& operator=(const PackedResults&) = delete;
+
+    /* Sets the number of results, which must be no more than the capacity.
+     * Slots that have never been written read as zeros.
+     */
+    void resize(size_t n);
+    /* Copies n results onto the end of the store and returns the index of the
+     * first. Throws std::length_error if they don't fit.
+     */
+    size_t append(const PackedResult* results, size_t n);
+
+    /* Writes the count into the file's header and truncates it to the
+     * results actually stored, throwing std::runtime_error if that fails. The
+     * destructor does this too, but can't report a failure.
+     */
+    void close();
+
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+    size_t capacity() const { return maxRecords; }
+    PackedResult* data() { return records; }
+    const PackedResult* data() const { return records; }
+    PackedResult& operator[](size_t i) { return records[i]; }
+    const PackedResult& operator[](size_t i) const { return records[i]; }
+};
+
+/* Writes results in the file format, e.g. to a pipe that can't be mapped. */
+void writeResults(std::ostream& out, const PackedResults& results);
+
+#endif
@@ -0,0 +1,120 @@
+#include "ruleset.h"
+#include "utils.h"
+
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+static const char* const MOD_CALL_NAMES[NUM_MOD_CALLS] = { "run", "short_pass", "long_pass" };
+
+std::shared_ptr<const Ruleset> defaultRuleset()
+{
+    static const std::shared_ptr<const Ruleset> rules = std::make_shared<const Ruleset>(DEFAULT_RULESET);
+    return rules;
+}
+
+static bool readMods(std::istream& in, int* values, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        if (!(in >> values[i]) || values[i] < MIN_DEF_MOD || values[i] > MAX_DEF_MOD)
+            return false;
+    }
+    return true;
+}
+
+static bool readGains(std::istream& in, Gain* gains, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        if (!(in >> gains[i].base >> gains[i].dice) || gains[i].dice < 0
+            || gains[i].dice > MAX_GAIN_DICE)
+            return false;
+    }
+    return true;
+}
+
+Ruleset loadRuleset(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("could not open ruleset " + path);
+
+    // Drop the comments, then treat the rest as one stream of words.
+    std::stringstream in;
+    std::string line;
+    while (std::getline(file, line))
+        in << line.substr(0, line.find('#')) << '\n';
+
+    Ruleset rules = DEFAULT_RULESET;
+    std::string name;
+    while (in >> name) {
+        bool ok;
+        if (name == "defensive_mods")
+            ok = readMods(in, &rules.defensiveMods[0][0][0], NUM_MOD_CALLS * NUM_MOD_CALLS * NUM_MOD_ROLLS);
+        else if (name == "short_pass")
+            ok = readGains(in, rules.shortPass, SHORT_PASS_GAINS);
+        else if (name == "long_pass")
+            ok = readGains(in, rules.longPass, LONG_PASS_GAINS);
+        else if (name == "run")
+            ok = readGains(in, rules.run, RUN_GAINS);
+        else
+            throw std::runtime_error(path + ": unknown table " + name);
+
+        if (!ok)
+            throw std::runtime_error(path + ": table " + name + " is incomplete or out of range");
+    }
+
+    return rules;
+}
+
+static void writeGains(std::ostream& out, const char* name, const Gain* gains,
+    unsigned int count, unsigned int firstRoll)
+{
+    out << "# " << name << ": base yards and dice for rolls " << firstRoll << " to "
+        << firstRoll + count - 1 << '\n'
+        << name;
+    for (unsigned int i = 0; i < count; i++)
+        out << "  " << gains[i].base << ' ' << gains[i].dice;
+    out << '\n';
+}
+
+void writeRuleset(std::ostream& out, const Ruleset& rules)
+{
+    out << "# defensive_mods: a row of modifiers for 2d6 rolls of 2 to 12 for\n"
+        << "# each offensive call, then each defensive call\n"
+        << "defensive_mods\n";
+    for (unsigned int o = 0; o < NUM_MOD_CALLS; o++) {
+        for (unsigned int d = 0; d < NUM_MOD_CALLS; d++) {
+            for (unsigned int r = 0; r < NUM_MOD_ROLLS; r++)
+                out << (r > 0 ? " " : "    ") << rules.defensiveMods[o][d][r];
+            out << "  # " << MOD_CALL_NAMES[o] << " vs " << MOD_CALL_NAMES[d] << '\n';
+        }
+    }
+
+    writeGains(out, "short_pass", rules.shortPass, SHORT_PASS_GAINS, SHORT_PASS_FIRST_GAIN);
+    writeGains(out, "long_pass", rules.longPass, LONG_PASS_GAINS, LONG_PASS_FIRST_GAIN);
+    writeGains(out, "run", rules.run, RUN_GAINS, RUN_FIRST_GAIN);
+}
+
+static uint64_t addGains(uint64_t digest, const Gain* gains, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        digest = deriveSeed(digest, static_cast<uint32_t>(gains[i].base));
+        digest = deriveSeed(digest, static_cast<uint32_t>(gains[i].dice));
+    }
+    return digest;
+}
+
+uint64_t rulesetDigest(const Ruleset& rules)
+{
+    // Fold in one value at a time, so the digest doesn't depend on the
+    // struct's layout or byte order.
+    uint64_t digest = 0;
+    const int* mods = &rules.defensiveMods[0][0][0];
+    for (unsigned int i = 0; i < NUM_MOD_CALLS * NUM_MOD_CALLS * NUM_MOD_ROLLS; i++)
+        digest = deriveSeed(digest, static_cast<uint32_t>(mods[i]));
+
+    digest = addGains(digest, rules.shortPass, SHORT_PASS_GAINS);
+    digest = addGains(digest, rules.longPass, LONG_PASS_GAINS);
+    return addGains(digest, rules.run, RUN_GAINS);
+}
@@ -0,0 +1,93 @@
+#ifndef __RULESET_H
+#define __RULESET_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+/**
+ * The tunable numbers behind the outcome of a play: the modifiers the defense's
+ * call adds to the offense's roll, and the yards gained on the better rolls of
+ * each kind of play. Everything else about a play (turnovers, sacks, kicks) is
+ * still written out in play.cpp.
+ *
+ * A ruleset can be read from a text file, so tuned tables (see calibrate
+ * --tune) can be tried out without rebuilding. Games only replay exactly with
+ * the ruleset they were played with, which is why game records keep a digest
+ * of it (see record.h).
+ */
+
+/* Number of results of the 2d6 roll for the defensive modifier, 2 to 12. */
+const unsigned int NUM_MOD_ROLLS = 11;
+/* Plays with a defensive modifier: run, short pass and long pass. */
+const unsigned int NUM_MOD_CALLS = 3;
+
+/* A 3d6 roll plus the defense's modifier picks the outcome of a play, from 1
+ * to 20. Modifiers are kept to those that can't push a roll outside that. */
+const int MIN_PLAY_ROLL = 1;
+const int MAX_PLAY_ROLL = 20;
+const int MIN_DEF_MOD = MIN_PLAY_ROLL - 3;
+const int MAX_DEF_MOD = MAX_PLAY_ROLL - 18;
+
+/* The rolls of each play whose yardage is in the tables. */
+const unsigned int SHORT_PASS_FIRST_GAIN = 10;
+const unsigned int SHORT_PASS_GAINS = 9;
+const unsigned int LONG_PASS_FIRST_GAIN = 12;
+const unsigned int LONG_PASS_GAINS = 6;
+const unsigned int RUN_FIRST_GAIN = 11;
+const unsigned int RUN_GAINS = 8;
+
+/* Most extra dice a gain can roll. */
+const int MAX_GAIN_DICE = 6;
+
+/* Yards gained on a roll: base plus the sum of some more dice. */
+struct Gain {
+    int base;
+    int dice;
+};
+
+struct Ruleset {
+    /* indexed [offensive call][defensive call][roll - 2] */
+    int defensiveMods[NUM_MOD_CALLS][NUM_MOD_CALLS][NUM_MOD_ROLLS];
+    /* indexed by roll - the play's FIRST_GAIN */
+    Gain shortPass[SHORT_PASS_GAINS];
+    Gain longPass[LONG_PASS_GAINS];
+    Gain run[RUN_GAINS];
+};
+
+/* The tables the game was designed with. */
+constexpr Ruleset DEFAULT_RULESET = {
+    { { { 1, 0, 0, 0, 0, 0, 0, -1, -1, -1, -2 },
+          { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 },
+          { 1, 1, 0, 0, 0, 0, 0, 0, 0, -1, -1 } },
+        { { 1, 1, 0, 0, 0, 0, 0, 0, 0, -1, -1 },
+            { 1, 0, 0, 0, 0, 0, 0, -1, -1, -1, -2 },
+            { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 } },
+        { { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 },
+            { 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, -1 },
+            { 1, 0, 0, 0, 0, 0, 0, -1, -1, -1, -2 } } },
+    { { 0, 1 }, { 1, 1 }, { 0, 2 }, { 0, 2 }, { 5, 2 }, { 10, 2 }, { 15, 2 }, { 30, 3 }, { 50, 3 } },
+    { { 2, 2 }, { 0, 3 }, { 5, 3 }, { 10, 3 }, { 15, 3 }, { 40, 4 } },
+    { { 0, 1 }, { 1, 1 }, { 0, 2 }, { 0, 2 }, { 0, 3 }, { 5, 3 }, { 20, 4 }, { 40, 4 } }
+};
+
+/* A shared copy of DEFAULT_RULESET. */
+std::shared_ptr<const Ruleset> defaultRuleset();
+
+/**
+ * Reads a ruleset written by writeRuleset(). Tables missing from the file keep
+ * their default values. Throws std::runtime_error if the file can't be read or
+ * has anything in it other than complete tables, or a modifier outside
+ * MIN_DEF_MOD to MAX_DEF_MOD.
+ */
+Ruleset loadRuleset(const std::string& path);
+
+/* Writes each table as its name followed by its values. */
+void writeRuleset(std::ostream& out, const Ruleset& rules);
+
+/* A hash of every value in the ruleset, the same on any machine. Two rulesets
+ * with the same digest play out the same games. */
+uint64_t rulesetDigest(const Ruleset& rules);
+
+#endif
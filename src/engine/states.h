@@ -64,6 +64,14 @@ public:
         curState->enter(owner);
     }
 
+    /* Sets the current state without calling exit or enter. Only meant for
+     * restoring an entity that was saved in the middle of some state.
+     */
+    void setState(State<Entity>* state)
+    {
+        curState = state;
+    }
+
     /* getters... */
     State<Entity>* getCurrentState() const { return curState; }
     Entity* getOwner() const { return owner; }
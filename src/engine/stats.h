@@ -0,0 +1,42 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <algorithm>
+#include <cmath>
+
+/* z value for a two sided 95% confidence interval */
+const double Z_95 = 1.96;
+
+/**
+ * Running sums, for the mean and variance of a stat. Sums from different
+ * threads can be added together.
+ */
+struct Moments {
+    double n = 0;
+    double sum = 0;
+    double sumSq = 0;
+
+    void add(double x)
+    {
+        n++;
+        sum += x;
+        sumSq += x * x;
+    }
+
+    void add(const Moments& other)
+    {
+        n += other.n;
+        sum += other.sum;
+        sumSq += other.sumSq;
+    }
+
+    double mean() const { return n > 0 ? sum / n : 0; }
+    double variance() const
+    {
+        return n > 1 ? std::max(0.0, (sumSq - sum * sum / n) / (n - 1)) : 0;
+    }
+    /* Half the width of the 95% confidence interval on the mean. */
+    double halfWidth() const { return n > 0 ? Z_95 * std::sqrt(variance() / n) : 0; }
+};
+
+#endif
@@ -1,11 +1,11 @@
 #include "team.h"
 #include "../learn/model.h"
-#include "utils.h"
+#include "dice.h"
 
 // TODO: rewrite this to be simpler
-static inline bool shouldPunt(Situation* sit)
+static inline bool shouldPunt(Situation* sit, Random& rng)
 {
-    unsigned int roll = rollDice(1, false);
+    unsigned int roll = rollDice<1>(rng);
     return sit->down == FOURTH && sit->fieldPos <= 57 && (sit->distance > 2 || sit->fieldPos <= 40 || (sit->fieldPos <= 50 && sit->distance == 1 && roll == 6) || (sit->fieldPos <= 57 && ((sit->distance == 1 && roll > 1) || roll == 6)));
 }
 
@@ -19,15 +19,58 @@ static inline bool shouldKick(Situation* sit)
  * Calls a play using the machine learning model.
  * Look how much nicer than that fucking abomination using dice rolls.
  */
-PlayCall AITeam::callPlay(Situation* situation)
+AITeam::AITeam(const EngineContext& context)
+    : model(context.getModel())
+{
+}
+
+AITeam::AITeam(const EngineContext& context, const std::string& model)
+    : model(context.getModel(model))
+{
+}
+
+PlayCall AITeam::callPlay(Situation* situation, Random& rng)
 {
     // Right now the model only takes into account offensive snaps,
     // and so it's easier to just have separate punt logic.
-    if (shouldPunt(situation)) {
+    if (shouldPunt(situation, rng)) {
         return PUNT;
     } else if (shouldKick(situation)) {
         return FIELD_GOAL;
     } else {
-        return getPlayCall(situation);
+        return getPlayCall(*model, situation, rng);
+    }
+}
+
+CallPrep Team::prepareCall(Situation* situation, Random& rng, PlayCall& call,
+    const PlaycallModel*&)
+{
+    call = callPlay(situation, rng);
+    return CALL_MADE;
+}
+
+CallPrep AITeam::prepareCall(Situation* situation, Random& rng, PlayCall& call,
+    const PlaycallModel*& model)
+{
+    if (shouldPunt(situation, rng)) {
+        call = PUNT;
+        return CALL_MADE;
+    } else if (shouldKick(situation)) {
+        call = FIELD_GOAL;
+        return CALL_MADE;
+    } else {
+        model = this->model.get();
+        return CALL_NEEDS_MODEL;
+    }
+}
+
+Team* makeTeam(const EngineContext& context, const TeamConfig& config)
+{
+    switch (config.type) {
+    case USER_TEAM:
+        return new UserTeam();
+    case AI_TEAM:
+    default:
+        return new AITeam(context, config.model);
     }
 }
@@ -1,8 +1,24 @@
 #ifndef __TEAM_H
 #define __TEAM_H
 
+#include "context.h"
 #include "game.h"
 #include "playcall.h"
+#include "utils.h"
+#include <memory>
+#include <ostream>
+#include <string>
+
+/* What Team::prepareCall() did with a call. */
+enum CallPrep {
+    /* the call has been made */
+    CALL_MADE,
+    /* the call has to be finished with the model handed back */
+    CALL_NEEDS_MODEL,
+    /* the team can't make the call on the spot, e.g. it's up to a player, so
+     * whoever is running the game has to get it some other way */
+    CALL_PENDING
+};
 
 /**
  * Should be the base Team class. Currently only responsible for calling plays,
@@ -16,7 +32,19 @@
 class Team {
 public:
     virtual ~Team() {};
-    virtual PlayCall callPlay(Situation* situation) = 0;
+    /* Any randomness in the playcall must come from rng, which belongs to the
+     * game being played, or else the game can't be replayed from its seed.
+     */
+    virtual PlayCall callPlay(Situation* situation, Random& rng) = 0;
+    /* For games played as coroutines (see gametask.h), where the model can be
+     * asked for many games' calls at once, and no game should hold up the
+     * rest: makes whatever part of the call can be made on the spot without
+     * a playcall model. Sets call, or sets model to the model to finish the
+     * call with, having used rng exactly as callPlay() would have up to that
+     * point, or leaves the call pending. By default just calls callPlay().
+     */
+    virtual CallPrep prepareCall(Situation* situation, Random& rng, PlayCall& call,
+        const PlaycallModel*& model);
 };
 
 /**
@@ -26,16 +54,61 @@ public:
  * playcalling capabilities.
  */
 class AITeam : public Team {
+private:
+    std::shared_ptr<const PlaycallModel> model;
+
 public:
-    PlayCall callPlay(Situation* situation);
+    /* Calls plays with the context's default model. */
+    AITeam(const EngineContext& context);
+    /* Calls plays with the model saved in the named file, which is shared with
+     * every other team using it. Throws std::runtime_error if the model can't
+     * be loaded.
+     */
+    AITeam(const EngineContext& context, const std::string& model);
+    PlayCall callPlay(Situation* situation, Random& rng);
+    CallPrep prepareCall(Situation* situation, Random& rng, PlayCall& call,
+        const PlaycallModel*& model);
 };
 
-#include <map>
-
+/**
+ * Lets a human call the plays, by printing the situation to stdout and reading
+ * their choice from stdin.
+ */
 class UserTeam : public Team {
 public:
-    UserTeam();
-    PlayCall callPlay(Situation* situation);
+    PlayCall callPlay(Situation* situation, Random& rng);
+    /* Always leaves the call pending, rather than waiting on stdin. */
+    CallPrep prepareCall(Situation* situation, Random& rng, PlayCall& call,
+        const PlaycallModel*& model);
+
+    /* What callPlay() shows the player, for other front ends (e.g. fb-playd)
+     * to show the same. */
+    static void renderSituation(std::ostream& out, Situation* situation);
+    static void renderPrompt(std::ostream& out);
+    static void renderError(std::ostream& out);
+    /* Reads the player's answer to the prompt. Returns false if it isn't one
+     * of the choices. */
+    static bool parseChoice(const std::string& choice, PlayCall& call);
 };
 
+/* The kinds of Team the engine knows how to build on its own. */
+enum TeamType { AI_TEAM,
+    USER_TEAM };
+
+/**
+ * Everything needed to rebuild a Team, e.g. when replaying a recorded game.
+ */
+struct TeamConfig {
+    TeamType type;
+    /* File name of an AI team's playcall model. Empty means the context's
+     * default model.
+     */
+    std::string model;
+};
+
+/* Builds a new team from its config. The caller owns the returned team.
+ * Throws std::runtime_error if the team's model can't be loaded.
+ */
+Team* makeTeam(const EngineContext& context, const TeamConfig& config);
+
 #endif
@@ -0,0 +1,73 @@
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+    : stopping(false)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < numThreads; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    hasWork.notify_all();
+
+    for (std::thread& t : workers)
+        t.join();
+}
+
+void ThreadPool::work()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            hasWork.wait(guard, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(std::move(task));
+    }
+    hasWork.notify_one();
+}
+
+unsigned int ThreadPool::size() const
+{
+    return workers.size();
+}
+
+size_t ThreadPool::queueDepth()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return tasks.size();
+}
+
+void TaskCounter::finish()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (--remaining == 0)
+        done.notify_all();
+}
+
+void TaskCounter::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return remaining == 0; });
+}
@@ -0,0 +1,63 @@
+#ifndef __THREADPOOL_H
+#define __THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads pulling tasks off a shared queue. Meant to be
+ * created once and kept around, so that lots of small batches don't each pay
+ * for starting up their own threads.
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable hasWork;
+    bool stopping;
+
+    /* Main loop for each worker thread. */
+    void work();
+
+public:
+    /* Starts numThreads workers. Uses one per core if numThreads is 0. */
+    ThreadPool(unsigned int numThreads);
+    /* Finishes any queued tasks, then joins all of the workers. */
+    ~ThreadPool();
+
+    /* Queues up a task to be run on one of the workers. */
+    void submit(std::function<void()> task);
+
+    unsigned int size() const;
+    /* Number of tasks waiting for a worker. */
+    size_t queueDepth();
+};
+
+/**
+ * Lets one thread wait for a known number of tasks to finish.
+ */
+class TaskCounter {
+private:
+    size_t remaining;
+    std::mutex lock;
+    std::condition_variable done;
+
+public:
+    TaskCounter(size_t count)
+        : remaining(count)
+    {
+    }
+
+    /* Called by each task when it finishes. */
+    void finish();
+    /* Blocks until finish() has been called count times. */
+    void wait();
+};
+
+#endif
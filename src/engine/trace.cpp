@@ -0,0 +1,201 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+std::atomic<bool> traceEnabled { false };
+thread_local bool traceSampledOut = false;
+
+/* Phases from the trace-event format. */
+static const char COMPLETE_EVENT = 'X';
+static const char INSTANT_EVENT = 'i';
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    uint64_t start;
+    uint64_t end;
+    char phase;
+};
+
+/*
+ * One thread's events. Owned by the list of buffers rather than the thread,
+ * so that they're still there to be written after it exits.
+ */
+struct TraceBuffer {
+    /* the thread's lane in the trace */
+    unsigned int lane;
+    std::vector<TraceEvent> events;
+    size_t dropped = 0;
+};
+
+static std::mutex buffersLock;
+static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+static uint64_t traceStart;
+static std::atomic<unsigned int> sampleEvery { 1 };
+
+static thread_local TraceBuffer* threadBuffer = nullptr;
+/* Games this thread has started since tracing began, for sampling. */
+static thread_local uint64_t gamesSeen = 0;
+/* Where the current drive started, or 0 if this thread isn't in a traced
+ * game. */
+static thread_local uint64_t driveStart = 0;
+static thread_local bool driveEnded = false;
+static thread_local bool inSnap = false;
+
+/* Gets this thread's buffer, making it the first time. */
+static TraceBuffer& buffer()
+{
+    if (!threadBuffer) {
+        std::lock_guard<std::mutex> guard(buffersLock);
+        buffers.push_back(std::make_unique<TraceBuffer>());
+        threadBuffer = buffers.back().get();
+        threadBuffer->lane = buffers.size() - 1;
+    }
+    return *threadBuffer;
+}
+
+static void record(const TraceEvent& event)
+{
+    TraceBuffer& buf = buffer();
+    if (buf.events.size() < MAX_TRACE_EVENTS_PER_THREAD)
+        buf.events.push_back(event);
+    else
+        buf.dropped++;
+}
+
+void startTrace(unsigned int every)
+{
+    traceStart = traceNow();
+    sampleEvery.store(std::max(1u, every), std::memory_order_relaxed);
+    traceEnabled.store(true, std::memory_order_release);
+}
+
+void traceSpan(const char* name, const char* category, uint64_t start, uint64_t end)
+{
+    record({ name, category, start, end, COMPLETE_EVENT });
+}
+
+void traceInstant(const char* name, const char* category)
+{
+    if (!inSnap || !traceRecording())
+        return;
+
+    uint64_t now = traceNow();
+    record({ name, category, now, now, INSTANT_EVENT });
+}
+
+GameTraceScope::GameTraceScope()
+    : start(0)
+    , sampledOut(false)
+{
+    if (!traceRecording())
+        return;
+
+    if (gamesSeen++ % sampleEvery.load(std::memory_order_relaxed) != 0) {
+        sampledOut = true;
+        traceSampledOut = true;
+        return;
+    }
+
+    start = traceNow();
+    driveStart = start;
+    driveEnded = false;
+}
+
+GameTraceScope::~GameTraceScope()
+{
+    if (sampledOut) {
+        traceSampledOut = false;
+    } else if (start) {
+        traceSpan("game", "game", start, traceNow());
+        driveStart = 0;
+    }
+}
+
+void traceDriveEnd()
+{
+    driveEnded = true;
+}
+
+uint64_t traceSnapStart()
+{
+    inSnap = true;
+    return traceNow();
+}
+
+void traceSnap(uint64_t start)
+{
+    inSnap = false;
+    if (!traceRecording())
+        return;
+
+    uint64_t end = traceNow();
+    traceSpan("snap", "game", start, end);
+    if (driveEnded && driveStart) {
+        traceSpan("drive", "game", driveStart, end);
+        driveStart = end;
+    }
+    driveEnded = false;
+}
+
+/* Writes ns, a time on the trace's clock, as microseconds since the trace
+ * started, which is what the format wants. */
+static void writeMicros(std::ostream& out, uint64_t ns)
+{
+    uint64_t since = ns > traceStart ? ns - traceStart : 0;
+    out << since / 1000 << '.' << char('0' + since / 100 % 10)
+        << char('0' + since / 10 % 10) << char('0' + since % 10);
+}
+
+size_t writeTrace(std::ostream& out)
+{
+    std::lock_guard<std::mutex> guard(buffersLock);
+    size_t dropped = 0;
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const std::unique_ptr<TraceBuffer>& buf : buffers) {
+        dropped += buf->dropped;
+
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << buf->lane << ",\"args\":{\"name\":\"thread " << buf->lane << "\"}}";
+        first = false;
+
+        for (const TraceEvent& event : buf->events) {
+            // Names and categories are literals from the engine, so they
+            // never need escaping.
+            out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                << "\",\"ph\":\"" << event.phase << "\",\"pid\":1,\"tid\":" << buf->lane
+                << ",\"ts\":";
+            writeMicros(out, event.start);
+            if (event.phase == COMPLETE_EVENT) {
+                out << ",\"dur\":";
+                writeMicros(out, traceStart + (event.end - event.start));
+            } else {
+                out << ",\"s\":\"t\"";
+            }
+            out << '}';
+        }
+    }
+    out << "\n]}\n";
+
+    return dropped;
+}
+
+size_t writeTrace(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("could not create trace " + path);
+
+    size_t dropped = writeTrace(out);
+    out.close();
+    if (!out)
+        throw std::runtime_error("could not write trace " + path);
+    return dropped;
+}
@@ -0,0 +1,161 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Timeline tracing, written out as Chrome trace-event JSON for Perfetto or
+ * chrome://tracing. Spans cover batches, each worker's chunks of games, games,
+ * drives, snaps, the state each snap runs in, playcall model inference and
+ * play resolution, with one lane per thread. That shows where a parallel batch
+ * or the daemon spends its time: a worker left running alone at the end, a
+ * snap that took far longer than the rest, a slow model call.
+ *
+ * Only built in with FB_TRACE (cmake -DFB_TRACE=ON); otherwise the macros
+ * below are empty. Even then nothing is recorded until startTrace().
+ *
+ * Each thread records into its own buffer, so recording never takes a lock.
+ * Timestamps come from steady_clock, which is read through the vDSO without a
+ * system call. Buffers are only read by writeTrace(), which must not run
+ * while anything is still recording.
+ */
+
+/* Stops a thread from recording past this many events, so that a long run
+ * can't use up all of memory. Anything past it is counted, and dropped. */
+const size_t MAX_TRACE_EVENTS_PER_THREAD = 1 << 22;
+
+/* Whether startTrace() has been called, and this thread isn't in a game that
+ * was sampled out. */
+extern std::atomic<bool> traceEnabled;
+extern thread_local bool traceSampledOut;
+
+inline bool traceRecording()
+{
+    return traceEnabled.load(std::memory_order_relaxed) && !traceSampledOut;
+}
+
+/* Nanoseconds on the trace's clock. */
+inline uint64_t traceNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/* Starts recording, keeping every sampleEvery'th game each thread plays and
+ * everything in it. Spans outside of games, like batches, are always kept.
+ * Names and categories must be string literals, since only the pointers are
+ * kept until writeTrace().
+ */
+void startTrace(unsigned int sampleEvery = 1);
+/* Writes everything recorded so far as trace-event JSON. Returns the number
+ * of events dropped for going over MAX_TRACE_EVENTS_PER_THREAD. */
+size_t writeTrace(std::ostream& out);
+/* Same as above, to a file. Throws std::runtime_error if it can't be
+ * written. */
+size_t writeTrace(const std::string& path);
+
+/* Records a span from start to end on this thread's lane. */
+void traceSpan(const char* name, const char* category, uint64_t start, uint64_t end);
+/* Records a moment on this thread's lane, if it's in a snap that's being
+ * recorded. Setting up a game changes its state too, but that's noise. */
+void traceInstant(const char* name, const char* category);
+
+/* Records a span from construction to destruction. */
+class TraceScope {
+private:
+    const char* name;
+    const char* category;
+    uint64_t start;
+
+public:
+    TraceScope(const char* name, const char* category)
+        : name(name)
+        , category(category)
+        , start(traceRecording() ? traceNow() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (start && traceRecording())
+            traceSpan(name, category, start, traceNow());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+/* Records a game, if it's sampled in. Games are sampled in or out as a
+ * whole, everything they call included.
+ */
+class GameTraceScope {
+private:
+    uint64_t start;
+    bool sampledOut;
+
+public:
+    GameTraceScope();
+    ~GameTraceScope();
+
+    GameTraceScope(const GameTraceScope&) = delete;
+    GameTraceScope& operator=(const GameTraceScope&) = delete;
+};
+
+/* Marks the snap this thread is in as the last of its drive. */
+void traceDriveEnd();
+/* Starts a snap, returning when, or 0 if it isn't being recorded. */
+uint64_t traceSnapStart();
+/* Records a snap that started at start, and the drive it ended, if it did. */
+void traceSnap(uint64_t start);
+
+/* Records a snap from construction to destruction. Drives are recorded as
+ * the snaps of a traced game from the end of one drive to the end of the next,
+ * so that they line up with the snaps inside them.
+ */
+class SnapTraceScope {
+private:
+    uint64_t start;
+
+public:
+    SnapTraceScope()
+        : start(traceRecording() ? traceSnapStart() : 0)
+    {
+    }
+
+    ~SnapTraceScope()
+    {
+        if (start)
+            traceSnap(start);
+    }
+
+    SnapTraceScope(const SnapTraceScope&) = delete;
+    SnapTraceScope& operator=(const SnapTraceScope&) = delete;
+};
+
+#ifdef FB_TRACE
+#define FB_TRACE_CONCAT2(a, b) a##b
+#define FB_TRACE_CONCAT(a, b) FB_TRACE_CONCAT2(a, b)
+#define FB_TRACE_SCOPE(name, category) TraceScope FB_TRACE_CONCAT(traceScope, __LINE__)(name, category)
+#define FB_TRACE_INSTANT(name, category) traceInstant(name, category)
+#define FB_TRACE_GAME() GameTraceScope gameTrace
+#define FB_TRACE_SNAP() SnapTraceScope snapTrace
+#define FB_TRACE_DRIVE_END() traceDriveEnd()
+#else
+#define FB_TRACE_SCOPE(name, category)
+#define FB_TRACE_INSTANT(name, category) \
+    do {                                 \
+    } while (0)
+#define FB_TRACE_GAME()
+#define FB_TRACE_SNAP()
+#define FB_TRACE_DRIVE_END() \
+    do {                     \
+    } while (0)
+#endif
+
+#endif
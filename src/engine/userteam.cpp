@@ -1,77 +1,74 @@
+#include <cstdlib>
 #include <iostream>
 
 #include "team.h"
 
-template <typename T>
-struct map_init_helper {
-    T& data;
-    map_init_helper(T& d)
-        : data(d)
-    {
-    }
-    map_init_helper& operator()(typename T::key_type const& key, typename T::mapped_type const& value)
-    {
-        data[key] = value;
-        return *this;
-    }
-};
+/* These tables are never written to, so any number of games with user teams
+ * can be going at once.
+ */
+#define NUM_PLAYS 5
+static const PlayCall plays[] = { RUN, SHORT_PASS, LONG_PASS, PUNT, FIELD_GOAL };
+/* Indexed by PlayCall */
+static const char* const playNames[] = { "Run", "Short pass", "Long pass", "Punt", "Field goal" };
+/* Indexed by Down */
+static const char* const downs[] = { "", "First down", "Second down", "Third down",
+    "Fourth down", "Kickoff", "Extra point" };
 
-template <typename T>
-map_init_helper<T> map_init(T& item)
+void UserTeam::renderSituation(std::ostream& out, Situation* sit)
 {
-    return map_init_helper<T>(item);
+    out << downs[sit->down];
+    out << " and ";
+    out << ((sit->fieldPos + sit->distance >= 100) ? " and goal" : std::to_string(sit->distance));
+    out << " from the ";
+    out << sit->fieldPos;
+    out << " yard line\n";
+    out << sit->clock->ticksToTime() + " remaining in quarter ";
+    out << sit->clock->getQuarter() << "\n";
 }
 
-#define NUM_PLAYS 5
-PlayCall plays[] = { RUN, SHORT_PASS, LONG_PASS, PUNT, FIELD_GOAL };
-std::map<PlayCall, const char*> playNames;
-std::map<Down, const char*> downs;
-
-UserTeam::UserTeam()
+void UserTeam::renderPrompt(std::ostream& out)
 {
-    map_init(playNames)(RUN, "Run")(SHORT_PASS, "Short pass")(LONG_PASS, "Long pass")(PUNT, "Punt")(FIELD_GOAL, "Field goal");
+    out << "Pick your play from the following\n";
 
-    map_init(downs)(FIRST, "First down")(SECOND, "Second down")(THIRD, "Third down")(FOURTH, "Fourth down");
+    for (size_t i = 0; i < NUM_PLAYS; i++)
+        out << i << ": " << playNames[plays[i]] << '\n';
 }
 
-void printSituation(Situation* sit)
+void UserTeam::renderError(std::ostream& out)
 {
-    std::cout << downs[sit->down];
-    std::cout << " and ";
-    std::cout << ((sit->fieldPos + sit->distance >= 100) ? " and goal" : std::to_string(sit->distance));
-    std::cout << " from the ";
-    std::cout << sit->fieldPos;
-    std::cout << " yard line\n";
-    std::cout << sit->clock->ticksToTime() + " remaining in quarter ";
-    std::cout << sit->clock->getQuarter() << "\n";
+    out << "Sorry, did not recognize that option.\n";
 }
 
-void printPrompt()
+bool UserTeam::parseChoice(const std::string& choice, PlayCall& call)
 {
-    std::cout << "Pick your play from the following" << std::endl;
-
-    for (size_t i = 0; i < NUM_PLAYS; i++)
-        std::cout << i << ": " << playNames[plays[i]] << std::endl;
-}
+    char* end;
+    unsigned long in = std::strtoul(choice.c_str(), &end, 10);
+    if (end == choice.c_str() || in >= NUM_PLAYS)
+        return false;
 
-void printError()
-{
-    std::cout << "Sorry, did not recognize that option." << std::endl;
+    call = plays[in];
+    return true;
 }
 
-PlayCall UserTeam::callPlay(Situation* sit)
+PlayCall UserTeam::callPlay(Situation* sit, Random&)
 {
     unsigned int in;
 
-    printSituation(sit);
+    renderSituation(std::cout, sit);
     while (1) {
-        printPrompt();
+        renderPrompt(std::cout);
+        std::cout.flush();
         std::cin >> in;
         if (in < NUM_PLAYS)
             break;
         else
-            printError();
+            renderError(std::cout);
     }
 
     return plays[in];
-}
\ No newline at end of file
+}
+
+CallPrep UserTeam::prepareCall(Situation*, Random&, PlayCall&, const PlaycallModel*&)
+{
+    return CALL_PENDING;
+}
@@ -1,20 +1,92 @@
 #include "utils.h"
-#include <stdlib.h>
+#include "dice.h"
 
-unsigned int rollDice(unsigned int numDice, bool breakaway)
+void Random::drawDice()
 {
-    int total = 0;
+    // Scaled down to a die by multiplying rather than taking a remainder, so
+    // there is no rejection loop.
+    diceState = state;
+    uint64_t z = next();
+    dice[0] = static_cast<uint8_t>((((z >> 32) * NUM_SIDES) >> 32) + 1);
+    dice[1] = static_cast<uint8_t>((((z & 0xffffffffULL) * NUM_SIDES) >> 32) + 1);
+    diceUsed = 0;
+}
+
+Random::State Random::getState() const
+{
+    return State { state, diceState, diceUsed };
+}
+
+void Random::setState(const State& s)
+{
+    if (s.diceUsed < 2) {
+        state = s.diceCounter;
+        drawDice();
+    }
+
+    state = s.counter;
+    diceState = s.diceCounter;
+    diceUsed = s.diceUsed;
+}
+
+unsigned int rollDice(Random& rng, unsigned int numDice, bool breakaway)
+{
+    switch (numDice) {
+    case 0:
+        return 0;
+    case 1:
+        return breakaway ? rollDice<1, true>(rng) : rollDice<1>(rng);
+    case 2:
+        return breakaway ? rollDice<2, true>(rng) : rollDice<2>(rng);
+    case 3:
+        return breakaway ? rollDice<3, true>(rng) : rollDice<3>(rng);
+    case 4:
+        return breakaway ? rollDice<4, true>(rng) : rollDice<4>(rng);
+    }
+
+    unsigned int total = 0;
     while (numDice-- > 0) {
-        int roll = rand() % NUM_SIDES + 1;
-        if (breakaway && roll == 6)
-            numDice++;
+        unsigned int roll = rng.roll();
+        // a six earns another die; added rather than branched on, since
+        // whether we roll one is a coin flip the predictor can't learn
+        numDice += breakaway & (roll == NUM_SIDES);
         total += roll;
     }
 
     return total;
 }
 
-unsigned int rollDice(unsigned int numDice)
+unsigned int breakawayTail(Random& rng, unsigned int numDice, unsigned int rolled)
+{
+    // More than rolled dice were needed, i.e. fewer than numDice of the first
+    // rolled dice weren't sixes. Pick how many weren't, in proportion to the
+    // number of ways that can happen, then finish the roll from there.
+    uint64_t weights[DICE_TABLE_ROLLS] = {};
+    uint64_t total = 0;
+    for (unsigned int j = 0; j < numDice; j++) {
+        weights[j] = dice_detail::choose(rolled, j) * dice_detail::power(NUM_SIDES - 1, j);
+        total += weights[j];
+    }
+
+    uint64_t x = rng.uniform64(total);
+    unsigned int done = 0;
+    while (x >= weights[done])
+        x -= weights[done++];
+
+    unsigned int sum = NUM_SIDES * (rolled - done);
+    for (unsigned int i = 0; i < done; i++)
+        sum += rng.uniform(NUM_SIDES - 1) + 1;
+
+    return sum + rollDice(rng, numDice - done, true);
+}
+
+unsigned int rollDice(Random& rng, unsigned int numDice)
+{
+    return rollDice(rng, numDice, false);
+}
+
+uint64_t deriveSeed(uint64_t seed, uint64_t index)
 {
-    return rollDice(numDice, false);
+    Random rng(seed ^ (index * 0xd1342543de82ef95ULL));
+    return rng.next();
 }
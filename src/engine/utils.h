@@ -1,14 +1,101 @@
 #ifndef __UTILS_H
 #define __UTILS_H
 
+#include <cstdint>
+
 /* number of sides on our dice. Might want to change at some point */
 const unsigned NUM_SIDES = 6;
 
+/**
+ * A small seedable random number generator (SplitMix64). Every Game owns one,
+ * so a game is completely determined by its seed and the teams playing it.
+ *
+ * The generator itself is a single 64 bit counter. A die only needs a few
+ * bits, so each draw is split into two dice, one from each 32 bit half, and
+ * the second is kept for the next roll. Rolls of more than one die don't come
+ * through here at all, but from the alias tables in dice.h.
+ *
+ * Dice used to be rolled a block at a time into a buffer by a vectorized loop.
+ * Every snap rolls from a fresh substream, though (see Game::callRandom()),
+ * and only a handful of times, so most of each block was thrown away, and the
+ * block was dropped for the single split draw. dice-bench still times both.
+ */
+class Random {
+public:
+    /* Everything needed to pick the stream back up where it was, e.g. when
+     * restoring a checkpointed game. The dice themselves aren't saved, since
+     * they can be drawn again from the counter they were drawn from.
+     */
+    struct State {
+        uint64_t counter;
+        uint64_t diceCounter;
+        uint32_t diceUsed;
+    };
+
+private:
+    uint64_t state;
+    /* counter the current pair of dice was drawn from */
+    uint64_t diceState;
+    /* dice[diceUsed] is the next roll; both have been rolled once this
+     * reaches 2 */
+    unsigned int diceUsed;
+    uint8_t dice[2];
+
+    /* Draws a new pair of dice. */
+    void drawDice();
+
+public:
+    Random(uint64_t seed = 0)
+        : state(seed)
+        , diceState(0)
+        , diceUsed(2)
+    {
+    }
+
+    /* Returns the next 64 uniformly distributed bits. */
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /* Returns a uniformly distributed integer in [0, n). */
+    unsigned int uniform(unsigned int n)
+    {
+        return static_cast<unsigned int>(((next() >> 32) * n) >> 32);
+    }
+
+    /* Same as uniform(), for n too big for 32 bits. */
+    uint64_t uniform64(uint64_t n)
+    {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * n) >> 64);
+    }
+
+    /* Returns a single die roll, from 1 to NUM_SIDES. */
+    unsigned int roll()
+    {
+        if (diceUsed == 2)
+            drawDice();
+        return dice[diceUsed++];
+    }
+
+    State getState() const;
+    void setState(const State& s);
+};
+/* Derives the seed for the index-th substream of seed, e.g. the index-th game
+ * of a batch, so that neighbouring streams don't overlap.
+ */
+uint64_t deriveSeed(uint64_t seed, uint64_t index);
+
 /**
  * Returns the sum of some number of six sided dic being rolled. When set, the
- * optional breakaway flag causes all 6's to result in a bonus roll.
+ * optional breakaway flag causes all 6's to result in a bonus roll. When the
+ * number of dice is known up front, rollDice<N, Breakaway>() in dice.h is
+ * quicker.
  */
-unsigned int rollDice(unsigned int numDice, bool breakaway);
-unsigned int rollDice(unsigned int numDice);
+unsigned int rollDice(Random& rng, unsigned int numDice, bool breakaway);
+unsigned int rollDice(Random& rng, unsigned int numDice);
 
-#endif
\ No newline at end of file
+#endif
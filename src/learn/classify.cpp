@@ -1,19 +1,35 @@
 #include <mlpack/core/data/load.hpp>
 #include <mlpack/methods/softmax_regression/softmax_regression.hpp>
-#include <cstdlib>
+#include <stdexcept>
 
-#include "model.h"
+#include "features.h"
 #include "learn.h"
+#include "softmax.h"
 #include "../engine/game.h"
+#include "../engine/alloctrack.h"
 #include "../engine/clock.h"
+#include "../engine/metrics.h"
+#include "../engine/perfcounters.h"
+#include "../engine/trace.h"
 
 using namespace mlpack;
 using namespace mlpack::regression;
 
-static SoftmaxRegression model;
+std::shared_ptr<const PlaycallModel> loadModel(const std::string &filename) {
+	std::shared_ptr<PlaycallModel> model = std::make_shared<PlaycallModel>();
+	if (!data::Load(filename, MODEL_NAME, model->regression))
+		throw std::runtime_error("could not load playcall model from " + filename);
 
-void initModel() {
-	data::Load<SoftmaxRegression>(MODEL_FILENAME, MODEL_NAME, model);
+	return model;
+}
+
+void situationFeatures(Situation *sit, double *features) {
+	features[FEATURE_QUARTER] = sit->clock->getQuarter();
+	features[FEATURE_MINUTES] = sit->clock->getMinutes();
+	features[FEATURE_SECONDS] = sit->clock->getSeconds();
+	features[FEATURE_DOWN] = static_cast<int>(sit->down);
+	features[FEATURE_DISTANCE] = sit->distance;
+	features[FEATURE_FIELD_POS] = sit->fieldPos;
 }
 
 /**
@@ -21,23 +37,16 @@ void initModel() {
  */
 static void loadDataVector(Situation *sit, arma::mat &data, size_t numFeatures) {
 	data = arma::mat(numFeatures, 1);
-
-	data.at(0,0) = sit->clock->getQuarter();
-	data.at(1,0) = sit->clock->getMinutes();
-	data.at(2,0) = sit->clock->getSeconds();
-	data.at(3,0) = static_cast<int>(sit->down);
-	data.at(4,0) = sit->distance;
-	data.at(5,0) = sit->fieldPos;
+	situationFeatures(sit, data.memptr());
 }
 
-PlayCall getPlayCall(Situation *sit) {
-	arma::mat probabilities, data;
-	loadDataVector(sit, data, model.FeatureSize());
-	model.Classify(data, probabilities);
-
-	double runThresh = probabilities.at(0,0) * 100;
-	double shortPassThresh = probabilities.at(1,0) * 100 + runThresh;
-	unsigned int roll = rand() % 100;
+/**
+ * Samples a call from column col of the model's probabilities.
+ */
+static PlayCall sampleCall(const arma::mat &probabilities, size_t col, Random &rng) {
+	double runThresh = probabilities.at(0,col) * 100;
+	double shortPassThresh = probabilities.at(1,col) * 100 + runThresh;
+	unsigned int roll = rng.uniform(100);
 
 	if (roll <= runThresh)
 		return RUN;
@@ -46,3 +55,31 @@ PlayCall getPlayCall(Situation *sit) {
 	else
 		return LONG_PASS;
 }
+
+PlayCall getPlayCall(const PlaycallModel &model, Situation *sit, Random &rng) {
+	FB_PERF_SCOPE(PERF_PLAYCALL);
+	FB_TRACE_SCOPE("playcall model", "inference");
+	countInferenceBatch(1);
+	FB_ALLOC_SCOPE(ALLOC_MODEL);
+	arma::mat probabilities, data;
+	loadDataVector(sit, data, model.regression.FeatureSize());
+	model.regression.Classify(data, probabilities);
+
+	return sampleCall(probabilities, 0, rng);
+}
+
+void getPlayCalls(const PlaycallModel &model, Situation *const *sits, Random *const *rngs,
+		PlayCall *calls, size_t n) {
+	FB_PERF_SCOPE_N(PERF_PLAYCALL, n);
+	FB_TRACE_SCOPE("playcall model batch", "inference");
+	countInferenceBatch(n);
+	FB_ALLOC_SCOPE(ALLOC_MODEL);
+	arma::mat probabilities;
+	arma::mat data(model.regression.FeatureSize(), n, arma::fill::zeros);
+	for (size_t i = 0; i < n; i++)
+		situationFeatures(sits[i], data.colptr(i));
+	model.regression.Classify(data, probabilities);
+
+	for (size_t i = 0; i < n; i++)
+		calls[i] = sampleCall(probabilities, i, *rngs[i]);
+}
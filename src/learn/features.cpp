@@ -0,0 +1,96 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <stdexcept>
+
+#include "features.h"
+
+/* Arrays in the file are aligned to this many bytes. */
+static const uint64_t CACHE_ALIGNMENT = 64;
+
+static uint64_t alignUp(uint64_t offset) {
+	return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+FeatureCache::FeatureCache(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("could not open feature cache " + path);
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(FeatureCacheHeader)) {
+		close(fd);
+		throw std::runtime_error(path + " is not a feature cache");
+	}
+
+	length = st.st_size;
+	map = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		throw std::runtime_error("could not map feature cache " + path);
+
+	header = static_cast<const FeatureCacheHeader *>(map);
+	uint64_t labelBytes = header->numSamples * sizeof(uint64_t);
+	bool ok = header->magic == FEATURE_CACHE_MAGIC
+		&& header->version == FEATURE_CACHE_VERSION
+		&& header->featureOffset % CACHE_ALIGNMENT == 0
+		&& header->labelOffset % CACHE_ALIGNMENT == 0
+		&& header->featureOffset + header->numSamples * header->numFeatures * sizeof(double) <= length
+		&& header->labelOffset + labelBytes <= length;
+	if (!ok) {
+		munmap(map, length);
+		throw std::runtime_error(path + " is not a valid feature cache");
+	}
+
+	madvise(map, length, MADV_SEQUENTIAL);
+}
+
+FeatureCache::~FeatureCache() {
+	munmap(map, length);
+}
+
+double *FeatureCache::features() const {
+	return reinterpret_cast<double *>(static_cast<char *>(map) + header->featureOffset);
+}
+
+uint64_t *FeatureCache::labels() const {
+	return reinterpret_cast<uint64_t *>(static_cast<char *>(map) + header->labelOffset);
+}
+
+bool isFeatureCache(const std::string &path) {
+	std::ifstream in(path, std::ios::binary);
+	uint32_t magic = 0;
+	in.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+	return in && magic == FEATURE_CACHE_MAGIC;
+}
+
+/* Pads the file out to offset with zeros. */
+static void padTo(std::ofstream &out, uint64_t offset) {
+	static const char zeros[CACHE_ALIGNMENT] = {};
+	uint64_t pos = out.tellp();
+	out.write(zeros, offset - pos);
+}
+
+void writeFeatureCache(const std::string &path, uint32_t numFeatures,
+		const std::vector<double> &features, const std::vector<uint64_t> &labels) {
+	FeatureCacheHeader header = {};
+	header.magic = FEATURE_CACHE_MAGIC;
+	header.version = FEATURE_CACHE_VERSION;
+	header.numFeatures = numFeatures;
+	header.numSamples = labels.size();
+	header.featureOffset = alignUp(sizeof(header));
+	header.labelOffset = alignUp(header.featureOffset + features.size() * sizeof(double));
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	padTo(out, header.featureOffset);
+	out.write(reinterpret_cast<const char *>(features.data()), features.size() * sizeof(double));
+	padTo(out, header.labelOffset);
+	out.write(reinterpret_cast<const char *>(labels.data()), labels.size() * sizeof(uint64_t));
+
+	if (!out)
+		throw std::runtime_error("could not write feature cache " + path);
+}
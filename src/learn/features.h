@@ -0,0 +1,94 @@
+#ifndef __DATA_FEATURES_H
+#define __DATA_FEATURES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A binary cache of training data, written by playcall-ingest and read by
+ * playcall-train.
+ *
+ * The file is a FeatureCacheHeader, then a numFeatures x numSamples matrix of
+ * doubles stored column by column (so each sample's features are together),
+ * then one label per sample. Both arrays start on a 64 byte boundary, so the
+ * file can be mapped and handed to Armadillo as is.
+ */
+
+const uint32_t FEATURE_CACHE_MAGIC = 0x43464246;
+const uint32_t FEATURE_CACHE_VERSION = 1;
+
+/* The features the model is trained on, in the order loadDataVector() in
+ * classify.cpp fills them in.
+ */
+enum BaseFeature {
+	FEATURE_QUARTER,
+	FEATURE_MINUTES,
+	FEATURE_SECONDS,
+	FEATURE_DOWN,
+	FEATURE_DISTANCE,
+	FEATURE_FIELD_POS,
+	NUM_BASE_FEATURES
+};
+
+/* Optional features, stored after the base ones when the cache has them. All
+ * are from the offense's point of view.
+ */
+enum ExtraFeature {
+	FEATURE_SCORE_MARGIN,
+	FEATURE_OFFENSE_TIMEOUTS,
+	FEATURE_DEFENSE_TIMEOUTS,
+	NUM_EXTRA_FEATURES
+};
+
+const unsigned int MAX_FEATURES = static_cast<unsigned int>(NUM_BASE_FEATURES) + NUM_EXTRA_FEATURES;
+
+struct FeatureCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numFeatures;
+	uint32_t reserved;
+	uint64_t numSamples;
+	/* byte offsets of the feature matrix and the labels */
+	uint64_t featureOffset;
+	uint64_t labelOffset;
+};
+
+/**
+ * A feature cache mapped into memory. The mapping is private, so the data can
+ * be handed to anything that wants a non-const pointer without touching the
+ * file.
+ */
+class FeatureCache {
+private:
+	void *map;
+	size_t length;
+	const FeatureCacheHeader *header;
+
+public:
+	/* Maps the cache at path. Throws std::runtime_error if it can't be read
+	 * or isn't a feature cache. */
+	explicit FeatureCache(const std::string &path);
+	~FeatureCache();
+
+	FeatureCache(const FeatureCache &) = delete;
+	FeatureCache &operator=(const FeatureCache &) = delete;
+
+	uint32_t numFeatures() const { return header->numFeatures; }
+	uint64_t numSamples() const { return header->numSamples; }
+	/* features()[i * numFeatures() + f] is feature f of sample i */
+	double *features() const;
+	/* labels()[i] is the PlayCall made on sample i */
+	uint64_t *labels() const;
+};
+
+/* True if the file at path starts like a feature cache. */
+bool isFeatureCache(const std::string &path);
+
+/* Writes a cache. features holds numFeatures values per sample, as above.
+ * Throws std::runtime_error if the file can't be written. */
+void writeFeatureCache(const std::string &path, uint32_t numFeatures,
+		const std::vector<double> &features, const std::vector<uint64_t> &labels);
+
+#endif
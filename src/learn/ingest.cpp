@@ -0,0 +1,395 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../engine/playcall.h"
+#include "features.h"
+#include "learn.h"
+
+/* Raw files are split into chunks of about this many bytes, which are parsed
+ * in parallel. */
+static const size_t CHUNK_BYTES = 8 << 20;
+
+/* Columns of the raw play by play we read, by their names in the header. */
+enum Column {
+	PLAY_TYPE,
+	PASS_LENGTH,
+	QUARTER,
+	QUARTER_SECONDS,
+	DOWN,
+	DISTANCE,
+	YARDS_TO_GOAL,
+	SCORE_MARGIN,
+	OFFENSE_TIMEOUTS,
+	DEFENSE_TIMEOUTS,
+	NUM_COLUMNS
+};
+
+static const char *const COLUMN_NAMES[NUM_COLUMNS] = {
+	"play_type",
+	"pass_length",
+	"qtr",
+	"quarter_seconds_remaining",
+	"down",
+	"ydstogo",
+	"yardline_100",
+	"score_differential",
+	"posteam_timeouts_remaining",
+	"defteam_timeouts_remaining"
+};
+
+/* Columns the extra features come from, in ExtraFeature order. */
+static const Column EXTRA_COLUMNS[NUM_EXTRA_FEATURES] = {
+	SCORE_MARGIN,
+	OFFENSE_TIMEOUTS,
+	DEFENSE_TIMEOUTS
+};
+
+/* A raw file mapped into memory, along with where its columns are. */
+struct RawFile {
+	std::string path;
+	const char *data;
+	size_t length;
+	/* field index of each Column, or -1 if the file doesn't have it */
+	int columns[NUM_COLUMNS];
+	/* number of fields we need to split off the front of each line */
+	int fieldsNeeded;
+};
+
+/* A piece of a raw file to parse, always starting and ending on a line. */
+struct Chunk {
+	const RawFile *file;
+	size_t begin;
+	size_t end;
+};
+
+/* Everything parsed out of one chunk. */
+struct ChunkResult {
+	std::vector<double> features;
+	std::vector<uint64_t> labels;
+	size_t skipped;
+};
+
+/**
+ * Splits line into its first n fields, handling quoted fields (which may hold
+ * commas). Quotes are left on, since we only care about numbers and a few
+ * short keywords. Returns false if the line has fewer than n fields.
+ */
+static bool splitFields(std::string_view line, int n, std::vector<std::string_view> &fields) {
+	fields.clear();
+	size_t start = 0;
+	bool quoted = false;
+
+	for (size_t i = 0; i <= line.size() && static_cast<int>(fields.size()) < n; i++) {
+		if (i < line.size() && line[i] == '"') {
+			quoted = !quoted;
+		} else if (i == line.size() || (line[i] == ',' && !quoted)) {
+			fields.push_back(line.substr(start, i - start));
+			start = i + 1;
+		}
+	}
+
+	return static_cast<int>(fields.size()) == n;
+}
+
+static std::string_view unquote(std::string_view field) {
+	if (field.size() >= 2 && field.front() == '"' && field.back() == '"')
+		return field.substr(1, field.size() - 2);
+	return field;
+}
+
+/* Parses a whole field as a number. "NA" and empty fields fail. */
+static bool parseNumber(std::string_view field, double &value) {
+	field = unquote(field);
+	const char *end = field.data() + field.size();
+	std::from_chars_result res = std::from_chars(field.data(), end, value);
+	return res.ec == std::errc() && res.ptr == end;
+}
+
+/**
+ * Works out which playcall a snap was. Only runs and passes with a known
+ * length count; everything else (kicks, kneels, spikes, sacks, penalties) is
+ * thrown out.
+ */
+static bool parseLabel(std::string_view playType, std::string_view passLength, PlayCall &call) {
+	playType = unquote(playType);
+	passLength = unquote(passLength);
+
+	if (playType == "run") {
+		call = RUN;
+	} else if (playType == "pass" && passLength == "short") {
+		call = SHORT_PASS;
+	} else if (playType == "pass" && passLength == "deep") {
+		call = LONG_PASS;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Parses one line of play by play into features, in the same units the
+ * engine's Situation uses. Returns false if the line isn't an offensive snap we
+ * can use.
+ */
+static bool parseSnap(const RawFile &file, const std::vector<std::string_view> &fields,
+		bool extras, double *features, PlayCall &call) {
+	const int *col = file.columns;
+	if (!parseLabel(fields[col[PLAY_TYPE]], fields[col[PASS_LENGTH]], call))
+		return false;
+
+	double quarter, seconds, down, distance, toGoal;
+	if (!parseNumber(fields[col[QUARTER]], quarter)
+			|| !parseNumber(fields[col[QUARTER_SECONDS]], seconds)
+			|| !parseNumber(fields[col[DOWN]], down)
+			|| !parseNumber(fields[col[DISTANCE]], distance)
+			|| !parseNumber(fields[col[YARDS_TO_GOAL]], toGoal))
+		return false;
+
+	if (down < 1 || down > 4)
+		return false;
+
+	int secondsLeft = static_cast<int>(seconds);
+	features[FEATURE_QUARTER] = quarter;
+	features[FEATURE_MINUTES] = secondsLeft / 60;
+	features[FEATURE_SECONDS] = secondsLeft % 60;
+	features[FEATURE_DOWN] = down;
+	features[FEATURE_DISTANCE] = distance;
+	// the engine measures field position from the offense's own goal line
+	features[FEATURE_FIELD_POS] = 100 - toGoal;
+
+	if (extras) {
+		for (int i = 0; i < NUM_EXTRA_FEATURES; i++) {
+			if (!parseNumber(fields[col[EXTRA_COLUMNS[i]]], features[NUM_BASE_FEATURES + i]))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void parseChunk(const Chunk &chunk, bool extras, ChunkResult &result) {
+	const RawFile &file = *chunk.file;
+	const size_t numFeatures = NUM_BASE_FEATURES + (extras ? NUM_EXTRA_FEATURES : 0);
+	std::vector<std::string_view> fields;
+	double features[MAX_FEATURES];
+	result.skipped = 0;
+
+	size_t pos = chunk.begin;
+	while (pos < chunk.end) {
+		const char *nl = static_cast<const char *>(memchr(file.data + pos, '\n', chunk.end - pos));
+		size_t lineEnd = nl ? nl - file.data : chunk.end;
+		std::string_view line(file.data + pos, lineEnd - pos);
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+		pos = lineEnd + 1;
+
+		PlayCall call;
+		if (line.empty())
+			continue;
+		if (!splitFields(line, file.fieldsNeeded, fields)
+				|| !parseSnap(file, fields, extras, features, call)) {
+			result.skipped++;
+			continue;
+		}
+
+		result.features.insert(result.features.end(), features, features + numFeatures);
+		result.labels.push_back(call);
+	}
+}
+
+/**
+ * Maps a raw file and finds its columns from the header. Throws
+ * std::runtime_error if the file can't be read or is missing a column we need.
+ */
+static void openRawFile(const std::string &path, bool extras, RawFile &file) {
+	file.path = path;
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("could not open " + path);
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		throw std::runtime_error(path + " is empty");
+	}
+
+	file.length = st.st_size;
+	void *map = mmap(nullptr, file.length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		throw std::runtime_error("could not map " + path);
+	madvise(map, file.length, MADV_SEQUENTIAL);
+	file.data = static_cast<const char *>(map);
+
+	const char *nl = static_cast<const char *>(memchr(file.data, '\n', file.length));
+	std::string_view header(file.data, nl ? nl - file.data : file.length);
+	if (!header.empty() && header.back() == '\r')
+		header.remove_suffix(1);
+
+	std::vector<std::string_view> names;
+	splitFields(header, std::count(header.begin(), header.end(), ',') + 1, names);
+
+	file.fieldsNeeded = 0;
+	for (int c = 0; c < NUM_COLUMNS; c++) {
+		auto it = std::find(names.begin(), names.end(), COLUMN_NAMES[c]);
+		if (it == names.end()) {
+			auto quotedName = std::string("\"") + COLUMN_NAMES[c] + "\"";
+			it = std::find(names.begin(), names.end(), quotedName);
+		}
+
+		file.columns[c] = it == names.end() ? -1 : it - names.begin();
+		// the columns for extra features come last, and are only needed
+		// when they were asked for
+		bool needed = c < SCORE_MARGIN || extras;
+		if (needed && file.columns[c] < 0)
+			throw std::runtime_error(path + " has no " + COLUMN_NAMES[c] + " column");
+		if (needed)
+			file.fieldsNeeded = std::max(file.fieldsNeeded, file.columns[c] + 1);
+	}
+}
+
+/* Splits the body of file (everything after the header) into chunks. */
+static void splitChunks(const RawFile &file, std::vector<Chunk> &chunks) {
+	const char *nl = static_cast<const char *>(memchr(file.data, '\n', file.length));
+	size_t pos = nl ? nl - file.data + 1 : file.length;
+
+	while (pos < file.length) {
+		size_t end = std::min(pos + CHUNK_BYTES, file.length);
+		if (end < file.length) {
+			nl = static_cast<const char *>(memchr(file.data + end, '\n', file.length - end));
+			end = nl ? nl - file.data + 1 : file.length;
+		}
+
+		chunks.push_back({ &file, pos, end });
+		pos = end;
+	}
+}
+
+static void printUsage(const char *name) {
+	std::cerr << "Usage: " << name << " [options] FILE...\n"
+		<< "Turns raw play by play CSV files into a feature cache for playcall-train.\n\n"
+		<< "  -o, --output FILE   where to write the cache (default " FEATURE_CACHE_FILENAME ")\n"
+		<< "  -j, --threads N     number of threads to parse with (default: all cores)\n"
+		<< "  -x, --extras        also store score margin and timeouts left\n"
+		<< "  -h, --help          show this message\n";
+}
+
+/**
+ * Ingests seasons of public play by play data (e.g. nflfastR's CSVs, one per
+ * season) for training the playcall model.
+ *
+ * Every file is mapped and cut into chunks on line boundaries, and the chunks
+ * are parsed in parallel. Only runs and passes with a known length on downs
+ * one through four are kept. The results are written, in file order, to a
+ * feature cache that playcall-train can map directly.
+ *
+ * Fields with embedded newlines aren't supported, since chunks are split on
+ * newlines. The play by play files we know of don't have any.
+ */
+int main(int argc, char *argv[]) {
+	static const struct option longOpts[] = {
+		{ "output", required_argument, nullptr, 'o' },
+		{ "threads", required_argument, nullptr, 'j' },
+		{ "extras", no_argument, nullptr, 'x' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+
+	std::string output = FEATURE_CACHE_FILENAME;
+	unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	bool extras = false;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "o:j:xh", longOpts, nullptr)) != -1) {
+		switch (c) {
+		case 'o':
+			output = optarg;
+			break;
+		case 'j':
+			numThreads = std::max(1ul, std::strtoul(optarg, nullptr, 10));
+			break;
+		case 'x':
+			extras = true;
+			break;
+		case 'h':
+		default:
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	std::vector<RawFile> files(argc - optind);
+	std::vector<Chunk> chunks;
+	try {
+		for (size_t i = 0; i < files.size(); i++)
+			openRawFile(argv[optind + i], extras, files[i]);
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+	for (const RawFile &file : files)
+		splitChunks(file, chunks);
+
+	std::vector<ChunkResult> results(chunks.size());
+	std::atomic<size_t> nextChunk(0);
+	auto worker = [&]() {
+		size_t i;
+		while ((i = nextChunk.fetch_add(1)) < chunks.size())
+			parseChunk(chunks[i], extras, results[i]);
+	};
+
+	std::vector<std::thread> threads;
+	numThreads = std::min<size_t>(numThreads, std::max<size_t>(chunks.size(), 1));
+	for (unsigned int t = 1; t < numThreads; t++)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread &t : threads)
+		t.join();
+
+	std::vector<double> features;
+	std::vector<uint64_t> labels;
+	size_t skipped = 0;
+	for (ChunkResult &res : results) {
+		features.insert(features.end(), res.features.begin(), res.features.end());
+		labels.insert(labels.end(), res.labels.begin(), res.labels.end());
+		skipped += res.skipped;
+	}
+
+	for (const RawFile &file : files)
+		munmap(const_cast<char *>(file.data), file.length);
+
+	uint32_t numFeatures = NUM_BASE_FEATURES + (extras ? NUM_EXTRA_FEATURES : 0);
+	try {
+		writeFeatureCache(output, numFeatures, features, labels);
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+
+	std::cout << labels.size() << " snaps from " << files.size() << " files ("
+		<< skipped << " lines skipped), " << numFeatures << " features, written to "
+		<< output << std::endl;
+
+	return 0;
+}
@@ -3,5 +3,6 @@
 
 #define MODEL_FILENAME "playcall-model.bin"
 #define MODEL_NAME "Playcall Model"
+#define FEATURE_CACHE_FILENAME "playcall-features.bin"
 
 #endif
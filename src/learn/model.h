@@ -1,11 +1,61 @@
 #ifndef __DATA_MODEL_H
 #define __DATA_MODEL_H
 
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include "../engine/playcall.h"
+#include "../engine/utils.h"
+#include "learn.h"
+
+/* A trained playcall model. Only classify.cpp knows what's inside. Once
+ * loaded, a model is never modified, so it can be shared between threads.
+ */
+class PlaycallModel;
+
+/* Loads a model from file. Throws std::runtime_error if it can't be loaded. */
+std::shared_ptr<const PlaycallModel> loadModel(const std::string &filename = MODEL_FILENAME);
+
+/**
+ * Loads models the first time they're asked for, and hands out shared,
+ * read-only references after that. However many teams, games and threads use
+ * a model, there is only ever one copy of it in memory. Safe to use from any
+ * number of threads; a model that's still being loaded by one thread is waited
+ * on by the others rather than loaded twice.
+ */
+class ModelCache {
+private:
+	std::mutex lock;
+	std::map<std::string, std::shared_future<std::shared_ptr<const PlaycallModel>>> models;
+
+public:
+	/* Returns the model saved in filename, loading it if this is the first
+	 * time it's been asked for. Throws std::runtime_error if it can't be
+	 * loaded. */
+	std::shared_ptr<const PlaycallModel> get(const std::string &filename);
+	/* Loads all of the given models in parallel, so that nobody has to wait
+	 * for them later. Throws std::runtime_error if any can't be loaded. */
+	void preload(const std::vector<std::string> &filenames);
+	/* Number of models loaded or being loaded. */
+	size_t size();
+
+	/* The cache for the whole process, which contexts use unless given one
+	 * of their own. */
+	static std::shared_ptr<ModelCache> shared();
+};
+
+/* Uses the AI model to call plays based on situation. The play is sampled from
+ * the model's probabilities using rng. */
+PlayCall getPlayCall(const PlaycallModel &model, Situation *sit, Random &rng);
 
-/* Uses the AI model to call plays based on situation */
-PlayCall getPlayCall(Situation *sit);
-/* Loads the model file. Must be called before any calls to getPlaycall() */
-void initModel();
+/* Same as getPlayCall() for n situations at once, call i being sampled with
+ * *rngs[i]. Asking the model once for a whole batch is a lot cheaper than
+ * asking it n times. */
+void getPlayCalls(const PlaycallModel &model, Situation *const *sits, Random *const *rngs,
+		PlayCall *calls, size_t n);
 
 #endif
@@ -0,0 +1,71 @@
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include "model.h"
+
+std::shared_ptr<const PlaycallModel> ModelCache::get(const std::string &filename) {
+	std::promise<std::shared_ptr<const PlaycallModel>> loaded;
+	std::shared_future<std::shared_ptr<const PlaycallModel>> model;
+	bool loader = false;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = models.find(filename);
+		if (it != models.end()) {
+			model = it->second;
+		} else {
+			model = loaded.get_future().share();
+			models.emplace(filename, model);
+			loader = true;
+		}
+	}
+
+	// Load outside the lock, so that other models can be loaded (and loaded
+	// ones handed out) in the meantime.
+	if (loader) {
+		try {
+			loaded.set_value(loadModel(filename));
+		} catch (...) {
+			loaded.set_exception(std::current_exception());
+			// don't remember the failure, in case the file shows up later
+			std::lock_guard<std::mutex> guard(lock);
+			models.erase(filename);
+		}
+	}
+
+	return model.get();
+}
+
+void ModelCache::preload(const std::vector<std::string> &filenames) {
+	std::vector<std::thread> threads;
+	std::vector<std::exception_ptr> errors(filenames.size());
+
+	for (size_t i = 0; i < filenames.size(); i++) {
+		threads.emplace_back([this, &filenames, &errors, i] {
+			try {
+				get(filenames[i]);
+			} catch (...) {
+				errors[i] = std::current_exception();
+			}
+		});
+	}
+
+	for (std::thread &t : threads)
+		t.join();
+	for (std::exception_ptr &e : errors) {
+		if (e)
+			std::rethrow_exception(e);
+	}
+}
+
+size_t ModelCache::size() {
+	std::lock_guard<std::mutex> guard(lock);
+	return models.size();
+}
+
+std::shared_ptr<ModelCache> ModelCache::shared() {
+	// made on first use, so contexts made during static initialization get it too
+	static std::shared_ptr<ModelCache> cache = std::make_shared<ModelCache>();
+	return cache;
+}
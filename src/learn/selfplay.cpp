@@ -0,0 +1,389 @@
+#include <mlpack/core/data/save.hpp>
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../engine/context.h"
+#include "../engine/game.h"
+#include "../engine/observers.h"
+#include "../engine/team.h"
+#include "../engine/utils.h"
+#include "features.h"
+#include "learn.h"
+#include "softmax.h"
+
+using namespace mlpack;
+using namespace mlpack::regression;
+
+/* Rough worth of the parts of a play's outcome, in points, for scoring how
+ * good a call turned out to be. */
+static const double YARD_VALUE = 0.07;
+static const double FIRST_DOWN_VALUE = 0.5;
+static const double TOUCHDOWN_VALUE = 7.0;
+static const double TURNOVER_VALUE = -4.0;
+
+/* How quickly the baseline follows the average value of a batch. */
+static const double BASELINE_RATE = 0.05;
+
+/* Most games' worth of samples waiting for the trainer before the simulation
+ * workers have to wait for it. */
+static const size_t QUEUE_GAMES = 64;
+
+/* A single offensive snap: the situation, what was called, and how it went. */
+struct Sample {
+	double features[NUM_BASE_FEATURES];
+	PlayCall call;
+	double value;
+};
+
+/**
+ * A fixed size queue between threads. Pushing blocks while it's full, and
+ * popping while it's empty, until the queue is closed.
+ */
+template <class T>
+class BoundedQueue {
+private:
+	std::deque<T> items;
+	size_t capacity;
+	bool closed;
+	std::mutex lock;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+	/* Returns false, dropping item, if the queue has been closed. */
+	bool push(T &&item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notFull.wait(guard, [this] { return closed || items.size() < capacity; });
+		if (closed)
+			return false;
+
+		items.push_back(std::move(item));
+		notEmpty.notify_one();
+		return true;
+	}
+
+	/* Returns false once the queue is closed and everything has been popped. */
+	bool pop(T &item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notEmpty.wait(guard, [this] { return closed || !items.empty(); });
+		if (items.empty())
+			return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		notFull.notify_all();
+		notEmpty.notify_all();
+	}
+};
+
+/* How good an outcome was for the offense, given how far they needed to go. */
+static double outcomeValue(const PlayOutcome &outcome, int distance) {
+	if (outcome.changePoss)
+		return outcome.touchdown ? TURNOVER_VALUE - TOUCHDOWN_VALUE : TURNOVER_VALUE;
+	if (outcome.touchdown)
+		return TOUCHDOWN_VALUE;
+
+	double value = outcome.yardsGained * YARD_VALUE;
+	if (outcome.yardsGained >= distance)
+		value += FIRST_DOWN_VALUE;
+	return value;
+}
+
+/* Collects a sample from every run or pass in a game. */
+class SampleCollector {
+private:
+	Sample pending;
+	int distance;
+	bool atSnap;
+
+public:
+	static constexpr unsigned int events = SNAP_EVENT | PLAY_EVENT;
+	std::vector<Sample> samples;
+
+	SampleCollector() : distance(0), atSnap(false) {}
+
+	void onGameEvent(GameEvent event, Game *game) {
+		if (event == SNAP_EVENT) {
+			situationFeatures(game->getSituation(), pending.features);
+			distance = game->getSituation()->distance;
+			atSnap = true;
+			return;
+		}
+
+		// kicks are decided by hand-written rules, not the model
+		PlayCall call = game->getLastOffenseCall();
+		if (!atSnap || call > LONG_PASS)
+			return;
+
+		atSnap = false;
+		pending.call = call;
+		pending.value = outcomeValue(*game->getLastOutcome(), distance);
+		samples.push_back(pending);
+	}
+};
+
+/**
+ * Improves the softmax weights by policy gradient: calls that did better than
+ * usual are made more likely in that situation, and calls that did worse less
+ * so. "Usual" is a running average of the value of recent samples.
+ */
+class PolicyTrainer {
+private:
+	arma::mat weights;
+	bool intercept;
+	double rate;
+	double lambda;
+	double baseline;
+
+public:
+	PolicyTrainer(const SoftmaxRegression &start, double rate)
+		: weights(start.Parameters())
+		, intercept(start.FitIntercept())
+		, rate(rate)
+		, lambda(start.Lambda())
+		, baseline(0) {}
+
+	/* One step of mini-batch gradient ascent. */
+	void update(const std::vector<Sample> &batch) {
+		arma::mat gradient(arma::size(weights), arma::fill::zeros);
+		arma::vec x(weights.n_cols);
+		double total = 0;
+
+		for (const Sample &s : batch) {
+			size_t first = intercept ? 1 : 0;
+			if (intercept)
+				x[0] = 1;
+			for (size_t f = 0; f < NUM_BASE_FEATURES; f++)
+				x[first + f] = s.features[f];
+
+			arma::vec scores = weights * x;
+			arma::vec probs = arma::exp(scores - scores.max());
+			probs /= arma::accu(probs);
+
+			// gradient of log probability of the call, weighted by how much
+			// better than usual it went
+			double advantage = s.value - baseline;
+			for (size_t k = 0; k < weights.n_rows; k++) {
+				double indicator = static_cast<size_t>(s.call) == k ? 1 : 0;
+				gradient.row(k) += advantage * (indicator - probs[k]) * x.t();
+			}
+			total += s.value;
+		}
+
+		weights += rate * (gradient / batch.size() - lambda * weights);
+		baseline += BASELINE_RATE * (total / batch.size() - baseline);
+	}
+
+	const arma::mat &getWeights() const { return weights; }
+	double getBaseline() const { return baseline; }
+};
+
+struct SelfPlayOptions {
+	uint64_t seed;
+	uint64_t numGames;
+	unsigned int numThreads;
+	size_t batchSize;
+	unsigned int publishInterval;
+	double rate;
+	std::string input;
+	std::string output;
+};
+
+static void printUsage(const char *name) {
+	std::cerr << "Usage: " << name << " [options]\n"
+		<< "Improves a playcall model by having it play against itself.\n\n"
+		<< "  -n, --games N       number of games to simulate (default 10000)\n"
+		<< "  -j, --threads N     simulation threads (default: all cores but one)\n"
+		<< "  -s, --seed N        seed for the simulated games (default: time)\n"
+		<< "  -b, --batch N       snaps per gradient step (default 256)\n"
+		<< "  -p, --publish N     gradient steps between handing the simulation\n"
+		<< "                      new weights (default 16)\n"
+		<< "  -r, --rate X        learning rate (default 1e-5)\n"
+		<< "  -m, --model FILE    model to start from (default " MODEL_FILENAME ")\n"
+		<< "  -o, --output FILE   where to save the new model (default playcall-model-selfplay.bin)\n"
+		<< "  -h, --help          show this message\n";
+}
+
+static bool parseOptions(int argc, char *argv[], SelfPlayOptions &opts) {
+	static const struct option longOpts[] = {
+		{ "games", required_argument, nullptr, 'n' },
+		{ "threads", required_argument, nullptr, 'j' },
+		{ "seed", required_argument, nullptr, 's' },
+		{ "batch", required_argument, nullptr, 'b' },
+		{ "publish", required_argument, nullptr, 'p' },
+		{ "rate", required_argument, nullptr, 'r' },
+		{ "model", required_argument, nullptr, 'm' },
+		{ "output", required_argument, nullptr, 'o' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+
+	opts.seed = time(0);
+	opts.numGames = 10000;
+	unsigned int cores = std::thread::hardware_concurrency();
+	opts.numThreads = cores > 1 ? cores - 1 : 1;
+	opts.batchSize = 256;
+	opts.publishInterval = 16;
+	opts.rate = 1e-5;
+	opts.input = MODEL_FILENAME;
+	opts.output = "playcall-model-selfplay.bin";
+
+	int c;
+	while ((c = getopt_long(argc, argv, "n:j:s:b:p:r:m:o:h", longOpts, nullptr)) != -1) {
+		switch (c) {
+		case 'n':
+			opts.numGames = std::strtoull(optarg, nullptr, 10);
+			break;
+		case 'j':
+			opts.numThreads = std::strtoul(optarg, nullptr, 10);
+			break;
+		case 's':
+			opts.seed = std::strtoull(optarg, nullptr, 0);
+			break;
+		case 'b':
+			opts.batchSize = std::strtoull(optarg, nullptr, 10);
+			break;
+		case 'p':
+			opts.publishInterval = std::strtoul(optarg, nullptr, 10);
+			break;
+		case 'r':
+			opts.rate = std::strtod(optarg, nullptr);
+			break;
+		case 'm':
+			opts.input = optarg;
+			break;
+		case 'o':
+			opts.output = optarg;
+			break;
+		case 'h':
+		default:
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+
+	if (opts.numThreads == 0 || opts.batchSize == 0 || opts.publishInterval == 0) {
+		std::cerr << "Threads, batch size, and publish interval must be positive\n";
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Self-play training. Simulation workers play games with the latest published
+ * model and stream the snaps into a bounded queue, while this thread pulls
+ * them off in mini-batches and updates the weights. Every so often the new
+ * weights are published, and each worker picks them up at the start of its
+ * next game, so simulation and training overlap instead of taking turns.
+ *
+ * The games are determined by the seed, but which weights each one is played
+ * with depends on timing, so runs aren't exactly reproducible.
+ */
+int main(int argc, char *argv[]) {
+	SelfPlayOptions opts;
+	if (!parseOptions(argc, argv, opts))
+		return 1;
+
+	std::shared_ptr<const PlaycallModel> current;
+	try {
+		current = loadModel(opts.input);
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	std::atomic<std::shared_ptr<const PlaycallModel>> published(current);
+	BoundedQueue<std::vector<Sample>> queue(QUEUE_GAMES);
+	std::atomic<uint64_t> nextGame(0);
+	std::atomic<unsigned int> running(opts.numThreads);
+
+	auto worker = [&]() {
+		uint64_t index;
+		while ((index = nextGame.fetch_add(1)) < opts.numGames) {
+			EngineContext context(published.load(), 0);
+			AITeam home(context), away(context);
+			Game game(&context, &home, &away, deriveSeed(opts.seed, index));
+
+			SampleCollector collector;
+			ObservedGame<SampleCollector> observed(&game, collector);
+			observed.gameLoop();
+
+			if (!queue.push(std::move(collector.samples)))
+				break;
+		}
+
+		if (--running == 0)
+			queue.close();
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < opts.numThreads; t++)
+		threads.emplace_back(worker);
+
+	PolicyTrainer trainer(current->regression, opts.rate);
+	std::vector<Sample> batch, incoming;
+	uint64_t gamesSeen = 0, steps = 0;
+
+	auto publish = [&]() {
+		std::shared_ptr<PlaycallModel> next = std::make_shared<PlaycallModel>(*current);
+		next->regression.Parameters() = trainer.getWeights();
+		current = next;
+		published.store(current);
+		std::cerr << gamesSeen << " games, " << steps << " steps, baseline "
+			<< trainer.getBaseline() << '\n';
+	};
+
+	while (queue.pop(incoming)) {
+		gamesSeen++;
+		for (const Sample &s : incoming) {
+			batch.push_back(s);
+			if (batch.size() < opts.batchSize)
+				continue;
+
+			trainer.update(batch);
+			batch.clear();
+			if (++steps % opts.publishInterval == 0)
+				publish();
+		}
+	}
+
+	for (std::thread &t : threads)
+		t.join();
+
+	if (!batch.empty()) {
+		trainer.update(batch);
+		steps++;
+	}
+	publish();
+
+	if (!data::Save(opts.output, MODEL_NAME, current->regression)) {
+		std::cerr << "could not save model to " << opts.output << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef __DATA_SOFTMAX_H
+#define __DATA_SOFTMAX_H
+
+#include <mlpack/methods/softmax_regression/softmax_regression.hpp>
+
+#include "../engine/game.h"
+#include "model.h"
+
+/* What's inside a PlaycallModel. Only for code in learn/ that needs to train
+ * or modify models; everything else should stick to model.h.
+ */
+class PlaycallModel {
+public:
+	mlpack::regression::SoftmaxRegression regression;
+};
+
+/* Fills in the NUM_BASE_FEATURES features the model sees for sit, in the
+ * order given in features.h.
+ */
+void situationFeatures(Situation *sit, double *features);
+
+#endif
@@ -5,7 +5,9 @@
 #include <mlpack/methods/softmax_regression/softmax_regression.hpp>
 
 #include <iostream>
+#include <stdexcept>
 
+#include "features.h"
 #include "learn.h"
 
 using namespace mlpack;
@@ -21,7 +23,47 @@ using namespace mlpack::regression;
 constexpr int LAMBDA = 100;
 
 /**
- * Trains a play calling model from play by play data from 2019 season.
+ * Splits a feature cache written by playcall-ingest into training and
+ * validation sets. The cache is mapped rather than read, and Armadillo works
+ * straight off the mapping. Only the features loadDataVector() fills in are
+ * trained on, whatever extras the cache has.
+ */
+static void loadFeatureCache(const char *path, arma::mat &trainX, arma::mat &validX,
+		arma::Row<size_t> &trainY, arma::Row<size_t> &validY) {
+	static_assert(sizeof(size_t) == sizeof(uint64_t), "labels are stored as 64 bit");
+
+	FeatureCache cache(path);
+	arma::mat features(cache.features(), cache.numFeatures(), cache.numSamples(), false, true);
+	arma::Row<size_t> labels(reinterpret_cast<size_t *>(cache.labels()), cache.numSamples(),
+			false, true);
+
+	if (cache.numFeatures() > NUM_BASE_FEATURES) {
+		arma::mat base = features.rows(0, NUM_BASE_FEATURES - 1);
+		data::Split(base, labels, trainX, validX, trainY, validY, 0.3);
+	} else {
+		data::Split(features, labels, trainX, validX, trainY, validY, 0.3);
+	}
+}
+
+/* Splits the CSV training set, whose last column is the label. */
+static void loadCSV(const char *path, arma::mat &trainX, arma::mat &validX,
+		arma::Row<size_t> &trainY, arma::Row<size_t> &validY) {
+	arma::mat dataset;
+	data::Load(path, dataset, true);
+
+    arma::mat train, valid;
+    data::Split(dataset, train, valid, 0.3);
+
+	trainX = train.submat(1, 0, train.n_rows - 1, train.n_cols - 1);
+	validX = valid.submat(1, 0, valid.n_rows - 1, valid.n_cols - 1);
+
+	trainY = arma::conv_to<arma::Row<size_t>>::from(train.row(train.n_rows - 1));
+	validY = arma::conv_to<arma::Row<size_t>>::from(valid.row(valid.n_rows - 1));
+}
+
+/**
+ * Trains a play calling model from play by play data: either the CSV from the
+ * 2019 season, or a feature cache made by playcall-ingest.
  *
  * Uses a logistic regression model, with three classes (run, short pass,
  * long pass).
@@ -30,20 +72,18 @@ constexpr int LAMBDA = 100;
  * for use by the main engine.
  */
 int main(int argc, char *argv[]) {
-	arma::mat dataset;
-	data::Load(argv[1], dataset, true);
-
-    arma::mat train, valid;
-    data::Split(dataset, train, valid, 0.3);
-
-	arma::mat trainX = train.submat(1, 0, train.n_rows - 1, train.n_cols - 1);
-	arma::mat validX = valid.submat(1, 0, valid.n_rows - 1, valid.n_cols - 1);
-
-	arma::Row<size_t> trainY = arma::conv_to<arma::Row<size_t>>::from(
-								train.row(train.n_rows - 1));
+	arma::mat trainX, validX;
+	arma::Row<size_t> trainY, validY;
 
-	arma::Row<size_t> validY = arma::conv_to<arma::Row<size_t>>::from(
-								valid.row(valid.n_rows - 1));
+	try {
+		if (isFeatureCache(argv[1]))
+			loadFeatureCache(argv[1], trainX, validX, trainY, validY);
+		else
+			loadCSV(argv[1], trainX, validX, trainY, validY);
+	} catch (const std::runtime_error &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
 
 	// Number of classes in the dataset.			
 	const size_t numClasses = arma::max(arma::max(trainY)) + 1;
@@ -3,189 +3,954 @@
  *
  * Basically a driver for testing the simulation engine. I'll remove this from
  * this folder once I feel like this can work as a standalone library.
+ *
+ * With no arguments, plays a single game with play by play commentary. Run
+ * with --help to see how to run large headless batches instead.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
+#include <fstream>
+#include <getopt.h>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <span>
 #include <string>
+#include <sys/resource.h>
+#include <vector>
 
+#include "engine/alloctrack.h"
+#include "engine/batch.h"
+#include "engine/context.h"
 #include "engine/game.h"
+#include "engine/observers.h"
+#include "engine/perfcounters.h"
 #include "engine/playcall.h"
+#include "engine/playlog.h"
+#include "engine/record.h"
+#include "engine/results.h"
+#include "engine/stats.h"
+#include "engine/trace.h"
 #include "engine/team.h"
 #include "learn/model.h"
 
 /*
- * Yes, I stole these from StackExchange. Why is it so goddamn complicated to
- * instantiate a simple map? I already know all of the possible values.
+ * Prints the outcome of each play.
  */
-template <typename T>
-struct map_init_helper {
-    T& data;
-    map_init_helper(T& d)
-        : data(d)
+class Commentator : public PlayByPlayObserver {
+public:
+    void notify(PlayOutcome* outcome)
     {
+        describeOutcome(std::cout, outcome->result, outcome->yardsGained,
+            outcome->touchdown, outcome->changePoss);
     }
-    map_init_helper& operator()(typename T::key_type const& key,
-        typename T::mapped_type const& value)
+
+    /* Lets this be attached to an ObservedGame. */
+    static constexpr unsigned int events = PLAY_EVENT;
+    void onGameEvent(GameEvent, Game* game)
     {
-        data[key] = value;
-        return *this;
+        notify(game->getLastOutcome());
     }
 };
 
-template <typename T>
-map_init_helper<T> map_init(T& item)
-{
-    return map_init_helper<T>(item);
-}
-
 /*
- * Prints the outcome of each play.
+ * Prints down, distance, yardline and time before each play.
  */
-class Commentator : public PlayByPlayObserver {
-    std::map<PlayResult, const char*> results;
-
+class ScoreboardOp : public SituationObserver {
 public:
-    Commentator()
+    void onSituationChange(Situation* sit)
     {
-        map_init(results)(COMPLETED_PASS, "Pass completed")(
-            INCOMPLETE_PASS, "Pass incomplete")(FUMBLE, "Fumble")(
-            INTERCEPTION, "Interception")(HANDOFF, "Run")(SACK, "Sacked")(
-            FIELD_GOAL_MADE, "Field goal is good!")(
-            FIELD_GOAL_MISS, "Field goal is missed")(PUNT_RETURN, "Punt");
+        describeSituation(std::cout, sit->down, sit->distance, sit->fieldPos,
+            sit->clock->getTicks(), sit->clock->getQuarter());
     }
 
-    void notify(PlayOutcome* outcome);
+    /* Lets this be attached to an ObservedGame. */
+    static constexpr unsigned int events = SNAP_EVENT;
+    void onGameEvent(GameEvent, Game* game)
+    {
+        onSituationChange(game->getSituation());
+    }
 };
 
+void printScore(double home, double away)
+{
+    std::cout << home << "-" << away << '\n';
+}
+
 /*
- * Prints down, distance, yardline and time before each play.
+ * Running totals for the summary output. Each worker thread keeps its own,
+ * and they are added together at the end.
  */
-class ScoreboardOp : public SituationObserver {
-    std::map<Down, const char*> downs;
+struct Totals {
+    size_t games = 0;
+    uint64_t plays = 0;
+    uint64_t homeScore = 0;
+    uint64_t awayScore = 0;
+    size_t homeWins = 0;
+    size_t awayWins = 0;
+    TeamStats home = {};
+    TeamStats away = {};
 
-public:
-    ScoreboardOp()
-    {
-        map_init(downs)(FIRST, "First down")(SECOND, "Second down")(
-            THIRD, "Third down")(FOURTH, "Fourth down");
+    void add(const GameResult& result);
+    void add(const Totals& other);
+};
+
+static void addStats(TeamStats& total, const TeamStats& stats)
+{
+    total.passingYards += stats.passingYards;
+    total.rushingYards += stats.rushingYards;
+    total.passingPlays += stats.passingPlays;
+    total.completions += stats.completions;
+    total.runningPlays += stats.runningPlays;
+    total.sacks += stats.sacks;
+    total.interceptions += stats.interceptions;
+    total.fumbles += stats.fumbles;
+}
+
+void Totals::add(const GameResult& result)
+{
+    games++;
+    plays += result.numPlays;
+    homeScore += result.homeScore;
+    awayScore += result.awayScore;
+    homeWins += result.homeScore > result.awayScore;
+    awayWins += result.awayScore > result.homeScore;
+    addStats(home, result.homeStats);
+    addStats(away, result.awayStats);
+}
+
+void Totals::add(const Totals& other)
+{
+    games += other.games;
+    plays += other.plays;
+    homeScore += other.homeScore;
+    awayScore += other.awayScore;
+    homeWins += other.homeWins;
+    awayWins += other.awayWins;
+    addStats(home, other.home);
+    addStats(away, other.away);
+}
+
+/*
+ * Prints the average score and stats over a batch.
+ */
+void printSummary(const Totals& totals)
+{
+    double n = totals.games;
+
+    printScore(totals.homeScore / n, totals.awayScore / n);
+    std::cout << "Wins: ";
+    printScore(totals.homeWins, totals.awayWins);
+    std::cout << "Passing Yards: ";
+    printScore(totals.home.passingYards / n, totals.away.passingYards / n);
+    std::cout << "Passing Attempts: ";
+    printScore(totals.home.passingPlays / n, totals.away.passingPlays / n);
+    std::cout << "Completions: ";
+    printScore(totals.home.completions / n, totals.away.completions / n);
+    std::cout << "Rushing Yards: ";
+    printScore(totals.home.rushingYards / n, totals.away.rushingYards / n);
+    std::cout << "Rushing Attempts: ";
+    printScore(totals.home.runningPlays / n, totals.away.runningPlays / n);
+}
+
+/*
+ * Writes one row per game, one column per field, tab separated.
+ */
+void writeColumns(std::ostream& out, const PackedResults& results)
+{
+    out << "seed\thome_score\taway_score\tplays"
+        << "\thome_pass_yds\thome_pass_att\thome_cmp\thome_rush_yds\thome_rush_att"
+        << "\thome_sacks\thome_int"
+        << "\taway_pass_yds\taway_pass_att\taway_cmp\taway_rush_yds\taway_rush_att"
+        << "\taway_sacks\taway_int\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        GameResult r = unpackResult(results[i]);
+        out << r.seed << '\t' << r.homeScore << '\t' << r.awayScore << '\t'
+            << r.numPlays;
+        for (const TeamStats* s : { &r.homeStats, &r.awayStats }) {
+            out << '\t' << s->passingYards << '\t' << s->passingPlays << '\t'
+                << s->completions << '\t' << s->rushingYards << '\t'
+                << s->runningPlays << '\t' << s->sacks << '\t'
+                << s->interceptions;
+        }
+        out << '\n';
     }
+}
+
+/* Number of games to play when only a stopping rule says when to stop. */
+static const size_t UNLIMITED_GAMES = size_t(1) << 48;
+/* Steps between the checkpoints of a game recorded for --replay. */
+static const unsigned int REPLAY_CHECKPOINT_INTERVAL = 32;
 
-    void onSituationChange(Situation* sit);
+enum OutputFormat { SUMMARY,
+    BINARY,
+    COLUMNS };
+
+/* Observers that can be turned on from the command line. */
+enum ObserverFlags { COMMENTATOR = 1,
+    SCOREBOARD = 2 };
+
+struct Options {
+    BatchConfig batch;
+    unsigned int observers;
+    OutputFormat format;
+    std::string output;
+    std::string rules;
+    std::string log;
+    /* game and range of plays to print from the log, rather than simulating */
+    bool show;
+    uint64_t showGame;
+    size_t firstPlay;
+    size_t lastPlay;
+    /* game to record and play back from the given step, rather than a batch */
+    bool replay;
+    uint64_t replayGame;
+    unsigned int replayStep;
+    /* home team to replay every game with, for a paired comparison */
+    bool compare;
+    TeamConfig compareHome;
+    std::string compareName;
+    /* where to write a trace of the batch, and every how many games to trace */
+    std::string trace;
+    unsigned int traceSample;
 };
 
-void Commentator::notify(PlayOutcome* outcome)
+void printUsage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  -n, --games N          number of games to simulate (default 1, or\n"
+              << "                         as many as it takes with the options below)\n"
+              << "  -j, --threads N        number of worker threads (default 1)\n"
+              << "  -s, --seed N           base seed for the batch (default: current time)\n"
+              << "      --win-ci W         stop once the 95% confidence interval on the\n"
+              << "                         home win rate is +/- W or narrower\n"
+              << "      --margin-ci M      stop once the interval on the average home\n"
+              << "                         margin is +/- M points or narrower\n"
+              << "  -t, --time-limit SECS  stop after SECS seconds\n"
+              << "  -I, --interleave       have each thread play its games 64 at a time,\n"
+              << "                         asking the model for their calls together\n"
+              << "                         (implies --headless)\n"
+              << "      --home TYPE        home team type: ai, ai:MODEL_FILE or user\n"
+              << "                         (default ai, which uses the default model)\n"
+              << "      --away TYPE        away team type, same as --home\n"
+              << "  -O, --observers LIST   comma separated list from: commentator,\n"
+              << "                         scoreboard, none (default commentator,scoreboard)\n"
+              << "  -q, --headless         same as --observers none\n"
+              << "  -f, --format FORMAT    summary, binary or columns (default summary)\n"
+              << "  -o, --output FILE      where to write binary or columns output\n"
+              << "                         (default stdout)\n"
+              << "  -r, --rules FILE       play outcome tables to use instead of the\n"
+              << "                         built in ones, e.g. from calibrate --tune\n"
+              << "  -L, --log FILE         log every play of every game to FILE (implies\n"
+              << "                         --headless)\n"
+              << "      --show N[:A[-B]]   print the play by play of game N (from 0) of\n"
+              << "                         the batch in the --log file, or only plays A\n"
+              << "                         to B (from 1), instead of simulating\n"
+              << "      --replay N[:STEP]  record game N (from 0) of the batch, then\n"
+              << "                         play it back from right before STEP (default\n"
+              << "                         0), starting at the nearest checkpoint\n"
+              << "      --compare TYPE     play every game again with TYPE as the home\n"
+              << "                         team, from the same seeds, and report how much\n"
+              << "                         the home margin and win rate change\n"
+              << "  -T, --trace FILE       write a Chrome trace of the batch to FILE, for\n"
+              << "                         Perfetto (needs a build with FB_TRACE)\n"
+              << "      --trace-sample N   only trace every Nth game (default 1)\n"
+              << "  -h, --help             show this message\n";
+}
+
+/* Parses "ai", "ai:MODEL_FILE" or "user". */
+static bool parseTeam(const char* arg, TeamConfig& team)
 {
-    if (outcome->touchdown) {
-        std::cout << "TOUCHDOWN! ";
+    std::string name(arg);
+    team.model.clear();
+    if (name == "ai") {
+        team.type = AI_TEAM;
+    } else if (name.rfind("ai:", 0) == 0 && name.size() > 3) {
+        team.type = AI_TEAM;
+        team.model = name.substr(3);
+    } else if (name == "user") {
+        team.type = USER_TEAM;
+    } else {
+        return false;
     }
 
-    if (outcome->changePoss) {
-        std::cout << "TURNOVER! ";
+    return true;
+}
+
+static bool parseObservers(const char* arg, unsigned int& observers)
+{
+    std::string list(arg);
+    observers = 0;
+
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string name = list.substr(start, end - start);
+
+        if (name == "commentator")
+            observers |= COMMENTATOR;
+        else if (name == "scoreboard")
+            observers |= SCOREBOARD;
+        else if (name != "none")
+            return false;
+
+        start = end + 1;
     }
 
-    std::cout << results[outcome->result];
-    std::cout << " for ";
-    std::cout << outcome->yardsGained;
-    std::cout << " yards\n";
+    return true;
 }
 
-void ScoreboardOp::onSituationChange(Situation* sit)
+/* Parses "N", "N:A" or "N:A-B". */
+static bool parseShow(const char* arg, Options& opts)
 {
-    std::cout << downs[sit->down];
-    std::cout << " and ";
-    std::cout << ((sit->fieldPos + sit->distance >= 100)
-            ? "goal"
-            : std::to_string(sit->distance));
-    std::cout << " from the ";
-    std::cout << sit->fieldPos;
-    std::cout << " yard line\n";
-    std::cout << sit->clock->ticksToTime() + " remaining in quarter ";
-    std::cout << sit->clock->getQuarter() << "\n";
+    char* end;
+    opts.show = true;
+    opts.showGame = std::strtoull(arg, &end, 10);
+    if (end == arg)
+        return false;
+    if (*end == '\0')
+        return true;
+    if (*end != ':')
+        return false;
+
+    const char* range = end + 1;
+    opts.firstPlay = std::strtoull(range, &end, 10);
+    opts.lastPlay = opts.firstPlay;
+    if (end != range && *end == '-') {
+        range = end + 1;
+        opts.lastPlay = std::strtoull(range, &end, 10);
+    }
+
+    return end != range && *end == '\0' && opts.firstPlay >= 1 && opts.lastPlay >= opts.firstPlay;
 }
 
-void printScore(double home, double away)
+/* Parses "N" or "N:STEP". */
+static bool parseReplay(const char* arg, Options& opts)
 {
-    std::cout << home << "-" << away << '\n';
+    char* end;
+    opts.replay = true;
+    opts.replayGame = std::strtoull(arg, &end, 10);
+    if (end == arg)
+        return false;
+    if (*end == '\0')
+        return true;
+    if (*end != ':')
+        return false;
+
+    const char* step = end + 1;
+    opts.replayStep = std::strtoul(step, &end, 10);
+    return end != step && *end == '\0';
+}
+
+/* Parses a positive number, e.g. a confidence interval's half width. */
+static bool parseLimit(const char* arg, double& limit)
+{
+    char* end;
+    limit = std::strtod(arg, &end);
+    return end != arg && *end == '\0' && limit > 0;
 }
 
-double average(unsigned int scores[], size_t len)
+static bool parseFormat(const char* arg, OutputFormat& format)
 {
-    unsigned int total = 0;
-    for (size_t i = 0; i < len; ++i)
-        total += scores[i];
+    std::string name(arg);
+    if (name == "summary")
+        format = SUMMARY;
+    else if (name == "binary")
+        format = BINARY;
+    else if (name == "columns")
+        format = COLUMNS;
+    else
+        return false;
 
-    return static_cast<double>(total) / static_cast<double>(len);
+    return true;
 }
 
-TeamStats* averageStats(TeamStats* stats[], size_t len)
+/*
+ * Fills in opts from the command line. Returns false, after printing what went
+ * wrong, if the arguments don't make sense.
+ */
+bool parseOptions(int argc, char* argv[], Options& opts)
 {
-    TeamStats* avg = new TeamStats();
-    int passAvg = 0;
-    int rushAvg = 0;
-    int attempts = 0;
-    int completions = 0;
-    int rushes = 0;
-    for (size_t i = 0; i < len; i++) {
-        passAvg += stats[i]->passingYards;
-        rushAvg += stats[i]->rushingYards;
-        attempts += stats[i]->passingPlays;
-        completions += stats[i]->completions;
-        rushes += stats[i]->runningPlays;
+    enum { HOME_OPT = 256,
+        AWAY_OPT,
+        SHOW_OPT,
+        REPLAY_OPT,
+        COMPARE_OPT,
+        WIN_CI_OPT,
+        MARGIN_CI_OPT,
+        TRACE_SAMPLE_OPT };
+    static const struct option longOpts[] = {
+        { "games", required_argument, nullptr, 'n' },
+        { "threads", required_argument, nullptr, 'j' },
+        { "seed", required_argument, nullptr, 's' },
+        { "win-ci", required_argument, nullptr, WIN_CI_OPT },
+        { "margin-ci", required_argument, nullptr, MARGIN_CI_OPT },
+        { "time-limit", required_argument, nullptr, 't' },
+        { "interleave", no_argument, nullptr, 'I' },
+        { "home", required_argument, nullptr, HOME_OPT },
+        { "away", required_argument, nullptr, AWAY_OPT },
+        { "observers", required_argument, nullptr, 'O' },
+        { "headless", no_argument, nullptr, 'q' },
+        { "format", required_argument, nullptr, 'f' },
+        { "output", required_argument, nullptr, 'o' },
+        { "rules", required_argument, nullptr, 'r' },
+        { "log", required_argument, nullptr, 'L' },
+        { "show", required_argument, nullptr, SHOW_OPT },
+        { "replay", required_argument, nullptr, REPLAY_OPT },
+        { "compare", required_argument, nullptr, COMPARE_OPT },
+        { "trace", required_argument, nullptr, 'T' },
+        { "trace-sample", required_argument, nullptr, TRACE_SAMPLE_OPT },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    opts.batch.seed = time(0);
+    opts.batch.numGames = 1;
+    opts.batch.numThreads = 1;
+    opts.batch.home.type = AI_TEAM;
+    opts.batch.away.type = AI_TEAM;
+    opts.observers = COMMENTATOR | SCOREBOARD;
+    opts.format = SUMMARY;
+    opts.show = false;
+    opts.firstPlay = 1;
+    opts.lastPlay = SIZE_MAX;
+    opts.replay = false;
+    opts.replayStep = 0;
+    opts.compare = false;
+    opts.compareHome.type = AI_TEAM;
+    opts.traceSample = 1;
+
+    int c;
+    bool ok = true;
+    bool gamesGiven = false;
+    while ((c = getopt_long(argc, argv, "n:j:s:t:IO:qf:o:r:L:T:h", longOpts, nullptr)) != -1) {
+        switch (c) {
+        case 'n':
+            opts.batch.numGames = std::strtoull(optarg, nullptr, 10);
+            gamesGiven = true;
+            break;
+        case 'j':
+            opts.batch.numThreads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 's':
+            opts.batch.seed = std::strtoull(optarg, nullptr, 0);
+            break;
+        case WIN_CI_OPT:
+            ok = parseLimit(optarg, opts.batch.stop.winRateHalfWidth);
+            break;
+        case MARGIN_CI_OPT:
+            ok = parseLimit(optarg, opts.batch.stop.marginHalfWidth);
+            break;
+        case 't':
+            ok = parseLimit(optarg, opts.batch.stop.timeLimit);
+            break;
+        case 'I':
+            opts.batch.interleave = true;
+            break;
+        case HOME_OPT:
+            ok = parseTeam(optarg, opts.batch.home);
+            break;
+        case AWAY_OPT:
+            ok = parseTeam(optarg, opts.batch.away);
+            break;
+        case 'O':
+            ok = parseObservers(optarg, opts.observers);
+            break;
+        case 'q':
+            opts.observers = 0;
+            break;
+        case 'f':
+            ok = parseFormat(optarg, opts.format);
+            break;
+        case 'o':
+            opts.output = optarg;
+            break;
+        case 'r':
+            opts.rules = optarg;
+            break;
+        case 'L':
+            opts.log = optarg;
+            break;
+        case SHOW_OPT:
+            ok = parseShow(optarg, opts);
+            break;
+        case REPLAY_OPT:
+            ok = parseReplay(optarg, opts);
+            break;
+        case COMPARE_OPT:
+            opts.compare = true;
+            opts.compareName = optarg;
+            ok = parseTeam(optarg, opts.compareHome);
+            break;
+        case 'T':
+            opts.trace = optarg;
+            break;
+        case TRACE_SAMPLE_OPT:
+            opts.traceSample = std::strtoul(optarg, nullptr, 10);
+            ok = opts.traceSample > 0;
+            break;
+        case 'h':
+        default:
+            printUsage(argv[0]);
+            return false;
+        }
+
+        if (!ok) {
+            std::cerr << "Invalid argument for " << argv[optind - 1] << ": " << optarg << '\n';
+            return false;
+        }
+    }
+
+    // With a stopping rule and no -n, play for as long as the rule says.
+    // Everything kept per game is sized up front, so that needs a summary.
+    const StoppingRule& stop = opts.batch.stop;
+    bool stopsEarly = stop.winRateHalfWidth > 0 || stop.marginHalfWidth > 0 || stop.timeLimit > 0;
+    if (stopsEarly && !gamesGiven) {
+        if (opts.format != SUMMARY || !opts.log.empty()) {
+            std::cerr << "Per game output and logs need -n, the most games to play\n";
+            return false;
+        }
+        opts.batch.numGames = UNLIMITED_GAMES;
+    }
+    if (stopsEarly && opts.compare) {
+        std::cerr << "--compare plays a fixed number of games (-n)\n";
+        return false;
+    }
+
+    if (opts.batch.numGames == 0 || opts.batch.numThreads == 0) {
+        std::cerr << "Need at least one game and one thread\n";
+        return false;
     }
 
-    avg->passingYards = passAvg / len;
-    avg->rushingYards = rushAvg / len;
-    avg->passingPlays = attempts / len;
-    avg->runningPlays = rushes / len;
-    avg->completions = completions / len;
+#ifndef FB_TRACE
+    if (!opts.trace.empty()) {
+        std::cerr << "--trace needs a build configured with -DFB_TRACE=ON\n";
+        return false;
+    }
+#endif
+
+    if (opts.show && opts.log.empty()) {
+        std::cerr << "--show needs the --log file to read the game from\n";
+        return false;
+    }
 
-    return avg;
+    // Observers print as they go, and a user needs the terminal to themself,
+    // so neither makes any sense with games running in parallel.
+    bool interactive = opts.batch.home.type == USER_TEAM || opts.batch.away.type == USER_TEAM;
+    if (opts.replay) {
+        if (interactive) {
+            std::cerr << "--replay plays the game twice, so only works between AI teams\n";
+            return false;
+        }
+        if (opts.show || opts.compare || opts.batch.interleave || !opts.log.empty()) {
+            std::cerr << "--replay plays a single game, and can't be combined with\n"
+                      << "--show, --compare, --interleave or --log\n";
+            return false;
+        }
+        return true;
+    }
+    if (opts.compare) {
+        if (interactive || opts.compareHome.type == USER_TEAM) {
+            std::cerr << "--compare replays every game, so only works between AI teams\n";
+            return false;
+        }
+        if (opts.format != SUMMARY || !opts.log.empty()) {
+            std::cerr << "--compare only prints a summary, and can't be logged\n";
+            return false;
+        }
+        opts.observers = 0;
+    }
+    if (opts.batch.interleave) {
+        if (interactive || !opts.log.empty()) {
+            std::cerr << "Interleaved games can't have user teams or be logged\n";
+            return false;
+        }
+        opts.observers = 0;
+    }
+    if (!opts.log.empty()) {
+        if (interactive) {
+            std::cerr << "User teams need play by play as they go, so can't be logged\n";
+            return false;
+        }
+        opts.observers = 0;
+    }
+    if ((opts.observers || interactive) && opts.batch.numThreads > 1) {
+        std::cerr << "Observers and user teams can only be used with a single thread\n";
+        return false;
+    }
+
+    return true;
 }
 
 /*
- * Run 1000 games and tell me the average score and stats.
+ * Picks the GameRunner with the requested observers compiled in. With no
+ * observers the play loop never touches iostreams.
  */
-int main()
-{
-    srand(time(0));
-    initModel();
-    Commentator* commentator = new Commentator();
-    ScoreboardOp* op = new ScoreboardOp();
-    size_t numTrials = 1;
-    unsigned int homeScores[numTrials];
-    unsigned int awayScores[numTrials];
-    TeamStats* homeStats[numTrials];
-    TeamStats* awayStats[numTrials];
-    for (size_t i = 0; i < numTrials; i++) {
-        Team* home = new AITeam();
-        Team* away = new AITeam();
-        Game* game = new Game(home, away);
-        game->registerPlayByPlayObs(commentator);
-        game->registerSitObserver(op);
-        game->gameLoop();
-        homeScores[i] = game->getHomeScore();
-        awayScores[i] = game->getAwayScore();
-        homeStats[i] = game->getHomeStats();
-        awayStats[i] = game->getAwayStats();
-        delete game;
-        delete home;
-        delete away;
-    }
-
-    printScore(average(homeScores, numTrials), average(awayScores, numTrials));
-    TeamStats* homeavg = averageStats(homeStats, numTrials);
-    TeamStats* awayavg = averageStats(awayStats, numTrials);
-    std::cout << "Passing Yards: ";
-    printScore(homeavg->passingYards, awayavg->passingYards);
-    std::cout << "Passing Attempts: ";
-    printScore(homeavg->passingPlays, awayavg->passingPlays);
-    std::cout << "Completions: ";
-    printScore(homeavg->completions, awayavg->completions);
-    std::cout << "Rushing Yards: ";
-    printScore(homeavg->rushingYards, awayavg->rushingYards);
-    std::cout << "Rushing Attempts:";
-    printScore(homeavg->runningPlays, awayavg->runningPlays);
+GameRunner makeRunner(unsigned int observers, Commentator& commentator,
+    ScoreboardOp& op)
+{
+    switch (observers) {
+    case COMMENTATOR | SCOREBOARD:
+        return [&](Game* game) {
+            ObservedGame<Commentator, ScoreboardOp> observed(game, commentator, op);
+            observed.gameLoop();
+        };
+    case COMMENTATOR:
+        return [&](Game* game) {
+            ObservedGame<Commentator> observed(game, commentator);
+            observed.gameLoop();
+        };
+    case SCOREBOARD:
+        return [&](Game* game) {
+            ObservedGame<ScoreboardOp> observed(game, op);
+            observed.gameLoop();
+        };
+    default:
+        return runHeadless;
+    }
+}
+
+/* The plays of the game a worker thread just ran, waiting for the ResultSink
+ * (which runs next, on the same thread) to write them to the log.
+ */
+static thread_local std::vector<LoggedPlay> loggedPlays;
+
+/* Runs a game with nothing attached but a PlayLogger. */
+void runLogged(Game* game)
+{
+    PlayLogger logger(loggedPlays);
+    ObservedGame<PlayLogger> observed(game, logger);
+    observed.gameLoop();
+}
+
+/*
+ * Prints plays from a logged game, without simulating anything.
+ */
+int showLoggedGame(const Options& opts)
+{
+    try {
+        PlayLog log(opts.log);
+        std::span<const LoggedPlay> plays = log.game(opts.showGame);
+        size_t first = std::min(opts.firstPlay - 1, plays.size());
+        size_t last = std::min(opts.lastPlay, plays.size());
+        renderPlays(std::cout, plays.subspan(first, last - first));
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Records a game of the batch with checkpoints, then seeks to a step of it and
+ * plays the rest out from there with the requested observers, the way a game
+ * record is meant to be used.
+ */
+int replayGame(const Options& opts, const EngineContext& context)
+{
+    uint64_t seed = deriveSeed(opts.batch.seed, opts.replayGame);
+
+    try {
+        GameRecord record = recordGame(context, seed, opts.batch.home, opts.batch.away,
+            REPLAY_CHECKPOINT_INTERVAL);
+        GameReplay replay(context, record);
+        Game* game = replay.seek(opts.replayStep);
+        std::cout << "Game " << opts.replayGame << " (seed " << seed << "), from step "
+                  << game->getStepCount() << " of " << record.numSteps << " at ";
+        printScore(game->getHomeScore(), game->getAwayScore());
+
+        Commentator commentator;
+        ScoreboardOp op;
+        makeRunner(opts.observers, commentator, op)(game);
+
+        std::cout << "Final: ";
+        printScore(game->getHomeScore(), game->getAwayScore());
+        if (game->getHomeScore() != record.homeScore || game->getAwayScore() != record.awayScore) {
+            std::cerr << "Replay came out differently from the recorded game\n";
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Writes out the trace, if there is one. Returns the exit status. */
+static int finishTrace(const Options& opts)
+{
+    if (opts.trace.empty())
+        return 0;
+
+    try {
+        size_t dropped = writeTrace(opts.trace);
+        if (dropped > 0)
+            std::cerr << "Trace ran out of room, " << dropped << " events dropped\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Peak resident set size of this process, in kilobytes. */
+long peakRSS()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/*
+ * Per worker sums for --compare, over pairs of games played from the same
+ * seed: first with the home team as given (run A), then with the --compare
+ * team (run B).
+ */
+struct PairedTotals {
+    uint64_t plays = 0;
+    Moments margin[2];
+    Moments marginDiff;
+    Moments winShare[2];
+    Moments winShareDiff;
+
+    void add(const PairedTotals& other)
+    {
+        plays += other.plays;
+        marginDiff.add(other.marginDiff);
+        winShareDiff.add(other.winShareDiff);
+        for (unsigned int run = 0; run < 2; run++) {
+            margin[run].add(other.margin[run]);
+            winShare[run].add(other.winShare[run]);
+        }
+    }
+};
+
+/* A win for the home team counts 1, a tie half. */
+static double winShare(int margin)
+{
+    return margin > 0 ? 1 : margin == 0 ? 0.5 : 0;
+}
+
+/*
+ * Prints a stat from both runs, and the difference B - A with its 95%
+ * confidence interval. Alongside is the interval the same number of games
+ * would have given with independent seeds for each run, which is what playing
+ * the pairs from the same seeds saves.
+ */
+void printPaired(const char* name, const Moments& a, const Moments& b, const Moments& diff)
+{
+    double n = diff.n;
+    double unpairedVar = a.variance() + b.variance();
+    std::cout << name << ": " << a.mean() << " -> " << b.mean()
+              << ", difference " << diff.mean() << " +/- " << diff.halfWidth()
+              << " (unpaired +/- " << Z_95 * std::sqrt(unpairedVar / n);
+    if (diff.variance() > 0)
+        std::cout << ", variance " << unpairedVar / diff.variance() << "x smaller";
+    std::cout << ")\n";
+}
+
+/*
+ * Plays the batch twice, the second time with the --compare team at home, and
+ * reports how the home team's results changed game by game. Game i is played
+ * from the same seed both times, and every snap draws from its own substreams
+ * of it, so wherever the two home teams make the same call, the play goes the
+ * same way, and the difference is down to the calls alone.
+ */
+int compareStrategies(const Options& opts)
+{
+    BatchConfig batch = opts.batch;
+    std::vector<int32_t> margins(batch.numGames);
+    std::vector<PairedTotals> totals(batch.numThreads);
+
+    auto start = std::chrono::steady_clock::now();
+    runBatch(batch, runHeadless, [&](unsigned int worker, size_t index, const GameResult& result) {
+        margins[index] = int(result.homeScore) - int(result.awayScore);
+        totals[worker].plays += result.numPlays;
+    });
+
+    batch.home = opts.compareHome;
+    runBatch(batch, runHeadless, [&](unsigned int worker, size_t index, const GameResult& result) {
+        PairedTotals& t = totals[worker];
+        int a = margins[index];
+        int b = int(result.homeScore) - int(result.awayScore);
+        t.plays += result.numPlays;
+        t.margin[0].add(a);
+        t.margin[1].add(b);
+        t.marginDiff.add(b - a);
+        t.winShare[0].add(winShare(a));
+        t.winShare[1].add(winShare(b));
+        t.winShareDiff.add(winShare(b) - winShare(a));
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    PairedTotals total;
+    for (const PairedTotals& t : totals)
+        total.add(t);
+
+    std::cout << "Home team replaced by " << opts.compareName << " in " << batch.numGames
+              << " games from the same seeds\n";
+    printPaired("Home margin", total.margin[0], total.margin[1], total.marginDiff);
+    printPaired("Home win rate", total.winShare[0], total.winShare[1], total.winShareDiff);
+
+    double secs = elapsed.count();
+    std::cerr << 2 * batch.numGames << " games, " << total.plays << " plays in "
+              << secs << " s (" << 2 * batch.numGames / secs << " games/s), peak RSS "
+              << peakRSS() << " KB\n";
+#ifdef FB_PERF
+    reportPerf(std::cerr);
+#endif
+#ifdef FB_ALLOC_TRACKING
+    reportAllocations(std::cerr, 2 * batch.numGames, total.plays);
+#endif
+
+    return finishTrace(opts);
+}
+
+/*
+ * Runs a batch of games, and reports the results in the requested format.
+ */
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseOptions(argc, argv, opts))
+        return 1;
+    if (opts.show)
+        return showLoggedGame(opts);
+
+    std::shared_ptr<const PlaycallModel> model;
+    try {
+        model = loadModel();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    EngineContext context(model, opts.batch.seed);
+    opts.batch.context = &context;
+
+    // Load the ruleset and the teams' own models now, rather than on the clock.
+    try {
+        if (!opts.rules.empty())
+            context.setRuleset(std::make_shared<const Ruleset>(loadRuleset(opts.rules)));
+        for (const TeamConfig* team : { &opts.batch.home, &opts.batch.away, &opts.compareHome }) {
+            if (team->type == AI_TEAM)
+                context.getModel(team->model);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    if (opts.replay)
+        return replayGame(opts, context);
+    if (!opts.trace.empty())
+        startTrace(opts.traceSample);
+    if (opts.compare)
+        return compareStrategies(opts);
+
+    Commentator commentator;
+    ScoreboardOp op;
+    GameRunner run = makeRunner(opts.observers, commentator, op);
+
+    std::unique_ptr<PlayLogWriter> log;
+    if (!opts.log.empty()) {
+        try {
+            log = std::make_unique<PlayLogWriter>(opts.log, opts.batch.numGames, opts.batch.numThreads);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        run = runLogged;
+    }
+
+    // Only keep every result around if we actually need to write them all
+    // out, otherwise each worker just keeps running totals. Binary results
+    // for a file are written straight into it.
+    bool keepResults = opts.format != SUMMARY;
+    std::unique_ptr<PackedResults> results;
+    try {
+        if (opts.format == BINARY && !opts.output.empty())
+            results = std::make_unique<PackedResults>(opts.output, opts.batch.numGames);
+        else
+            results = std::make_unique<PackedResults>(keepResults ? opts.batch.numGames : 0);
+        results->resize(results->capacity());
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::vector<Totals> totals(opts.batch.numThreads);
+
+    ResultSink sink = [&](unsigned int worker, size_t index, const GameResult& result) {
+        totals[worker].add(result);
+        if (keepResults)
+            (*results)[index] = packResult(result);
+        if (log)
+            log->add(worker, index, loggedPlays);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    size_t played = runBatch(opts.batch, run, sink);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (keepResults)
+        results->resize(played);
+
+    Totals total;
+    for (const Totals& t : totals)
+        total.add(t);
+
+    if (log) {
+        try {
+            log->truncate(played);
+            log->close();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    if (opts.format == SUMMARY) {
+        printSummary(total);
+    } else if (opts.format == BINARY && !opts.output.empty()) {
+        try {
+            results->close();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    } else if (opts.format == BINARY) {
+        writeResults(std::cout, *results);
+    } else {
+        std::ofstream file;
+        if (!opts.output.empty()) {
+            file.open(opts.output);
+            if (!file) {
+                std::cerr << "Could not open " << opts.output << '\n';
+                return 1;
+            }
+        }
+        writeColumns(opts.output.empty() ? std::cout : file, *results);
+    }
+
+    double secs = elapsed.count();
+    std::cerr << total.games << " games, " << total.plays << " plays in "
+              << secs << " s (" << total.games / secs << " games/s, "
+              << total.plays / secs << " plays/s), peak RSS "
+              << peakRSS() << " KB\n";
+#ifdef FB_PERF
+    reportPerf(std::cerr);
+#endif
+#ifdef FB_ALLOC_TRACKING
+    reportAllocations(std::cerr, total.games, total.plays);
+#endif
+
+    return finishTrace(opts);
 }
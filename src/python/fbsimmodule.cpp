@@ -0,0 +1,209 @@
+/**
+ * fbsimmodule.cpp
+ *
+ * Python bindings for fb-engine. Exposes a single batch simulation call, which
+ * runs with the GIL released and hands back its results as NumPy arrays that
+ * point straight at the engine's result buffers, so nothing is copied.
+ *
+ *     import fbsim
+ *     res = fbsim.simulate(seed=42, games=100000, threads=8)
+ *     res["home_score"].mean()
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "engine/batch.h"
+#include "engine/context.h"
+#include "learn/model.h"
+
+/* The model is loaded on first use, and kept for the life of the process. It
+ * is never written to after that, so simulations on other threads can share it.
+ */
+static std::once_flag modelLoaded;
+static std::shared_ptr<const PlaycallModel> model;
+
+static const char* CAPSULE_NAME = "fbsim.ResultColumns";
+
+static void freeColumns(PyObject* capsule)
+{
+    delete static_cast<ResultColumns*>(PyCapsule_GetPointer(capsule, CAPSULE_NAME));
+}
+
+/*
+ * Wraps one column in a read-only array. The array holds a reference to the
+ * capsule that owns the columns, so they live as long as any array does.
+ */
+static PyObject* viewColumn(PyObject* owner, void* data, npy_intp len, int type)
+{
+    PyObject* array = PyArray_SimpleNewFromData(1, &len, type, data);
+    if (!array)
+        return nullptr;
+
+    PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject*>(array), NPY_ARRAY_WRITEABLE);
+    Py_INCREF(owner);
+    if (PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(array), owner) < 0) {
+        Py_DECREF(array);
+        return nullptr;
+    }
+
+    return array;
+}
+
+/* Parses "ai" or "ai:MODEL_FILE", as the driver's --home and --away do. */
+static bool parseTeam(const char* name, TeamConfig& config)
+{
+    // User teams read from stdin, which makes no sense from Python.
+    std::string spec(name);
+    config.type = AI_TEAM;
+    config.model.clear();
+    if (spec == "ai")
+        return true;
+    if (spec.rfind("ai:", 0) == 0 && spec.size() > 3) {
+        config.model = spec.substr(3);
+        return true;
+    }
+
+    PyErr_Format(PyExc_ValueError, "unknown team type '%s'", name);
+    return false;
+}
+
+static PyObject* simulate(PyObject*, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = { "seed", "games", "home", "away", "threads",
+        "win_ci", "margin_ci", "time_limit", nullptr };
+
+    unsigned long long seed = 0;
+    Py_ssize_t games = 0;
+    const char* home = "ai";
+    const char* away = "ai";
+    unsigned int threads = 0;
+    StoppingRule stop;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Kn|ssIddd",
+            const_cast<char**>(keywords), &seed, &games, &home, &away, &threads,
+            &stop.winRateHalfWidth, &stop.marginHalfWidth, &stop.timeLimit))
+        return nullptr;
+
+    if (games < 0) {
+        PyErr_SetString(PyExc_ValueError, "games must not be negative");
+        return nullptr;
+    }
+
+    BatchConfig config;
+    config.seed = seed;
+    config.numGames = games;
+    config.numThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    config.stop = stop;
+    if (!parseTeam(home, config.home) || !parseTeam(away, config.away))
+        return nullptr;
+
+    // Load the models before letting go of the GIL, so a bad model file is
+    // reported before anything else runs.
+    std::unique_ptr<EngineContext> context;
+    try {
+        std::call_once(modelLoaded, [] { model = loadModel(); });
+        context = std::make_unique<EngineContext>(model, seed);
+        for (const TeamConfig* team : { &config.home, &config.away })
+            context->getModel(team->model);
+    } catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    config.context = context.get();
+
+    ResultColumns* results = new ResultColumns();
+    std::string error;
+
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        results->resize(games);
+        games = runBatch(config, runHeadless,
+            [results](unsigned int, size_t index, const GameResult& result) {
+                results->store(index, result);
+            });
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        delete results;
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return nullptr;
+    }
+
+    PyObject* owner = PyCapsule_New(results, CAPSULE_NAME, freeColumns);
+    if (!owner) {
+        delete results;
+        return nullptr;
+    }
+
+    PyObject* dict = PyDict_New();
+    if (!dict) {
+        Py_DECREF(owner);
+        return nullptr;
+    }
+
+    bool ok = true;
+    PyObject* seeds = viewColumn(owner, results->seeds.data(), games, NPY_UINT64);
+    ok = seeds && PyDict_SetItemString(dict, "seed", seeds) == 0;
+    Py_XDECREF(seeds);
+
+    for (int i = 0; ok && i < NUM_RESULT_COLUMNS; i++) {
+        PyObject* column = viewColumn(owner, results->columns[i].data(), games, NPY_INT32);
+        ok = column && PyDict_SetItemString(dict, RESULT_COLUMN_NAMES[i], column) == 0;
+        Py_XDECREF(column);
+    }
+
+    Py_DECREF(owner);
+    if (!ok) {
+        Py_DECREF(dict);
+        return nullptr;
+    }
+
+    return dict;
+}
+
+static PyMethodDef methods[] = {
+    { "simulate", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(simulate)),
+        METH_VARARGS | METH_KEYWORDS,
+        "simulate(seed, games, home='ai', away='ai', threads=0, win_ci=0,\n"
+        "         margin_ci=0, time_limit=0)\n\n"
+        "Simulates a batch of games, game i seeded from (seed, i) exactly as in\n"
+        "the driver. Either team can be 'ai', or 'ai:MODEL_FILE' to play with a\n"
+        "model of its own. Returns a dict of read-only NumPy arrays, one per\n"
+        "result column, with one entry per game. threads=0 uses one thread per\n"
+        "core. Stops early, after the first n games, once the 95% confidence\n"
+        "interval on the home win rate is +/- win_ci or narrower, the one on the\n"
+        "home margin +/- margin_ci, or after time_limit seconds (0 for no\n"
+        "limit)." },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT,
+    "fbsim",
+    "Batch football simulations backed by fb-engine.",
+    -1,
+    methods,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr
+};
+
+PyMODINIT_FUNC PyInit_fbsim(void)
+{
+    import_array();
+    return PyModule_Create(&module);
+}
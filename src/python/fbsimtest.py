@@ -0,0 +1,117 @@
+"""
+fbsimtest.py
+
+Checks the fbsim module against the driver. Run from the build directory, so
+the model file can be found, with fbsim on the PYTHONPATH and the driver's
+path as the only argument:
+
+    python3 fbsimtest.py ./driver
+
+ctest runs it that way in builds configured with -DFB_BUILD_PYTHON=ON.
+"""
+
+import gc
+import subprocess
+import sys
+import unittest
+
+import numpy as np
+
+import fbsim
+
+SEED = 42
+GAMES = 500
+# the default model, which the build directory has a copy of
+MODEL_FILENAME = "playcall-model.bin"
+
+# The driver's --format columns header, and the fbsim column each one is.
+DRIVER_COLUMNS = {
+    "seed": "seed",
+    "home_score": "home_score",
+    "away_score": "away_score",
+    "plays": "num_plays",
+    "home_pass_yds": "home_passing_yards",
+    "home_pass_att": "home_passing_plays",
+    "home_cmp": "home_completions",
+    "home_rush_yds": "home_rushing_yards",
+    "home_rush_att": "home_running_plays",
+    "home_sacks": "home_sacks",
+    "home_int": "home_interceptions",
+    "away_pass_yds": "away_passing_yards",
+    "away_pass_att": "away_passing_plays",
+    "away_cmp": "away_completions",
+    "away_rush_yds": "away_rushing_yards",
+    "away_rush_att": "away_running_plays",
+    "away_sacks": "away_sacks",
+    "away_int": "away_interceptions",
+}
+
+driver = None
+
+
+class SimulateTest(unittest.TestCase):
+    def test_arrays(self):
+        res = fbsim.simulate(seed=SEED, games=GAMES, threads=2)
+        self.assertIn("home_fumbles", res)
+        for name, column in res.items():
+            self.assertIsInstance(column, np.ndarray, name)
+            self.assertEqual(column.dtype, np.uint64 if name == "seed" else np.int32, name)
+            self.assertEqual(column.shape, (GAMES,), name)
+            self.assertFalse(column.flags.writeable, name)
+            with self.assertRaises(ValueError):
+                column[0] = 1
+
+    def test_same_seed(self):
+        a = fbsim.simulate(seed=SEED, games=GAMES, threads=1)
+        b = fbsim.simulate(seed=SEED, games=GAMES, threads=4)
+        self.assertEqual(a.keys(), b.keys())
+        for name in a:
+            np.testing.assert_array_equal(a[name], b[name], err_msg=name)
+
+        c = fbsim.simulate(seed=SEED + 1, games=GAMES, threads=1)
+        self.assertFalse(np.array_equal(a["seed"], c["seed"]))
+
+    def test_matches_driver(self):
+        out = subprocess.run(
+            [driver, "--headless", "--games", str(GAMES), "--seed", str(SEED),
+             "--format", "columns"],
+            check=True, capture_output=True, text=True).stdout
+        lines = out.splitlines()
+        header = lines[0].split("\t")
+        rows = [line.split("\t") for line in lines[1:]]
+        self.assertEqual(len(rows), GAMES)
+
+        res = fbsim.simulate(seed=SEED, games=GAMES, threads=2)
+        for i, name in enumerate(header):
+            expected = np.array([int(row[i]) for row in rows])
+            np.testing.assert_array_equal(res[DRIVER_COLUMNS[name]], expected, err_msg=name)
+
+    def test_team_models(self):
+        res = fbsim.simulate(seed=SEED, games=GAMES, threads=2)
+        own = fbsim.simulate(seed=SEED, games=GAMES, threads=2,
+                             home="ai:" + MODEL_FILENAME, away="ai:" + MODEL_FILENAME)
+        for name in res:
+            np.testing.assert_array_equal(res[name], own[name], err_msg=name)
+
+        with self.assertRaises(RuntimeError):
+            fbsim.simulate(seed=SEED, games=GAMES, home="ai:no-such-model.bin")
+        with self.assertRaises(ValueError):
+            fbsim.simulate(seed=SEED, games=GAMES, away="user")
+
+    def test_arrays_outlive_dict(self):
+        res = fbsim.simulate(seed=SEED, games=GAMES, threads=2)
+        scores = res["home_score"]
+        expected = scores.copy()
+        del res
+        gc.collect()
+
+        # Allocate over anything that was freed, then look again.
+        fbsim.simulate(seed=SEED + 1, games=GAMES, threads=2)
+        np.testing.assert_array_equal(scores, expected)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("usage: fbsimtest.py DRIVER")
+    driver = sys.argv.pop()
+    unittest.main()
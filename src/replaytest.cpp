@@ -0,0 +1,187 @@
+/**
+ * replaytest.cpp
+ *
+ * Checks that recorded games play back exactly. Records a number of games,
+ * round trips each record through writeRecord() and readRecord(), then seeks
+ * a GameReplay back and forth to steps in the middle of the game, comparing
+ * the state it lands in with a fresh game simply stepped that far from the
+ * same seed. Also checks that a truncated record doesn't read, and that a
+ * replay refuses a context with a different ruleset. Exits non-zero if
+ * anything doesn't match.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "engine/context.h"
+#include "engine/record.h"
+#include "engine/ruleset.h"
+#include "learn/model.h"
+
+static const uint64_t DEFAULT_GAMES = 200;
+static const unsigned int CHECKPOINT_INTERVAL = 10;
+
+static bool sameStats(const TeamStats& a, const TeamStats& b)
+{
+    return a.passingYards == b.passingYards && a.rushingYards == b.rushingYards
+        && a.passingPlays == b.passingPlays && a.completions == b.completions
+        && a.runningPlays == b.runningPlays && a.sacks == b.sacks
+        && a.interceptions == b.interceptions && a.fumbles == b.fumbles;
+}
+
+static bool sameState(const GameCheckpoint& a, const GameCheckpoint& b)
+{
+    return a.step == b.step && a.rngState.counter == b.rngState.counter
+        && a.rngState.diceCounter == b.rngState.diceCounter
+        && a.rngState.diceUsed == b.rngState.diceUsed && a.state == b.state
+        && a.homeOnOffense == b.homeOnOffense && a.down == b.down
+        && a.distance == b.distance && a.fieldPos == b.fieldPos
+        && a.quarter == b.quarter && a.ticks == b.ticks
+        && a.homeScore == b.homeScore && a.awayScore == b.awayScore
+        && a.homeTimeouts == b.homeTimeouts && a.awayTimeouts == b.awayTimeouts
+        && sameStats(a.homeStats, b.homeStats) && sameStats(a.awayStats, b.awayStats);
+}
+
+/* The state of the recorded game right before step, from playing it straight
+ * through from the kickoff. */
+static GameCheckpoint straightReplay(const EngineContext& context, const GameRecord& record,
+    unsigned int step)
+{
+    GameReplay replay(context, record);
+    Game* game = replay.getGame();
+    while (game->getStepCount() < step && !game->isOver())
+        game->step();
+    return game->checkpoint();
+}
+
+/* Records the game played from seed and checks every way of playing it back.
+ * Returns the number of problems found, after printing them. */
+static unsigned int checkGame(const EngineContext& context, uint64_t seed)
+{
+    const TeamConfig ai = { AI_TEAM, "" };
+    GameRecord original = recordGame(context, seed, ai, ai, CHECKPOINT_INTERVAL);
+
+    std::stringstream stream;
+    writeRecord(stream, original);
+    GameRecord record;
+    if (!readRecord(stream, record) || record.checkpoints.size() != original.checkpoints.size()) {
+        std::cerr << "seed " << seed << ": record didn't read back\n";
+        return 1;
+    }
+
+    unsigned int problems = 0;
+    GameReplay replay(context, record);
+    Game* game = replay.finish();
+    if (game->getStepCount() != record.numSteps || game->getHomeScore() != record.homeScore
+        || game->getAwayScore() != record.awayScore) {
+        std::cerr << "seed " << seed << ": replay finished differently from the recorded game\n";
+        problems++;
+    }
+
+    // Seeks backwards from the end, forwards, and backwards again, between
+    // checkpoints and right onto them.
+    const unsigned int steps[] = { record.numSteps / 2, 3, record.numSteps - 1,
+        CHECKPOINT_INTERVAL * 2, record.numSteps / 3 + 1 };
+    for (unsigned int step : steps) {
+        game = replay.seek(step);
+        if (game->getLastEvents() != 0 && game->getStepCount() % CHECKPOINT_INTERVAL == 0) {
+            std::cerr << "seed " << seed << ": events left over after seeking to step " << step << '\n';
+            problems++;
+        }
+        if (!sameState(game->checkpoint(), straightReplay(context, record, step))) {
+            std::cerr << "seed " << seed << ": seeking to step " << step
+                      << " differs from a straight replay\n";
+            problems++;
+        }
+    }
+
+    // Losing the end of the last checkpoint has to fail the read.
+    std::string bytes = stream.str();
+    std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+    if (readRecord(truncated, record)) {
+        std::cerr << "seed " << seed << ": truncated record read\n";
+        problems++;
+    }
+
+    return problems;
+}
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [options] [MODEL]\n"
+              << "Records games with MODEL (default " MODEL_FILENAME ") and checks they\n"
+              << "play back exactly.\n"
+              << "  -n, --games N      games to record (default " << DEFAULT_GAMES << ")\n"
+              << "  -h, --help         show this message\n";
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t numGames = DEFAULT_GAMES;
+
+    static const struct option longOptions[] = {
+        { "games", required_argument, nullptr, 'n' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+        case 'n':
+            numGames = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (numGames == 0 || argc - optind > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    unsigned int problems = 0;
+    try {
+        EngineContext context(loadModel(optind < argc ? argv[optind] : MODEL_FILENAME), 1);
+        for (uint64_t i = 0; i < numGames; i++)
+            problems += checkGame(context, deriveSeed(42, i));
+
+        // The same record under different rules would play out another game.
+        Ruleset longRuns = DEFAULT_RULESET;
+        for (Gain& gain : longRuns.run)
+            gain.base += 5;
+        EngineContext otherRules(context.getModel(), 1);
+        otherRules.setRuleset(std::make_shared<const Ruleset>(longRuns));
+
+        const TeamConfig ai = { AI_TEAM, "" };
+        GameRecord record = recordGame(context, 1, ai, ai, CHECKPOINT_INTERVAL);
+        try {
+            GameReplay replay(otherRules, record);
+            std::cerr << "replay accepted a record played by another ruleset\n";
+            problems++;
+        } catch (const std::runtime_error&) {
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    std::cout << numGames << " recorded games: ";
+    if (problems) {
+        std::cout << problems << " problems\n";
+        return 1;
+    }
+    std::cout << "ok\n";
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * resultstest.cpp
+ *
+ * Checks packed results (see engine/results.h) against numbers worked out by
+ * hand. Packs a few made up games, counts that don't fit their fields
+ * included, writes them to a results file, maps it back in and checks what
+ * sumResults(), countResults() and filterResults() make of them, and that
+ * out of range counts come back clamped and flagged SATURATED. Exits non-zero
+ * if anything is off.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "engine/results.h"
+
+static const char* const RESULTS_FILE = "results-test.bin";
+
+static unsigned int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "failed: " << what << '\n';
+        failures++;
+    }
+}
+
+static GameResult makeResult(uint64_t seed, unsigned int homeScore, unsigned int awayScore,
+    int homePassingYards, unsigned int homeSacks)
+{
+    GameResult result = {};
+    result.seed = seed;
+    result.homeScore = homeScore;
+    result.awayScore = awayScore;
+    result.numPlays = 150;
+    result.homeStats.passingYards = homePassingYards;
+    result.homeStats.rushingYards = -12;
+    result.homeStats.passingPlays = 30;
+    result.homeStats.completions = 20;
+    result.homeStats.sacks = homeSacks;
+    result.awayStats.rushingYards = 80;
+    result.awayStats.runningPlays = 25;
+    result.awayStats.fumbles = 1;
+    return result;
+}
+
+int main()
+{
+    // Game 2 passes for more yards than 12 bits hold, game 3 has more sacks
+    // than 6 bits do, and game 4 more points than 16 bits do.
+    const GameResult games[] = {
+        makeResult(1, 24, 17, 250, 2),
+        makeResult(2, 10, 31, -40, 0),
+        makeResult(3, 0, 0, 5000, 1),
+        makeResult(4, 14, 0, 180, 70),
+        makeResult(5, 70000, 3, 300, 3),
+    };
+    const size_t numGames = sizeof(games) / sizeof(games[0]);
+
+    try {
+        {
+            PackedResults out(RESULTS_FILE, numGames);
+            std::vector<PackedResult> packed;
+            for (const GameResult& game : games)
+                packed.push_back(packResult(game));
+            out.append(packed.data(), packed.size());
+            out.close();
+        }
+
+        PackedResults in(RESULTS_FILE);
+        check(in.size() == numGames, "every result read back");
+        const PackedResult* results = in.data();
+
+        auto all = [](const PackedResult&) { return true; };
+        ResultTotals totals = sumResults(results, in.size(), all);
+        check(totals.games == 5, "games");
+        check(totals.plays == 750, "plays");
+        check(totals.homeScore == 24 + 10 + 0 + 14 + UINT16_MAX, "home score, clamped");
+        check(totals.awayScore == 17 + 31 + 0 + 0 + 3, "away score");
+        check(totals.homeWins == 3 && totals.awayWins == 1, "wins, with a tie");
+        check(totals.home[PACKED_PASSING_YARDS] == 250 - 40 + 2047 + 180 + 300, "home passing yards, clamped");
+        check(totals.home[PACKED_RUSHING_YARDS] == -60, "negative rushing yards");
+        check(totals.home[PACKED_SACKS] == 2 + 0 + 1 + 63 + 3, "home sacks, clamped");
+        check(totals.away[PACKED_RUSHING_YARDS] == 400, "away rushing yards");
+        check(totals.away[PACKED_FUMBLES] == 5, "away fumbles");
+
+        auto saturated = [](const PackedResult& r) { return (r.flags & SATURATED) != 0; };
+        std::vector<size_t> clamped = filterResults(results, in.size(), saturated);
+        check(clamped == std::vector<size_t>({ 2, 3, 4 }), "games flagged saturated");
+        check(countResults(results, in.size(), saturated) == 3, "count of saturated games");
+
+        auto shutout = [](const PackedResult& r) { return (r.flags & SHUTOUT) != 0; };
+        check(countResults(results, in.size(), shutout) == 2, "shutouts");
+        ResultTotals shutouts = sumResults(results, in.size(), shutout);
+        check(shutouts.games == 2 && shutouts.homeScore == 14, "totals over shutouts");
+
+        // Values that fit come back exactly, and ones that didn't as the
+        // nearest that did.
+        GameResult first = unpackResult(results[0]);
+        check(first.seed == 1 && first.homeScore == 24 && first.awayScore == 17, "first game's score");
+        check(first.homeStats.passingYards == 250 && first.homeStats.rushingYards == -12
+                && first.homeStats.completions == 20 && first.awayStats.fumbles == 1,
+            "first game's stats");
+        check(unpackResult(results[1]).homeStats.passingYards == -40, "negative passing yards");
+        check(unpackResult(results[2]).homeStats.passingYards == 2047, "passing yards clamped");
+        check(unpackResult(results[3]).homeStats.sacks == 63, "sacks clamped");
+        check(unpackResult(results[4]).homeScore == UINT16_MAX, "score clamped");
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        std::remove(RESULTS_FILE);
+        return 1;
+    }
+    std::remove(RESULTS_FILE);
+
+    if (failures) {
+        std::cout << failures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "packed results: ok\n";
+    return 0;
+}
@@ -0,0 +1,539 @@
+/**
+ * daemon.cpp
+ *
+ * A long running simulation service. Loads the playcall model once, starts a
+ * thread pool once, and then takes jobs over a Unix domain socket, so that
+ * small jobs cost about as much as the simulation itself rather than process
+ * startup. See protocol.h for the wire format.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/context.h"
+#include "engine/metrics.h"
+#include "engine/trace.h"
+#include "learn/model.h"
+#include "service/metricsserver.h"
+#include "service/protocol.h"
+
+/* Number of results each worker buffers up before sending them as a frame. */
+static const size_t RESULTS_PER_FRAME = 512;
+
+/* Set by the signal handler to shut the daemon down. */
+static volatile sig_atomic_t shuttingDown = 0;
+
+static void onSignal(int)
+{
+    shuttingDown = 1;
+}
+
+/* Frames that never went out because their client had gone away. */
+static std::atomic<uint64_t> droppedFrames { 0 };
+
+/*
+ * One client's socket. Frames can be written from several pool threads at
+ * once, so writes are serialized here.
+ */
+class Connection {
+private:
+    int fd;
+    std::mutex writeLock;
+    bool broken;
+
+    bool writeAll(const void* data, size_t len)
+    {
+        const char* buf = static_cast<const char*>(data);
+        while (len > 0) {
+            ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            buf += n;
+            len -= n;
+        }
+        return true;
+    }
+
+public:
+    Connection(int fd)
+        : fd(fd)
+        , broken(false)
+    {
+    }
+
+    /* Reads exactly len bytes. Returns false on EOF or error. */
+    bool readAll(void* data, size_t len)
+    {
+        char* buf = static_cast<char*>(data);
+        while (len > 0) {
+            ssize_t n = recv(fd, buf, len, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            buf += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    /* Sends a whole frame. Once a write fails, every later one is dropped. */
+    bool sendFrame(FrameType type, const void* payload, uint32_t count,
+        uint32_t length)
+    {
+        FrameHeader header = {};
+        header.magic = RESPONSE_MAGIC;
+        header.type = type;
+        header.count = count;
+        header.length = length;
+
+        std::lock_guard<std::mutex> guard(writeLock);
+        if (!broken)
+            broken = !writeAll(&header, sizeof(header)) || !writeAll(payload, length);
+        if (broken)
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return !broken;
+    }
+
+    bool sendError(const std::string& message)
+    {
+        return sendFrame(ERROR_FRAME, message.data(), 1, message.size());
+    }
+};
+
+/* What each worker keeps while a job runs. Padded out so that workers don't
+ * share cache lines.
+ */
+struct alignas(64) WorkerState {
+    std::vector<WireResult> pending;
+    JobSummary totals = {};
+};
+
+static void addResult(WorkerState& state, const GameResult& result)
+{
+    JobSummary& t = state.totals;
+    t.games++;
+    t.plays += result.numPlays;
+    t.homeWins += result.homeScore > result.awayScore;
+    t.awayWins += result.awayScore > result.homeScore;
+    t.homePoints += result.homeScore;
+    t.awayPoints += result.awayScore;
+    t.homePassingYards += result.homeStats.passingYards;
+    t.homeRushingYards += result.homeStats.rushingYards;
+    t.awayPassingYards += result.awayStats.passingYards;
+    t.awayRushingYards += result.awayStats.rushingYards;
+}
+
+static WireResult toWire(size_t index, const GameResult& result)
+{
+    WireResult wire = {};
+    wire.index = index;
+    wire.homeScore = result.homeScore;
+    wire.awayScore = result.awayScore;
+    wire.plays = result.numPlays;
+    wire.homePassingYards = result.homeStats.passingYards;
+    wire.homeRushingYards = result.homeStats.rushingYards;
+    wire.awayPassingYards = result.awayStats.passingYards;
+    wire.awayRushingYards = result.awayStats.rushingYards;
+    wire.homeInterceptions = result.homeStats.interceptions;
+    wire.awayInterceptions = result.awayStats.interceptions;
+    return wire;
+}
+
+static void flushResults(Connection& conn, std::vector<WireResult>& pending)
+{
+    if (pending.empty())
+        return;
+
+    conn.sendFrame(RESULTS_FRAME, pending.data(), pending.size(),
+        pending.size() * sizeof(WireResult));
+    pending.clear();
+}
+
+/*
+ * Checks a request, returning an empty string if it's fine or else what's
+ * wrong with it.
+ */
+static std::string validate(const JobRequest& req)
+{
+    if (req.magic != REQUEST_MAGIC)
+        return "bad magic number";
+    if (req.version != PROTOCOL_VERSION)
+        return "unsupported protocol version";
+    if (req.homeType != AI_TEAM || req.awayType != AI_TEAM)
+        return "only AI teams can be simulated by the daemon";
+    return "";
+}
+
+/*
+ * Runs one job on the shared pool, streaming results back as workers fill up
+ * their buffers, and finishing with the summary.
+ */
+static void runJob(Connection& conn, const JobRequest& req,
+    const EngineContext& context, ThreadPool& pool)
+{
+    FB_TRACE_SCOPE("job", "daemon");
+    bool wantResults = req.flags & WANT_RESULTS;
+
+    BatchConfig config;
+    config.context = &context;
+    config.seed = req.seed;
+    config.numGames = req.numGames;
+    config.numThreads = std::min<size_t>(pool.size(),
+        (req.numGames + RESULTS_PER_FRAME - 1) / RESULTS_PER_FRAME);
+    config.home.type = static_cast<TeamType>(req.homeType);
+    config.away.type = static_cast<TeamType>(req.awayType);
+
+    std::vector<WorkerState> workers(std::max(1u, config.numThreads));
+
+    ResultSink sink = [&](unsigned int worker, size_t index, const GameResult& result) {
+        WorkerState& state = workers[worker];
+        addResult(state, result);
+        if (wantResults) {
+            state.pending.push_back(toWire(index, result));
+            if (state.pending.size() >= RESULTS_PER_FRAME)
+                flushResults(conn, state.pending);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    runBatch(config, runHeadless, sink, pool);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    JobSummary summary = {};
+    for (WorkerState& state : workers) {
+        flushResults(conn, state.pending);
+        const JobSummary& t = state.totals;
+        summary.games += t.games;
+        summary.plays += t.plays;
+        summary.homeWins += t.homeWins;
+        summary.awayWins += t.awayWins;
+        summary.homePoints += t.homePoints;
+        summary.awayPoints += t.awayPoints;
+        summary.homePassingYards += t.homePassingYards;
+        summary.homeRushingYards += t.homeRushingYards;
+        summary.awayPassingYards += t.awayPassingYards;
+        summary.awayRushingYards += t.awayRushingYards;
+    }
+    summary.micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+    conn.sendFrame(SUMMARY_FRAME, &summary, 1, sizeof(summary));
+}
+
+/*
+ * Handles every request from one client until it hangs up.
+ */
+static void serveClient(int fd, const EngineContext& context, ThreadPool& pool)
+{
+    Connection conn(fd);
+    JobRequest req;
+
+    while (!shuttingDown && conn.readAll(&req, sizeof(req))) {
+        std::string error = validate(req);
+        if (!error.empty()) {
+            conn.sendError(error);
+            break;
+        }
+        runJob(conn, req, context, pool);
+    }
+}
+
+static int listenOn(const std::string& path)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << '\n';
+        return -1;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Listens on localhost only: there's no authentication of any kind. */
+static int listenOnPort(unsigned int port)
+{
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Resident set size of this process right now, in bytes. */
+static uint64_t residentBytes()
+{
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+
+    unsigned long size = 0, resident = 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return uint64_t(resident) * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * What a scrape gets: the engine's counts, plus the daemon's own. Games per
+ * second are over the time since the last scrape, so a scraper polling every
+ * few seconds sees the current rate rather than the average since startup.
+ * Only ever called from the metrics server's thread.
+ */
+class DaemonMetrics {
+private:
+    ThreadPool& pool;
+    std::chrono::steady_clock::time_point lastScrape;
+    uint64_t lastGames;
+
+public:
+    DaemonMetrics(ThreadPool& pool)
+        : pool(pool)
+        , lastScrape(std::chrono::steady_clock::now())
+        , lastGames(0)
+    {
+    }
+
+    void write(std::ostream& out)
+    {
+        MetricTotals totals = metricTotals();
+        writeMetrics(out, totals);
+
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - lastScrape;
+        double rate = elapsed.count() > 0 ? (totals.games - lastGames) / elapsed.count() : 0;
+        lastScrape = now;
+        lastGames = totals.games;
+
+        out << "# HELP fb_games_per_second Games simulated per second since the last scrape.\n"
+            << "# TYPE fb_games_per_second gauge\n"
+            << "fb_games_per_second " << rate << '\n'
+            << "# HELP fb_queue_depth Tasks waiting for a simulation thread.\n"
+            << "# TYPE fb_queue_depth gauge\n"
+            << "fb_queue_depth " << pool.queueDepth() << '\n'
+            << "# HELP fb_dropped_frames_total Result frames dropped because their client went away.\n"
+            << "# TYPE fb_dropped_frames_total counter\n"
+            << "fb_dropped_frames_total " << droppedFrames.load(std::memory_order_relaxed) << '\n'
+            << "# HELP process_resident_memory_bytes Resident memory size in bytes.\n"
+            << "# TYPE process_resident_memory_bytes gauge\n"
+            << "process_resident_memory_bytes " << residentBytes() << '\n';
+    }
+};
+
+void printUsage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  -S, --socket PATH    where to listen (default " DEFAULT_SOCKET_PATH ")\n"
+              << "  -j, --threads N      simulation threads (default: one per core)\n"
+              << "  -T, --trace FILE     trace every job, and write it to FILE on shutdown\n"
+              << "                       (needs a build with FB_TRACE)\n"
+              << "      --trace-sample N only trace every Nth game (default 1)\n"
+              << "  -M, --metrics-port N serve Prometheus metrics on localhost port N\n"
+              << "      --metrics-socket PATH\n"
+              << "                       same, on a Unix domain socket\n"
+              << "  -h, --help           show this message\n";
+}
+
+int main(int argc, char* argv[])
+{
+    enum { TRACE_SAMPLE_OPT = 256,
+        METRICS_SOCKET_OPT };
+    static const struct option longOpts[] = {
+        { "socket", required_argument, nullptr, 'S' },
+        { "threads", required_argument, nullptr, 'j' },
+        { "trace", required_argument, nullptr, 'T' },
+        { "trace-sample", required_argument, nullptr, TRACE_SAMPLE_OPT },
+        { "metrics-port", required_argument, nullptr, 'M' },
+        { "metrics-socket", required_argument, nullptr, METRICS_SOCKET_OPT },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    std::string path = DEFAULT_SOCKET_PATH;
+    unsigned int numThreads = 0;
+    std::string tracePath;
+    unsigned int traceSample = 1;
+    unsigned int metricsPort = 0;
+    std::string metricsPath;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "S:j:T:M:h", longOpts, nullptr)) != -1) {
+        switch (c) {
+        case 'S':
+            path = optarg;
+            break;
+        case 'j':
+            numThreads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'T':
+            tracePath = optarg;
+            break;
+        case TRACE_SAMPLE_OPT:
+            traceSample = std::max(1ul, std::strtoul(optarg, nullptr, 10));
+            break;
+        case 'M':
+            metricsPort = std::strtoul(optarg, nullptr, 10);
+            break;
+        case METRICS_SOCKET_OPT:
+            metricsPath = optarg;
+            break;
+        case 'h':
+        default:
+            printUsage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+#ifndef FB_TRACE
+    if (!tracePath.empty()) {
+        std::cerr << "--trace needs a build configured with -DFB_TRACE=ON\n";
+        return 1;
+    }
+#endif
+
+    // No SA_RESTART, so that accept() wakes up when we're told to stop.
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::shared_ptr<const PlaycallModel> model;
+    try {
+        model = loadModel();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    // Jobs only read from the context, so one is shared by every client.
+    const EngineContext context(model, 0);
+    ThreadPool pool(numThreads);
+
+    int listener = listenOn(path);
+    if (listener < 0)
+        return 1;
+    std::cerr << "Listening on " << path << " with " << pool.size() << " threads\n";
+    if (!tracePath.empty())
+        startTrace(traceSample);
+
+    DaemonMetrics metrics(pool);
+    std::unique_ptr<MetricsServer> metricsServer;
+    if (metricsPort || !metricsPath.empty()) {
+        int fd = metricsPort ? listenOnPort(metricsPort) : listenOn(metricsPath);
+        if (fd < 0)
+            return 1;
+        enableMetrics();
+        metricsServer = std::make_unique<MetricsServer>(fd,
+            [&metrics](std::ostream& out) { metrics.write(out); });
+        std::cerr << "Serving metrics on "
+                  << (metricsPort ? "port " + std::to_string(metricsPort) : metricsPath) << '\n';
+    }
+
+    // Each client gets a thread of its own, which closes its socket and drops
+    // it from clientFds on the way out, so nothing is left to join.
+    std::set<int> clientFds;
+    std::mutex clientLock;
+    std::condition_variable clientsGone;
+
+    while (!shuttingDown) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            break;
+        }
+
+        std::lock_guard<std::mutex> guard(clientLock);
+        clientFds.insert(fd);
+        std::thread([fd, &context, &pool, &clientFds, &clientLock, &clientsGone] {
+            serveClient(fd, context, pool);
+
+            // Closed under the lock, so shutdown below never sees a reused fd.
+            std::lock_guard<std::mutex> guard(clientLock);
+            clientFds.erase(fd);
+            close(fd);
+            if (clientFds.empty())
+                clientsGone.notify_all();
+        }).detach();
+    }
+
+    // Kick any connected clients off and wait for their threads to finish up.
+    {
+        std::unique_lock<std::mutex> lock(clientLock);
+        for (int fd : clientFds)
+            shutdown(fd, SHUT_RDWR);
+        clientsGone.wait(lock, [&clientFds] { return clientFds.empty(); });
+    }
+
+    close(listener);
+    unlink(path.c_str());
+    metricsServer.reset();
+    if (!metricsPath.empty())
+        unlink(metricsPath.c_str());
+
+    // Every job is done, so nothing is recording any more.
+    if (!tracePath.empty()) {
+        try {
+            writeTrace(tracePath);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "service/metricsserver.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <utility>
+
+/* Most of a request that's read, and how long a scraper gets to send it.
+ * Only the request line matters, and not even that. */
+static const size_t MAX_REQUEST = 4096;
+static const int REQUEST_TIMEOUT_SECS = 1;
+
+MetricsServer::MetricsServer(int listener, Writer write)
+    : listener(listener)
+    , write(std::move(write))
+{
+    if (pipe2(stopPipe, O_CLOEXEC) < 0) {
+        close(listener);
+        throw std::runtime_error("could not create the metrics server's pipe");
+    }
+    thread = std::thread(&MetricsServer::serve, this);
+}
+
+MetricsServer::~MetricsServer()
+{
+    char c = 0;
+    ::write(stopPipe[1], &c, 1);
+    thread.join();
+
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    close(listener);
+}
+
+void MetricsServer::serve()
+{
+    struct pollfd fds[2] = { { listener, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return;
+        }
+        if (fds[1].revents)
+            return;
+
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        respond(fd);
+        close(fd);
+    }
+}
+
+void MetricsServer::respond(int fd)
+{
+    struct timeval timeout = { REQUEST_TIMEOUT_SECS, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Read up to the blank line that ends the headers, so the scraper isn't
+    // cut off mid request, which some treat as an error.
+    std::string request;
+    char buf[512];
+    while (request.size() < MAX_REQUEST && request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        request.append(buf, n);
+    }
+
+    std::ostringstream body;
+    write(body);
+    std::string text = body.str();
+
+    std::ostringstream response;
+    response << "HTTP/1.0 200 OK\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << text.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << text;
+    std::string out = response.str();
+
+    const char* data = out.data();
+    size_t len = out.size();
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        data += n;
+        len -= n;
+    }
+}
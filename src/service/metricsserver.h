@@ -0,0 +1,39 @@
+#ifndef __METRICSSERVER_H
+#define __METRICSSERVER_H
+
+#include <functional>
+#include <ostream>
+#include <thread>
+
+/**
+ * Serves metrics in Prometheus' text format over plain HTTP, from a thread of
+ * its own. Every request gets the same answer, whatever its path, so it can be
+ * scraped as http://localhost:PORT/metrics. Scrapes are rare and cheap, so
+ * they're answered one at a time.
+ */
+class MetricsServer {
+public:
+    /* Writes the body of a response. */
+    typedef std::function<void(std::ostream& out)> Writer;
+
+private:
+    int listener;
+    int stopPipe[2];
+    Writer write;
+    std::thread thread;
+
+    void serve();
+    void respond(int fd);
+
+public:
+    /* Starts serving on listener, which it closes when it's done. Throws
+     * std::runtime_error if the thread can't be set up. */
+    MetricsServer(int listener, Writer write);
+    /* Stops serving, and waits for any scrape in progress. */
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+};
+
+#endif
@@ -0,0 +1,526 @@
+/**
+ * playserver.cpp
+ *
+ * Interactive games over a socket. Each client that connects calls the plays
+ * for the home team of a game of its own against an AITeam, with the same
+ * prompts UserTeam gives on a terminal: it's sent the situation and a menu
+ * before each of its calls, and answers with a line holding the number of its
+ * choice.
+ *
+ * Games are played as coroutines (see engine/gametask.h), so a game waiting
+ * on its player is just a suspended coroutine rather than a blocked thread.
+ * Each event loop thread has its own epoll set and its own sessions, and
+ * takes new connections off the shared listening socket, so a few threads
+ * can keep thousands of games going.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <sstream>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/context.h"
+#include "engine/game.h"
+#include "engine/gametask.h"
+#include "engine/observers.h"
+#include "engine/playlog.h"
+#include "engine/team.h"
+#include "learn/model.h"
+
+/* Default path for the server's socket. */
+#define DEFAULT_PLAY_SOCKET_PATH "/tmp/fb-play.sock"
+
+/* Longest line a client may send before it's disconnected. */
+static const size_t MAX_LINE = 256;
+/* Events handled per epoll_wait(). */
+static const int MAX_EVENTS = 256;
+
+/* Written to by the signal handler, so every event loop wakes up to stop. */
+static int stopPipe[2] = { -1, -1 };
+
+static void onSignal(int)
+{
+    char c = 0;
+    ssize_t ignored = write(stopPipe[1], &c, 1);
+    (void)ignored;
+}
+
+/*
+ * Writes the outcome of each of the session's plays into its output.
+ */
+class SessionCommentator {
+private:
+    std::ostream& out;
+
+public:
+    static constexpr unsigned int events = PLAY_EVENT;
+
+    explicit SessionCommentator(std::ostream& out)
+        : out(out)
+    {
+    }
+
+    void onGameEvent(GameEvent, Game* game)
+    {
+        const PlayOutcome* outcome = game->getLastOutcome();
+        describeOutcome(out, outcome->result, outcome->yardsGained,
+            outcome->touchdown, outcome->changePoss);
+    }
+};
+
+/*
+ * One connected player and their game. Only ever touched by the event loop
+ * that accepted it.
+ */
+class Session {
+private:
+    int fd;
+    /* the team the player calls plays for */
+    Team* user;
+    Game game;
+    /* text waiting to be sent, and how much of it has been */
+    std::ostringstream out;
+    std::string unsent;
+    size_t sentUpTo;
+    /* what's been read that isn't a whole line yet */
+    std::string input;
+    SessionCommentator commentator;
+    GameTask task;
+    /* the request the player is answering, if any */
+    PlayRequest* waitingOn;
+    bool finished;
+
+    /* Plays until the game needs the player, or is over. */
+    void advance();
+    void handleLine(const std::string& line);
+
+public:
+    Session(int fd, EngineContext& context, Team* user, Team* ai);
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    int getFd() const { return fd; }
+    /* Reads whatever the client sent. Returns false once the session should
+     * be closed. */
+    bool onReadable();
+    /* Sends as much queued output as the socket takes. Returns false if the
+     * connection is broken. */
+    bool flush();
+    /* True if there is output the socket wouldn't take yet. */
+    bool hasUnsent() const { return sentUpTo < unsent.size(); }
+    /* True once the game is over and everything has been sent. */
+    bool isDone() const { return finished && !hasUnsent(); }
+};
+
+Session::Session(int fd, EngineContext& context, Team* user, Team* ai)
+    : fd(fd)
+    , user(user)
+    , game(&context, user, ai)
+    , sentUpTo(0)
+    , commentator(out)
+    , task(playAsync(ObservedGame<SessionCommentator>(&game, commentator)))
+    , waitingOn(nullptr)
+    , finished(false)
+{
+    out << "You have the home team. Game seed " << game.getSeed() << "\n";
+    advance();
+}
+
+Session::~Session()
+{
+    close(fd);
+}
+
+void Session::advance()
+{
+    while (true) {
+        task.resume();
+        if (task.done()) {
+            waitingOn = nullptr;
+            out << "Final score: " << game.getHomeScore() << "-" << game.getAwayScore() << "\n";
+            finished = true;
+            return;
+        }
+
+        // The AI's calls are made on the spot; only the player's are waited on.
+        waitingOn = nullptr;
+        for (unsigned int side = 0; side < 2; side++) {
+            PlayRequest& request = task.requests()[side];
+            const PlaycallModel* model = nullptr;
+            switch (request.team->prepareCall(request.situation, request.rng, request.call, model)) {
+            case CALL_MADE:
+                break;
+            case CALL_NEEDS_MODEL:
+                request.call = getPlayCall(*model, request.situation, request.rng);
+                break;
+            case CALL_PENDING:
+                waitingOn = &request;
+                break;
+            }
+        }
+
+        if (waitingOn) {
+            out << "Score: " << game.getHomeScore() << "-" << game.getAwayScore()
+                << (game.getOffenseTeam() == user ? ", you have the ball\n" : ", you're on defense\n");
+            UserTeam::renderSituation(out, waitingOn->situation);
+            UserTeam::renderPrompt(out);
+            return;
+        }
+    }
+}
+
+void Session::handleLine(const std::string& line)
+{
+    // Anything sent after the game is over is ignored.
+    if (finished || !waitingOn)
+        return;
+
+    if (!UserTeam::parseChoice(line, waitingOn->call)) {
+        UserTeam::renderError(out);
+        UserTeam::renderPrompt(out);
+        return;
+    }
+
+    advance();
+}
+
+bool Session::onReadable()
+{
+    char buf[4096];
+    while (true) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+            return false;
+        input.append(buf, n);
+    }
+
+    size_t start = 0;
+    size_t end;
+    while ((end = input.find('\n', start)) != std::string::npos) {
+        handleLine(input.substr(start, end - start));
+        start = end + 1;
+    }
+    input.erase(0, start);
+
+    return input.size() <= MAX_LINE;
+}
+
+bool Session::flush()
+{
+    if (out.tellp() > 0) {
+        // Drop what's already gone before queueing more.
+        unsent.erase(0, sentUpTo);
+        sentUpTo = 0;
+        unsent += out.str();
+        out.str("");
+    }
+
+    while (hasUnsent()) {
+        ssize_t n = send(fd, unsent.data() + sentUpTo, unsent.size() - sentUpTo, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (n <= 0)
+            return false;
+        sentUpTo += n;
+    }
+
+    return true;
+}
+
+/*
+ * One thread's worth of sessions, and the epoll set that drives them.
+ */
+class EventLoop {
+private:
+    int epfd;
+    int listener;
+    EngineContext context;
+    AITeam ai;
+    UserTeam user;
+    std::unordered_map<int, std::unique_ptr<Session>> sessions;
+
+    void acceptAll();
+    /* Flushes a session, watching for the socket to drain if that didn't
+     * send everything. Closes it if it's done or broken. */
+    void update(Session* session);
+    void drop(int fd);
+
+public:
+    /* Each loop needs its own context, since sessions take seeds from it. */
+    EventLoop(int listener, const EngineContext& context);
+    ~EventLoop();
+
+    void run();
+};
+
+EventLoop::EventLoop(int listener, const EngineContext& context)
+    : epfd(epoll_create1(EPOLL_CLOEXEC))
+    , listener(listener)
+    , context(context)
+    , ai(context)
+{
+    // EPOLLEXCLUSIVE wakes only one of the loops for each new connection.
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = listener;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.fd = stopPipe[0];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, stopPipe[0], &ev);
+}
+
+EventLoop::~EventLoop()
+{
+    sessions.clear();
+    close(epfd);
+}
+
+void EventLoop::acceptAll()
+{
+    while (true) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        auto session = std::make_unique<Session>(fd, context, &user, &ai);
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            continue;
+
+        Session* s = session.get();
+        sessions.emplace(fd, std::move(session));
+        update(s);
+    }
+}
+
+void EventLoop::drop(int fd)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    sessions.erase(fd);
+}
+
+void EventLoop::update(Session* session)
+{
+    int fd = session->getFd();
+    if (!session->flush() || session->isDone()) {
+        drop(fd);
+        return;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    if (session->hasUnsent())
+        ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EventLoop::run()
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == stopPipe[0])
+                return;
+            if (fd == listener) {
+                acceptAll();
+                continue;
+            }
+
+            auto it = sessions.find(fd);
+            if (it == sessions.end())
+                continue;
+            Session* session = it->second.get();
+
+            uint32_t ev = events[i].events;
+            if ((ev & EPOLLIN) && !session->onReadable()) {
+                drop(fd);
+                continue;
+            }
+            if (ev & (EPOLLERR | EPOLLHUP)) {
+                drop(fd);
+                continue;
+            }
+            update(session);
+        }
+    }
+}
+
+static int listenOnPath(const std::string& path)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << '\n';
+        return -1;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Listens on localhost only: there's no authentication of any kind. */
+static int listenOnPort(unsigned int port)
+{
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void printUsage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  -S, --socket PATH    Unix socket to listen on (default " DEFAULT_PLAY_SOCKET_PATH ")\n"
+              << "  -p, --port N         listen on localhost port N instead\n"
+              << "  -j, --threads N      event loop threads (default: one per core)\n"
+              << "  -h, --help           show this message\n";
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option longOpts[] = {
+        { "socket", required_argument, nullptr, 'S' },
+        { "port", required_argument, nullptr, 'p' },
+        { "threads", required_argument, nullptr, 'j' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    std::string path = DEFAULT_PLAY_SOCKET_PATH;
+    unsigned int port = 0;
+    unsigned int numThreads = 0;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "S:p:j:h", longOpts, nullptr)) != -1) {
+        switch (c) {
+        case 'S':
+            path = optarg;
+            break;
+        case 'p':
+            port = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'j':
+            numThreads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'h':
+        default:
+            printUsage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::shared_ptr<const PlaycallModel> model;
+    try {
+        model = loadModel();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    if (pipe2(stopPipe, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    int listener = port ? listenOnPort(port) : listenOnPath(path);
+    if (listener < 0)
+        return 1;
+    std::cerr << "Listening on " << (port ? "localhost:" + std::to_string(port) : path)
+              << " with " << numThreads << " threads\n";
+
+    // Every loop gets its own context, seeded differently, so that no two
+    // sessions play the same game.
+    EngineContext context(model, time(0));
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    for (unsigned int i = 0; i < numThreads; i++)
+        loops.push_back(std::make_unique<EventLoop>(listener, EngineContext(model, context.nextSeed())));
+
+    std::vector<std::thread> threads;
+    for (auto& loop : loops)
+        threads.emplace_back(&EventLoop::run, loop.get());
+    for (std::thread& t : threads)
+        t.join();
+
+    loops.clear();
+    close(listener);
+    if (!port)
+        unlink(path.c_str());
+
+    return 0;
+}
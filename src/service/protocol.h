@@ -0,0 +1,106 @@
+#ifndef __PROTOCOL_H
+#define __PROTOCOL_H
+
+#include <cstdint>
+
+/**
+ * Wire format for talking to fb-daemon over its Unix domain socket.
+ *
+ * A client sends a JobRequest, and the daemon answers with a stream of frames.
+ * Each frame is a FrameHeader followed by header.length bytes of payload:
+ *
+ * RESULTS_FRAME: header.count WireResults, only sent if the job asked for
+ * WANT_RESULTS. Games finish out of order, so every result carries its index.
+ * SUMMARY_FRAME: a single JobSummary. Always the last frame of a job.
+ * ERROR_FRAME: a message (not null terminated) saying what was wrong with the
+ * request. The daemon closes the connection after sending one.
+ *
+ * After the summary the client can send another request on the same
+ * connection. Everything is little endian and tightly packed.
+ */
+
+/* "FBJQ" and "FBJR" */
+const uint32_t REQUEST_MAGIC = 0x514a4246;
+const uint32_t RESPONSE_MAGIC = 0x524a4246;
+const uint16_t PROTOCOL_VERSION = 1;
+
+/* Default path for the daemon's socket. */
+#define DEFAULT_SOCKET_PATH "/tmp/fb-engine.sock"
+
+enum RequestFlags : uint16_t {
+    /* Stream back every game's result, not just the summary. */
+    WANT_RESULTS = 1 << 0
+};
+
+enum FrameType : uint8_t {
+    RESULTS_FRAME = 1,
+    SUMMARY_FRAME = 2,
+    ERROR_FRAME = 3
+};
+
+#pragma pack(push, 1)
+
+/* "Simulate numGames games between these two teams." Team types are
+ * TeamType values.
+ */
+struct JobRequest {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint64_t seed;
+    uint32_t numGames;
+    uint8_t homeType;
+    uint8_t awayType;
+    uint8_t reserved[10];
+};
+
+struct FrameHeader {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t reserved[3];
+    /* Number of records in the payload. */
+    uint32_t count;
+    /* Size of the payload in bytes. */
+    uint32_t length;
+};
+
+/* One game's result. Game index i of a job was seeded with
+ * deriveSeed(request.seed, i).
+ */
+struct WireResult {
+    uint32_t index;
+    uint16_t homeScore;
+    uint16_t awayScore;
+    uint16_t plays;
+    int16_t homePassingYards;
+    int16_t homeRushingYards;
+    int16_t awayPassingYards;
+    int16_t awayRushingYards;
+    uint8_t homeInterceptions;
+    uint8_t awayInterceptions;
+    uint8_t reserved[4];
+};
+
+/* Totals over every game in a job. */
+struct JobSummary {
+    uint64_t games;
+    uint64_t plays;
+    uint64_t homeWins;
+    uint64_t awayWins;
+    uint64_t homePoints;
+    uint64_t awayPoints;
+    int64_t homePassingYards;
+    int64_t homeRushingYards;
+    int64_t awayPassingYards;
+    int64_t awayRushingYards;
+    /* Wall clock time the daemon spent on the job, in microseconds. */
+    uint64_t micros;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(JobRequest) == 32, "JobRequest must be 32 bytes");
+static_assert(sizeof(FrameHeader) == 16, "FrameHeader must be 16 bytes");
+static_assert(sizeof(WireResult) == 24, "WireResult must be 24 bytes");
+
+#endif
@@ -0,0 +1,191 @@
+/**
+ * stress.cpp
+ *
+ * Checks that independent engines can run side by side in one process. Sets
+ * up a number of EngineContexts, each with a model object of its own (cycling
+ * through the model files given), a seed of its own and, for every other one,
+ * a ruleset of its own, and an away team whose model comes through the shared
+ * ModelCache. Half of them play their games interleaved.
+ *
+ * Every context's batch is first played on its own, then all of them are
+ * played again at once, each on several threads. Any state shared between
+ * contexts would show up as a game that came out differently the second
+ * time; build with -DFB_SANITIZE=thread to have ThreadSanitizer check for
+ * races as well. Exits non-zero if any game differs.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/context.h"
+#include "engine/ruleset.h"
+#include "learn/learn.h"
+#include "learn/model.h"
+
+static const unsigned int DEFAULT_CONTEXTS = 8;
+static const size_t DEFAULT_GAMES = 2000;
+static const unsigned int DEFAULT_THREADS = 2;
+
+struct StressOptions {
+    unsigned int numContexts = DEFAULT_CONTEXTS;
+    size_t numGames = DEFAULT_GAMES;
+    /* worker threads for each context's batch */
+    unsigned int numThreads = DEFAULT_THREADS;
+    std::vector<std::string> models;
+};
+
+/* One context and the batch it plays. */
+struct StressRun {
+    std::unique_ptr<EngineContext> context;
+    BatchConfig config;
+    /* score and length of each game, from playing the batch alone */
+    std::vector<uint64_t> expected;
+};
+
+static uint64_t fingerprint(const GameResult& result)
+{
+    return uint64_t(result.homeScore) << 48 | uint64_t(result.awayScore) << 32 | result.numPlays;
+}
+
+/* Plays run's batch, returning each game's fingerprint. */
+static std::vector<uint64_t> play(const StressRun& run)
+{
+    std::vector<uint64_t> results(run.config.numGames);
+    runBatch(run.config, runHeadless, [&results](unsigned int, size_t index, const GameResult& result) {
+        results[index] = fingerprint(result);
+    });
+    return results;
+}
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [options] [MODEL...]\n"
+              << "Plays batches from several engine contexts at once, cycling through the\n"
+              << "given model files (default " MODEL_FILENAME ").\n"
+              << "  -c, --contexts N   contexts to run at once (default " << DEFAULT_CONTEXTS << ")\n"
+              << "  -n, --games N      games in each context's batch (default " << DEFAULT_GAMES << ")\n"
+              << "  -j, --threads N    threads for each batch (default " << DEFAULT_THREADS << ")\n"
+              << "  -h, --help         show this message\n";
+}
+
+static bool parseOptions(int argc, char* argv[], StressOptions& opts)
+{
+    static const struct option longOptions[] = {
+        { "contexts", required_argument, nullptr, 'c' },
+        { "games", required_argument, nullptr, 'n' },
+        { "threads", required_argument, nullptr, 'j' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:n:j:h", longOptions, nullptr)) != -1) {
+        switch (opt) {
+        case 'c':
+            opts.numContexts = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'n':
+            opts.numGames = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'j':
+            opts.numThreads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'h':
+            usage(argv[0]);
+            std::exit(0);
+        default:
+            usage(argv[0]);
+            return false;
+        }
+    }
+
+    for (int i = optind; i < argc; i++)
+        opts.models.push_back(argv[i]);
+    if (opts.models.empty())
+        opts.models.push_back(MODEL_FILENAME);
+
+    if (opts.numContexts == 0 || opts.numGames == 0 || opts.numThreads == 0) {
+        usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    StressOptions opts;
+    if (!parseOptions(argc, argv, opts))
+        return 1;
+
+    // The odd contexts play by a ruleset of their own, so that any context
+    // picking up another's would change its games.
+    Ruleset longRuns = DEFAULT_RULESET;
+    for (Gain& gain : longRuns.run)
+        gain.base += 5;
+    auto otherRules = std::make_shared<const Ruleset>(longRuns);
+
+    std::vector<StressRun> runs(opts.numContexts);
+    try {
+        for (unsigned int i = 0; i < opts.numContexts; i++) {
+            StressRun& run = runs[i];
+            const std::string& model = opts.models[i % opts.models.size()];
+            run.context = std::make_unique<EngineContext>(loadModel(model), i);
+            if (i % 2)
+                run.context->setRuleset(otherRules);
+
+            run.config.context = run.context.get();
+            run.config.seed = deriveSeed(42, i);
+            run.config.numGames = opts.numGames;
+            run.config.numThreads = opts.numThreads;
+            run.config.home = { AI_TEAM, "" };
+            run.config.away = { AI_TEAM, opts.models[(i + 1) % opts.models.size()] };
+            run.config.interleave = i % 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    // Loads the away teams' models into the cache too, so nothing can fail
+    // once the contexts are running at once.
+    try {
+        for (StressRun& run : runs)
+            run.expected = play(run);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    std::vector<std::vector<uint64_t>> results(runs.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < runs.size(); i++)
+        threads.emplace_back([&runs, &results, i] { results[i] = play(runs[i]); });
+    for (std::thread& t : threads)
+        t.join();
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < runs.size(); i++) {
+        for (size_t g = 0; g < opts.numGames; g++) {
+            if (results[i][g] != runs[i].expected[g]) {
+                if (mismatches++ < 10)
+                    std::cerr << "context " << i << ", game " << g << " came out differently\n";
+            }
+        }
+    }
+
+    std::cout << runs.size() << " contexts of " << opts.numGames << " games on "
+              << opts.numThreads << " threads each: ";
+    if (mismatches) {
+        std::cout << mismatches << " games differed\n";
+        return 1;
+    }
+    std::cout << "ok\n";
+    return 0;
+}